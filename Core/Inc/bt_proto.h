@@ -0,0 +1,89 @@
+// bt_proto.h  — HC-05 上的 binary 指令 (大量匯入 / 匯出白名單、狀態查詢)
+//
+// 跟原本的 ASCII PIN 共用同一條 UART：vBtTask 每收到一個 byte 先丟給 bt_proto_input，
+// 它回 0 的 byte 才照舊當 PIN 解析。0xA5 不會出現在 PIN 裡，所以拿來當 frame 開頭。
+//
+// Frame (request / response 都一樣，多 byte 欄位都是 little-endian)：
+//   [0xA5] [type] [seq] [len_lo] [len_hi] [payload ...len] [crc_lo] [crc_hi]
+//   crc = CRC16-CCITT (init 0xFFFF)，從 type 算到 payload 最後一個 byte
+//
+// Response 的 type = request type | 0x80，seq 照抄，payload 第一個 byte 是 BT_PROTO_ST_xxx。
+// CRC 錯的 frame 回 BT_PROTO_RSP_NAK (沒有 payload 以外的資訊可信)，host 直接重送。
+// 一個 frame 處理完 (Flash 寫完) 才回 response，host 收到 response 再送下一個。
+//
+// 指令：
+//   STATUS      req: -            rsp: st, ver, unlocked, cards(4), max_cards(4),
+//                                      log_used(4), log_size(4), last_seq(2), block,
+//                                      bt_rx_dropped(4), bad_frames(4), long_cards(4)
+//   ADD_BATCH   req: n x UID       rsp: st, written(2), skipped(2)   (已經在的卡算 skipped)
+//                                      UID = 4 byte + BCC；有一個 BCC 不對整個 frame 不收 (BT_PROTO_ST_UID)
+//                                      一個 frame 是一個 card_db transaction，斷電時整個 frame 不是全有就是全無
+//   DEL_BATCH   req: n x UID       rsp: st, written(2), skipped(2)   (不在的卡算 skipped)
+//   EXPORT      req: -            rsp: 好幾個 frame，每個是 st, part(2), count, count x UID
+//                                      最後一個 count = 0 表示結束，後面接 omitted(4)
+//   ADD_UIDS    req: n x [len][UID] rsp: 同 ADD_BATCH。len = 4 / 7 / 10，UID 不含 BCC
+//   DEL_UIDS    req: n x [len][UID] rsp: 同 DEL_BATCH
+//   EXPORT_UIDS req: -            rsp: 同 EXPORT，但每個 frame 是 count x [len][UID] (塞得下幾筆就幾筆)
+//                                      count = 0 的 frame 表示結束
+//
+// UID 長度：ADD_BATCH / DEL_BATCH / EXPORT 的 5-byte 格式只放得下 4-byte UID。
+// EXPORT 會跳過 7 / 10-byte 的卡，跳過幾張放在最後一個 frame 的 omitted (STATUS 的 long_cards 也是)；
+// 要完整備份 / 還原請用 EXPORT_UIDS + ADD_UIDS (version 2 起)。
+// ADD / DEL / EXPORT 只有在開鎖狀態才接受 (跟按鍵 A / B 一樣)，否則回 BT_PROTO_ST_LOCKED。
+
+#ifndef BT_PROTO_H
+#define BT_PROTO_H
+
+#include <stdint.h>
+#include "usart.h"
+#include "card_db.h"
+
+#define BT_PROTO_VERSION        2U
+#define BT_PROTO_SOF            0xA5U
+
+// payload 上限：一個 frame 最多 50 個 UID，整個 frame 放得進 bt_rx 的 stream buffer
+#define BT_PROTO_MAX_UIDS       50U
+#define BT_PROTO_MAX_PAYLOAD    (BT_PROTO_MAX_UIDS * CARD_UID_SIZE)
+
+// frame 收到一半，超過這麼久沒下一個 byte 就丟掉重來 (ms)
+#ifndef BT_PROTO_TIMEOUT_MS
+#define BT_PROTO_TIMEOUT_MS     200U
+#endif
+
+// EXPORT 每個 response frame 放幾個 UID
+#define BT_PROTO_EXPORT_UIDS    BT_PROTO_MAX_UIDS
+
+// Request type
+#define BT_PROTO_CMD_STATUS     0x01U
+#define BT_PROTO_CMD_ADD_BATCH  0x10U
+#define BT_PROTO_CMD_DEL_BATCH  0x11U
+#define BT_PROTO_CMD_ADD_UIDS   0x12U
+#define BT_PROTO_CMD_DEL_UIDS   0x13U
+#define BT_PROTO_CMD_EXPORT     0x20U
+#define BT_PROTO_CMD_EXPORT_UIDS 0x21U
+
+#define BT_PROTO_RSP_FLAG       0x80U
+#define BT_PROTO_RSP_NAK        0xFFU
+
+// Response status
+#define BT_PROTO_ST_OK          0x00U
+#define BT_PROTO_ST_CRC         0x01U   // CRC 錯 (NAK)
+#define BT_PROTO_ST_LEN         0x02U   // payload 長度不對
+#define BT_PROTO_ST_CMD         0x03U   // 不認得的 type
+#define BT_PROTO_ST_LOCKED      0x04U   // 要先開鎖
+#define BT_PROTO_ST_FULL        0x05U   // 白名單 / Flash 滿了
+#define BT_PROTO_ST_FLASH       0x06U   // Flash 寫入錯誤
+#define BT_PROTO_ST_UID         0x07U   // 有 UID 的 BCC / 長度不對，整個 frame 沒寫
+
+// huart: 回 response 用的 UART；unlocked: 目前是不是開鎖狀態 (main.c 的 gIsUnlocked)
+void bt_proto_init(UART_HandleTypeDef *huart, const volatile uint8_t *unlocked);
+
+// 餵一個收到的 byte (now_ms = 現在時間，HAL_GetTick)
+// 回傳 1 = 這個 byte 屬於 binary frame (已經吃掉)，0 = 不是，給 PIN 解析
+int bt_proto_input(uint8_t ch, uint32_t now_ms);
+
+// 送一段資料到 HC-05 (blocking)。binary response 跟 vBtNotifyTask 的文字通知
+// 都走這裡，一個 mutex 排隊，不會有一邊拿到 HAL_BUSY 被丟掉
+void bt_proto_write(const uint8_t *buf, uint16_t len);
+
+#endif // BT_PROTO_H
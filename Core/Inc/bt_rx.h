@@ -0,0 +1,39 @@
+// bt_rx.h  — HC-05 (USART2) 連續接收
+//
+// USART2 RX 用 DMA1_Stream5 的 circular mode 一直收進 ring buffer，
+// 不用每個 byte 重新 arm DMA、也不會因為 arm 太慢掉字：
+//   - IDLE line (一段資料結束)、half / full transfer 時 HAL 會呼叫 HAL_UARTEx_RxEventCallback
+//   - callback 把上次位置到現在位置之間的新資料整段丟進 stream buffer
+//   - vBtTask 用 bt_rx_read() 一次拿一整段
+// UART 出錯 (overrun 等) 停掉接收時，會在 HAL_UART_ErrorCallback 裡重新啟動。
+
+#ifndef BT_RX_H
+#define BT_RX_H
+
+#include <stdint.h>
+#include "usart.h"
+
+// DMA circular buffer 大小 (byte)；115200 baud 下約 5.5ms 的資料，HT/TC 中斷會在一半時先搬一次
+#ifndef BT_RX_DMA_SIZE
+#define BT_RX_DMA_SIZE      64U
+#endif
+
+// 給 vBtTask 的 stream buffer 大小 (byte)
+#ifndef BT_RX_STREAM_SIZE
+#define BT_RX_STREAM_SIZE   512U
+#endif
+
+// 建立 stream buffer 並開始接收 (vTaskStartScheduler 之前呼叫)
+void bt_rx_start(UART_HandleTypeDef *huart);
+
+// 等資料進來，最多拿 max 個 byte；回傳拿到的數量 (timeout 時是 0)
+uint32_t bt_rx_read(uint8_t *buf, uint32_t max, uint32_t timeout_ms);
+
+// stream buffer 滿了被丟掉的 byte 數
+uint32_t bt_rx_dropped(void);
+
+// HAL_UARTEx_RxEventCallback / HAL_UART_ErrorCallback 裡呼叫
+void bt_rx_event_isr(UART_HandleTypeDef *huart, uint16_t pos);
+void bt_rx_error_isr(UART_HandleTypeDef *huart);
+
+#endif // BT_RX_H
@@ -5,23 +5,114 @@
 
 #include <stdint.h>
 
-#define CARD_UID_SIZE        5      // 你目前是 5-byte UID，就先抓 5
-#define CARD_DB_MAX_CARDS    32     // RAM 白名單最多幾張卡，自己調
-
-// Flash 相關設定：用你現在專案的定義即可
-// 你之前是這樣：
-//   #define CARD_FLASH_SECTOR FLASH_SECTOR_11
-//   #define CARD_FLASH_ADDR   0x080E0000U
-// 我這裡沿用，但加一個 "sector 大小"，請依你的 chip 實際大小調整
-#define CARD_FLASH_SECTOR       FLASH_SECTOR_11
-#define CARD_FLASH_ADDR         0x080E0000U
-// #define CARD_FLASH_SECTOR_SIZE  (128 * 1024U)  // F407 sector 11 是 128KB，確認一下
-#define CARD_FLASH_SECTOR_SIZE   64   
+// 4-byte UID 的卡用 5-byte key (UID + BCC)，跟舊版 Flash / 藍牙協定一樣
+// 7 / 10-byte UID (cascade level 2 / 3) 的卡另外放一張小表，不會拖慢 4-byte 卡的查詢
+#define CARD_UID_SIZE        5
+#define CARD_UID_MAX_LEN     10     // ISO14443A UID：4 / 7 / 10 byte
+
+// 7 / 10-byte UID 的卡最多幾張 (每張 11 byte，也放 CCMRAM)
+#ifndef CARD_DB_MAX_LONG_CARDS
+#define CARD_DB_MAX_LONG_CARDS 256
+#endif
+
+// RAM 白名單最多幾張卡，自己調
+//   UID 表 (5 byte/張) + long UID 表放在 CCMRAM (64KB)，12288 張 + 256 張 long 約 62.8KB
+//   佔用 bitmap 跟 hash index (2 byte/格) 放在一般 SRAM
+#ifndef CARD_DB_MAX_CARDS
+#define CARD_DB_MAX_CARDS    12288
+#endif
+
+// UID hash index：1 = open-addressing hash (O(1) 查詢)，0 = 舊的線性掃描
+#ifndef CARD_DB_HASH_INDEX
+#define CARD_DB_HASH_INDEX   1
+#endif
+
+// Hash table 有 (1 << CARD_DB_HASH_BITS) 格，load factor 最多 75%
+#ifndef CARD_DB_HASH_BITS
+#define CARD_DB_HASH_BITS    15     // 32768 格 (64KB SRAM) → 最多 24576 張卡，滿載時 load factor ~38%
+#endif
+
+// UID 表要放的 section (host build 用 -DCARD_DB_CCMRAM= 拿掉)
+#ifndef CARD_DB_CCMRAM
+#define CARD_DB_CCMRAM       __attribute__((section(".ccmbss")))
+#endif
+
+// Flash 相關設定：白名單 log 輪流用這幾個 sector (至少 2 個)
+// F407 的 sector 8~11 各 128KB (0x08080000 ~ 0x080FFFFF)；STM32F407VGTX_FLASH.ld 的 FLASH 只給到
+// sector 7 (512K)，image 長進來會 link 失敗。改這裡的話 linker script 要一起改
+// sector 越多，每個 sector 被 erase 的次數越少 (壽命約 x N/2)
+#ifndef CARD_DB_SECTORS
+#define CARD_DB_SECTORS      { 8, 9, 10, 11 }
+#endif
 
 // log record 相關常數
 #define CARD_LOG_MAGIC       0xA5
 #define CARD_LOG_OP_ADD      0x01
 #define CARD_LOG_OP_DEL      0x02
+#define CARD_LOG_OP_CKPT     0x10   // checkpoint 開頭，後面接整份白名單的 packed UID
+#define CARD_LOG_OP_CKPT_END 0x11   // checkpoint 結尾 (寫完這筆 checkpoint 才算數)
+#define CARD_LOG_OP_TXN      0x20   // transaction 開頭，後面接 (op, UID) 清單
+#define CARD_LOG_OP_TXN_END  0x21   // commit marker (寫完這筆整個 transaction 才算數)
+#define CARD_LOG_OP_HDR      0x30   // sector 第一筆：erase 次數 + record 格式 (每次 erase 完馬上寫)
+#define CARD_LOG_OP_OPEN     0x31   // sector 第二筆：generation (第一個 checkpoint 寫完才寫)
+#define CARD_LOG_OP_LONG     0x40   // v2：ADD / DEL | LONG = 7 / 10-byte UID，下一筆 record 放整個 UID
+
+// record 格式 (寫在每個 sector 的 HDR 裡，決定那個 sector 的 record / blob 用哪種 CRC)
+//   CARD_FMT_CRC16：CRC16-CCITT，軟體算 (舊資料都是這個)
+//   CARD_FMT_CRC32：CRC32 以 32-bit word 為單位，板子上用 F407 的硬體 CRC 單元，存低 16 bit
+// 新 erase 的 sector 用 CARD_DB_FORMAT_VERSION；舊格式的 sector 照樣讀，下一次 GC 搬過去就換新格式
+//   CARD_FMT_UID_V2：可以放 7 / 10-byte UID (checkpoint / transaction 的 blob 後面多一段長 UID)。
+//   新 erase 的 sector 一定有；舊 sector 要寫長 UID 時先 GC 搬到新格式
+#define CARD_FMT_CRC16       1
+#define CARD_FMT_CRC32       2
+#define CARD_FMT_CRC_MASK    0x0F
+#define CARD_FMT_UID_V2      0x10
+
+#ifndef CARD_DB_FORMAT_VERSION
+#define CARD_DB_FORMAT_VERSION CARD_FMT_CRC32
+#endif
+
+// CRC16 的算法：4 = slice-by-4 查表 (一次 4 byte，表 2KB RAM)，0 = 一次 1 bit
+// 板子上 CRC16 只剩讀舊 sector 用，預設不佔那 2KB
+#ifndef CARD_DB_CRC16_SLICES
+#ifdef USE_HAL_DRIVER
+#define CARD_DB_CRC16_SLICES 0
+#else
+#define CARD_DB_CRC16_SLICES 4
+#endif
+#endif
+
+// checkpoint 之後至少累積幾筆 ADD/DEL 才寫下一個 checkpoint
+// (另外 tail 也要比 checkpoint 本身長，見 carddb_maybe_checkpoint)
+#ifndef CARD_DB_CKPT_MIN_OPS
+#define CARD_DB_CKPT_MIN_OPS 64
+#endif
+
+// 開機找 log 結尾：1 = binary search (fast mount)，0 = 一筆一筆往後掃
+#ifndef CARD_DB_FAST_MOUNT
+#define CARD_DB_FAST_MOUNT   1
+#endif
+
+// 一個 transaction 最多幾筆加卡 / 刪卡 (RAM 暫存：筆數 x 6 byte)
+#ifndef CARD_DB_TXN_MAX
+#define CARD_DB_TXN_MAX      64
+#endif
+
+// active sector 用到幾 % 就開始在背景搬到下一個 sector (carddb_gc_step)
+// 剩下的空間給搬的期間照常 add / remove；滿了背景還沒搬完，carddb_add 才自己把它做完
+#ifndef CARD_DB_GC_START_PCT
+#define CARD_DB_GC_START_PCT 90
+#endif
+
+// carddb_gc_step 每次搬幾個 UID (每 12 個一次 Flash 寫入；60 個大約 1.2 ms)
+#ifndef CARD_DB_GC_STEP_UIDS
+#define CARD_DB_GC_STEP_UIDS 60
+#endif
+
+// 1 = replay 時每筆 record 都印到 UART (很慢，debug 用)
+#ifndef CARD_DB_REPLAY_VERBOSE
+#define CARD_DB_REPLAY_VERBOSE 0
+#endif
 
 // 回傳值
 typedef enum {
@@ -29,27 +120,97 @@ typedef enum {
     CARDDB_ERR_FULL,        // Flash log 沒空間了
     CARDDB_ERR_NOT_FOUND,   // 刪卡時找不到
     CARDDB_ERR_FLASH,       // Flash 寫入錯誤
+    CARDDB_ERR_TXN,         // transaction 沒開 / 已經開了 / 暫存滿了 (先 commit)
+    CARDDB_ERR_UID,         // UID 長度不是 4 / 7 / 10，或 batch 的 key BCC 不對
 } carddb_status_t;
 
-// 一筆 RAM 裡的卡片條目
+// 卡片 UID (MFRC522_ReadUid 讀到的，不含 cascade tag / BCC)
+typedef struct {
+    uint8_t len;            // 4 / 7 / 10
+    uint8_t uid[CARD_UID_MAX_LEN];
+} card_uid_t;
+
+// 一筆卡片條目 (carddb_get_all 輸出用；RAM 內部是 packed key + bitmap)
 typedef struct {
-    uint8_t uid[CARD_UID_SIZE];
-    uint8_t in_use;         // 1 = 有效，0 = 空/已刪除
+    card_uid_t uid;
+    uint8_t    in_use;      // 1 = 有效，0 = 空/已刪除
 } card_entry_t;
 
-// 初始化：開機時呼叫一次
+// 狀態查詢 (carddb_get_stats)
+typedef struct {
+    uint32_t cards;         // 白名單裡幾張卡
+    uint32_t max_cards;     // CARD_DB_MAX_CARDS
+    uint32_t long_cards;    // 其中 7 / 10-byte UID 的卡 (最多 CARD_DB_MAX_LONG_CARDS)
+    uint32_t log_used;      // active block 已經用掉的 byte 數
+    uint32_t log_size;      // active block 大小
+    uint16_t last_seq;      // 最新一筆 record 的 seq
+    uint8_t  active_block;
+    uint8_t  blocks;        // CARD_DB_SECTORS 裡幾個 sector
+    uint32_t erase_min;     // 各 sector erase 次數的最小 / 最大值 (wear leveling 看差距)
+    uint32_t erase_max;
+} carddb_stats_t;
+
+// 初始化：開機時呼叫一次 (scheduler 啟動前)
+// 之後所有 API 都可以從不同 task 呼叫，card_db 內部用 carddb_port_lock 排隊
 void carddb_init(void);
 
 // 加卡（白名單）: 成功回傳 CARDDB_OK，卡已存在也視為 OK
-carddb_status_t carddb_add(const uint8_t uid[CARD_UID_SIZE]);
+//   4-byte UID 寫一筆 12-byte record；7 / 10-byte 寫兩筆 (record + 整個 UID)
+carddb_status_t carddb_add(const card_uid_t *uid);
 
 // 刪卡：找不到會回 CARDDB_ERR_NOT_FOUND
-carddb_status_t carddb_remove(const uint8_t uid[CARD_UID_SIZE]);
+carddb_status_t carddb_remove(const card_uid_t *uid);
 
 // 查詢此 UID 是否在白名單中：1 = 在，0 = 不在
-int carddb_check(const uint8_t uid[CARD_UID_SIZE]);
+int carddb_check(const card_uid_t *uid);
 
 // （選用）取得目前白名單內容，方便你 debug / 顯示
 int carddb_get_all(card_entry_t *out_array, int max_items);
 
+// Transaction：begin → N 次 add / remove → commit
+//   - add / remove 先暫存在 RAM (查詢看到的還是舊的白名單)，最多 CARD_DB_TXN_MAX 筆
+//     已經在的卡 (加) 不暫存、回 OK；不在的卡 (刪) 回 CARDDB_ERR_NOT_FOUND；暫存滿了回 CARDDB_ERR_TXN
+//   - commit 在同一次 Flash unlock 裡寫 header + (op, UID) 清單 + commit marker，
+//     之後才更新 RAM；斷電時整批不是全部生效就是全部沒生效
+//   - begin 到 commit / abort 之間其他 task 的 card_db 呼叫會等，不要在中間做慢的事
+carddb_status_t carddb_txn_begin(void);
+carddb_status_t carddb_txn_add(const card_uid_t *uid);
+carddb_status_t carddb_txn_remove(const card_uid_t *uid);
+uint32_t        carddb_txn_pending(void);                 // 目前暫存幾筆
+carddb_status_t carddb_txn_commit(uint32_t *written);     // *written = 寫進去的筆數
+void            carddb_txn_abort(void);
+
+// 批次加卡 / 刪卡 (藍牙匯入用)：uids 是 n 個緊接著的 CARD_UID_SIZE byte key (4-byte UID + BCC)
+//   - 已經在白名單的 (加) / 不在白名單的 (刪) 直接跳過，不寫 record
+//   - 有任何一個 key 的 BCC 不是 uid0^uid1^uid2^uid3：整批不收、什麼都不寫，回 CARDDB_ERR_UID
+//   - 每 CARD_DB_TXN_MAX 筆是一個 transaction (一個藍牙 frame 的 50 個 UID 就是一整批)
+//   - *applied = 真的寫進去的筆數；出錯時前面已經 commit 的仍然有效
+carddb_status_t carddb_add_batch(const uint8_t *uids, uint32_t n, uint32_t *applied);
+carddb_status_t carddb_remove_batch(const uint8_t *uids, uint32_t n, uint32_t *applied);
+
+// 同上，但 buf 是 size byte 的 [len][UID] 清單 (len = 4 / 7 / 10，UID 不含 BCC)，長 UID 的卡也能加 / 刪。
+// 有一筆 len 不對或清單切不剛好：整批不收，回 CARDDB_ERR_UID
+carddb_status_t carddb_add_uids(const uint8_t *buf, uint32_t size, uint32_t *applied);
+carddb_status_t carddb_remove_uids(const uint8_t *buf, uint32_t size, uint32_t *applied);
+
+// 分段匯出白名單：從 *cursor 開始最多拿 max 個 CARD_UID_SIZE byte key (緊接著放進 out)，
+// 回傳拿到的數量。只匯出 4-byte UID 的卡，7 / 10-byte 的卡會被跳過 (要全部的用 carddb_export_uids)
+// *cursor 第一次給 0，回傳 0 表示拿完了。兩次呼叫之間有增刪卡時，
+// 沒動到的卡還是剛好出現一次，新加的卡不一定會出現
+uint32_t carddb_export(uint32_t *cursor, uint8_t *out, uint32_t max);
+
+// 分段匯出整個白名單 (含 7 / 10-byte UID)：out 放 [len][UID] 清單，最多 max_bytes byte
+// (至少要 1 + CARD_UID_MAX_LEN)，回傳這次放了幾筆；cursor 用法跟 carddb_export 一樣
+uint32_t carddb_export_uids(uint32_t *cursor, uint8_t *out, uint32_t max_bytes);
+
+void carddb_get_stats(carddb_stats_t *out);
+
+// 背景 GC：在低優先權 task 裡一直呼叫，每次只做一小步 (拿 lock 的時間很短，刷卡照樣查得到)
+//   - 搬移中：再搬 CARD_DB_GC_STEP_UIDS 張卡，搬完就切到新 sector
+//   - allow_erase = 1：先把用過的 sector erase 好 (F407 erase 時 CPU 讀 Flash 會卡住 1~2 秒，
+//     所以只在沒人刷卡的時候給 1)
+//   - active sector 超過 CARD_DB_GC_START_PCT：開始搬
+// 回傳 1 = 還有事要做 (馬上再叫)，0 = 目前沒事
+int carddb_gc_step(int allow_erase);
+
 #endif // CARD_DB_H
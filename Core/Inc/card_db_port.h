@@ -0,0 +1,59 @@
+// card_db_port.h  — card_db 與底層 Flash / debug 輸出之間的移植層
+//
+// card_db.c 不直接呼叫 HAL，所有 Flash 存取與 debug 輸出都經過這裡。
+//   板子上：Core/Src/card_db_port.c  (HAL_FLASH_xxx，debug 走 dbg_log)
+//   Host 上：Host/flash_sim.c         (記憶體模擬 Flash，可量測時間)
+
+#ifndef CARD_DB_PORT_H
+#define CARD_DB_PORT_H
+
+#include <stdint.h>
+#include "card_db.h"
+
+// Sector 編號跟 HAL 的 FLASH_SECTOR_x 一樣 (FLASH_SECTOR_10 == 10U)
+// Start address and size of a sector (F407 map: 4 x 16KB, 1 x 64KB, 7 x 128KB).
+uint32_t carddb_port_sector_addr(uint32_t sector);
+uint32_t carddb_port_sector_size(uint32_t sector);
+
+// Unlock / lock the Flash control register around program/erase.
+void carddb_port_flash_unlock(void);
+void carddb_port_flash_lock(void);
+
+// Program len bytes (addr and len multiples of 4, Flash must be unlocked),
+// using the widest parallelism the supply voltage allows (x32 words, or x64
+// double words with VPP on the target, see CARD_PORT_VOLTAGE_RANGE).
+carddb_status_t carddb_port_flash_program(uint32_t addr, const uint8_t *data, uint32_t len);
+
+// Erase one whole sector (Flash must be unlocked).
+carddb_status_t carddb_port_flash_erase_sector(uint32_t sector);
+
+// CRC32 (poly 0x04C11DB7, init 0xFFFFFFFF, no reflection / final xor) over
+// len bytes taken as little-endian 32-bit words, the last one padded with 0xFF:
+// the F407 CRC unit on target, the same in software on the host.
+uint32_t carddb_port_crc32(const uint8_t *data, uint32_t len);
+
+// Last low-level error code (HAL_FLASH_GetError() on target).
+uint32_t carddb_port_flash_error(void);
+
+// Map a Flash address to a readable pointer (identity on target).
+const uint8_t *carddb_port_flash_ptr(uint32_t addr);
+
+// Serialise the public card_db API between tasks (FreeRTOS mutex on target,
+// no-op on the host).  carddb_port_init runs from carddb_init, before the scheduler.
+void carddb_port_init(void);
+void carddb_port_lock(void);
+void carddb_port_unlock(void);
+
+// Debug output.
+//   板子上：LOG_DEBUG (dbg_log，預設是 binary trace，format 字串不會上 UART)
+//   Host 上：carddb_port_debug_printf (stdout 或直接丟掉)
+#ifdef USE_HAL_DRIVER
+#include "dbg_log.h"
+#define CARDDB_LOG(...)     LOG_DEBUG(__VA_ARGS__)
+#else
+void carddb_port_debug_printf(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+#define CARDDB_LOG(...)     carddb_port_debug_printf(__VA_ARGS__)
+#endif
+
+#endif // CARD_DB_PORT_H
@@ -0,0 +1,108 @@
+// dbg_log.h  — 非阻塞 debug log (USART3)
+//
+// 任何 task / ISR 都可以呼叫，不會等 UART：
+//   - 訊息先丟進一個 lock-free 的 ring buffer (多個 producer，用 LDREX/STREX 搶位置)
+//   - 低優先權的 LOG task 把 ring 裡的資料整批用 DMA 送到 USART3
+//   - ring 滿了就直接丟掉這筆，記在 dropped 計數
+//   - scheduler 還沒啟動前 (開機階段) 直接用 HAL_UART_Transmit 印出去
+//
+// 等級：DBG_LOG_LEVEL 以下的 LOG_xxx() 在編譯時就整個拿掉 (連 snprintf 都不會有)。
+// 格式：DBG_LOG_BINARY = 1 時 LOG_xxx() 送 binary trace (trace.h)，板子上不做 printf，
+//       UART 上看到的是 COBS frame，要用 Host/trace_decode 配合 ELF 解回文字。
+
+#ifndef DBG_LOG_H
+#define DBG_LOG_H
+
+#include <stdint.h>
+
+#define DBG_LVL_NONE    0
+#define DBG_LVL_ERR     1
+#define DBG_LVL_WARN    2
+#define DBG_LVL_INFO    3
+#define DBG_LVL_DEBUG   4
+
+// 編譯時的等級上限：Debug build 全開，Release 只留到 INFO
+#ifndef DBG_LOG_LEVEL
+#ifdef DEBUG
+#define DBG_LOG_LEVEL   DBG_LVL_DEBUG
+#else
+#define DBG_LOG_LEVEL   DBG_LVL_INFO
+#endif
+#endif
+
+// 1 = LOG_xxx 走 binary trace，0 = 板子上 snprintf 後直接送文字 (可以直接用終端機看)
+#ifndef DBG_LOG_BINARY
+#define DBG_LOG_BINARY      1
+#endif
+
+// ring buffer 大小 (byte，必須是 2 的次方)；FreeRTOS 改成 static allocation 之後 SRAM 夠，
+// 開機 / GC 時一次噴一大堆 log 也不太會掉
+#ifndef DBG_LOG_RING_SIZE
+#define DBG_LOG_RING_SIZE   8192U
+#endif
+
+// 單筆訊息最長幾個字 (LOG_xxx 的 snprintf buffer，放在呼叫者的 stack)
+#ifndef DBG_LOG_LINE_MAX
+#define DBG_LOG_LINE_MAX    128
+#endif
+
+// 初始化 ring buffer；在 main() 最前面、第一次 log 之前呼叫
+void dbg_log_init(void);
+
+// 建立 LOG drain task (vTaskStartScheduler 之前呼叫)
+void dbg_log_start_task(void);
+
+// 丟一段已經排好的文字進 ring，不會 block；回傳 0 = 被丟掉 (ring 滿)
+int dbg_log_write(uint8_t level, const char *buf, int len);
+
+// printf 風格；一般請用下面的 LOG_xxx 巨集
+void dbg_log_printf(uint8_t level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// 執行時再過濾一次 (不能超過編譯時的 DBG_LOG_LEVEL)
+void    dbg_log_set_level(uint8_t level);
+uint8_t dbg_log_get_level(void);
+
+// ring 滿而被丟掉的訊息數
+uint32_t dbg_log_dropped(void);
+
+// USART3 DMA 傳完 (HAL_UART_TxCpltCallback 裡呼叫)
+void dbg_log_tx_cplt_isr(void);
+
+// 被拿掉的等級：不產生任何程式碼，但參數還是會做型別檢查 (也不會有 unused 警告)
+#define DBG_LOG_STRIPPED(...)   do { if (0) { dbg_log_printf(0, __VA_ARGS__); } } while (0)
+
+#if DBG_LOG_BINARY
+#include "trace.h"
+// format 字串照樣讓 compiler 檢查，但實際只送 ID + 參數
+#define DBG_LOG_EMIT(level, ...) \
+    do { DBG_LOG_STRIPPED(__VA_ARGS__); TRACE(level, __VA_ARGS__); } while (0)
+#else
+#define DBG_LOG_EMIT(level, ...) dbg_log_printf(level, __VA_ARGS__)
+#endif
+
+#if DBG_LOG_LEVEL >= DBG_LVL_ERR
+#define LOG_ERR(...)    DBG_LOG_EMIT(DBG_LVL_ERR, __VA_ARGS__)
+#else
+#define LOG_ERR(...)    DBG_LOG_STRIPPED(__VA_ARGS__)
+#endif
+
+#if DBG_LOG_LEVEL >= DBG_LVL_WARN
+#define LOG_WARN(...)   DBG_LOG_EMIT(DBG_LVL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...)   DBG_LOG_STRIPPED(__VA_ARGS__)
+#endif
+
+#if DBG_LOG_LEVEL >= DBG_LVL_INFO
+#define LOG_INFO(...)   DBG_LOG_EMIT(DBG_LVL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...)   DBG_LOG_STRIPPED(__VA_ARGS__)
+#endif
+
+#if DBG_LOG_LEVEL >= DBG_LVL_DEBUG
+#define LOG_DEBUG(...)  DBG_LOG_EMIT(DBG_LVL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...)  DBG_LOG_STRIPPED(__VA_ARGS__)
+#endif
+
+#endif // DBG_LOG_H
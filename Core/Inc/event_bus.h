@@ -0,0 +1,93 @@
+// event_bus.h  — task 之間的 typed event (publish / subscribe)
+//
+// 以前 xEventQueue 只有一個 byte ('1' 開 / '0' 關)，誰刷的卡、哪張卡、結果是什麼
+// 都另外靠 gIsUnlocked / gNfcMode 跟各 task 自己 HAL_UART_Transmit 出去。現在：
+//   - producer (keypad / NFC / BT) 只 publish 一個 app_event_t：type + source + 結果 + UID + tick
+//   - 每個 subscriber 有自己的 FreeRTOS queue 跟一個 type mask，publish 時複製一份丟進
+//     mask 有勾的 queue (照 subscribe 的順序)
+//   - 開鎖狀態只有 vStateTask 在改，改完再 publish EV_STATE
+//   - 藍牙文字通知、LCD 畫面、audit log 各自是 subscriber，producer 不再自己送 UART
+// subscribe 只能在 scheduler 啟動前做；publish 只能在 task 裡 (不能在 ISR)。
+
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "card_db.h"
+
+#define EVENT_BUS_MAX_SUBS  6
+
+typedef enum
+{
+    EV_SRC_SYSTEM = 0,
+    EV_SRC_KEYPAD,
+    EV_SRC_NFC,
+    EV_SRC_BT,
+} app_ev_src_t;
+
+typedef enum
+{
+    EV_UNLOCK_REQ = 0,  // PIN 對了 (keypad / BT)
+    EV_LOCK_REQ,        // 上鎖 PIN / keypad C
+    EV_MODE_REQ,        // keypad A / B：code = 要進的 NFC 模式
+    EV_PIN_INPUT,       // keypad 打了幾位：code = 位數
+    EV_PIN_WRONG,       // PIN 錯 (keypad / BT)
+    EV_CARD_SEEN,       // 新的一張卡：uid, arg = 場內幾張
+    EV_CARD_RESULT,     // 刷卡處理完：code = app_card_result_t, uid, arg = 場內幾張
+    EV_STATE,           // vStateTask：code = 1 開 / 0 關，arg = 1 有變 / 0 本來就是
+    EV_MODE,            // vStateTask：code = NFC 模式，arg = 1 接受 / 0 鎖著被拒
+                        // (EV_STATE / EV_MODE 的 source 是提出要求的那一方)
+    EV_TYPE_COUNT
+} app_ev_type_t;
+
+typedef enum
+{
+    CARD_AUTH_OK = 0,
+    CARD_AUTH_DENIED,
+    CARD_ADD_OK,
+    CARD_ADD_FULL,
+    CARD_ADD_ERR,
+    CARD_DEL_OK,
+    CARD_DEL_NOT_FOUND,
+    CARD_DEL_ERR,
+    CARD_MULTI,         // 新增 / 刪除模式下場內不只一張
+    CARD_RESULT_COUNT
+} app_card_result_t;
+
+// NFC 模式 (EV_MODE_REQ / EV_MODE 的 code)
+typedef enum
+{
+    NFC_MODE_NORMAL = 0,
+    NFC_MODE_ADD_CARD = 1,
+    NFC_MODE_DELETE_CARD = 2
+} NfcMode_t;
+
+typedef struct
+{
+    uint8_t    type;    // app_ev_type_t
+    uint8_t    source;  // app_ev_src_t
+    uint8_t    code;    // 看 type
+    uint8_t    arg;     // 看 type
+    uint32_t   tick;    // publish 的時間 (ms)
+    card_uid_t uid;     // EV_CARD_xxx 才有
+} app_event_t;
+
+#define EV_BIT(t)       (1UL << (t))
+#define EV_MASK_ALL     (EV_BIT(EV_TYPE_COUNT) - 1UL)
+
+// 把 queue (item = app_event_t) 掛到 bus 上，收 mask 裡的 type。
+// 滿了最多等 wait 個 tick (0 = 直接丟掉、算在 dropped)。scheduler 啟動前呼叫；回傳 0 = 滿了
+int event_bus_subscribe(QueueHandle_t q, uint32_t mask, TickType_t wait);
+
+// 填好 tick 之後依 subscribe 順序送給每個有勾這個 type 的 queue；回傳送進去幾個
+int event_bus_publish(app_event_t *ev);
+
+// 只帶 type / source / code 的小事件
+int event_bus_post(uint8_t type, uint8_t source, uint8_t code);
+
+// 所有 subscriber queue 滿了丟掉的事件數
+uint32_t event_bus_dropped(void);
+
+#endif // EVENT_BUS_H
@@ -0,0 +1,41 @@
+// keypad.h  — 4x4 矩陣鍵盤 (EXTI 喚醒 + timer 取樣 + keypad_fsm 去彈跳)
+//
+// 平常四條 column (PE11–PE14) 都拉低，row (PE7–PE10, pull-up) 開 falling EXTI：
+//   - 沒人按的時候完全不掃，MCU 可以睡
+//   - 按下 → EXTI 先把 row 中斷關掉 (彈跳不會一直進來)，啟動每 KEYPAD_SAMPLE_MS 一次的 timer
+//   - timer (timer task 裡) 把整個矩陣掃成 16-bit bitmap 丟給 keypad_fsm，
+//     PRESS / RELEASE / LONG 事件 (帶 tick) 丟進 queue
+//   - keypad_fsm 說全部放開而且穩定了 → 停 timer、column 拉回低、清掉 pending、再開 EXTI
+// 使用的人 (vKeypadTask) 只要 keypad_get 等 queue。
+
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include <stdint.h>
+#include "main.h"
+#include "FreeRTOS.h"
+#include "keypad_fsm.h"
+
+#define KEYPAD_ROW_PORT     GPIOE
+#define KEYPAD_ROW_PINS     (GPIO_PIN_7 | GPIO_PIN_8 | GPIO_PIN_9 | GPIO_PIN_10)
+#define KEYPAD_COL_PORT     GPIOE
+#define KEYPAD_COL_PINS     (GPIO_PIN_11 | GPIO_PIN_12 | GPIO_PIN_13 | GPIO_PIN_14)
+
+// 切 column 之後等 row 穩定 (pull-up + 線上電容，幾 us 就夠)
+#define KEYPAD_SETTLE_US    10
+
+#define KEYPAD_QUEUE_LEN    16
+
+// 建 queue / timer，column 拉低、開 row EXTI。scheduler 啟動前呼叫
+void keypad_init(void);
+
+// 等下一個鍵盤事件；pdFALSE = timeout
+BaseType_t keypad_get(keypad_event_t *ev, TickType_t wait);
+
+// queue 滿了被丟掉的事件數
+uint32_t keypad_dropped(void);
+
+// row 腳的 EXTI (HAL_GPIO_EXTI_Callback 裡呼叫，不是 row 的腳直接忽略)
+void keypad_exti_isr(uint16_t pin);
+
+#endif // KEYPAD_H
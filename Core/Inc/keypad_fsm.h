@@ -0,0 +1,65 @@
+// keypad_fsm.h  — 4x4 鍵盤的去彈跳 / n-key rollover 狀態機
+//
+// keypad driver 每 KEYPAD_SAMPLE_MS 把整個矩陣掃成一個 16-bit bitmap (bit = row * 4 + col，1 = 按著)
+// 丟進來，這裡對每一個鍵各自做 integrating debounce：
+//   - raw 是按著就 +1、放開就 -1 (0 .. KEYPAD_INTEG_MAX)；到頂才算按下、歸零才算放開，
+//     所以單一次彈跳 (或掃描時 column 之間的雜訊) 只會讓計數器晃一下，不會多一個鍵
+//   - 每個鍵各自判斷，兩個鍵一起按 / 前一個還沒放開就按下一個 (打字快) 都會各有一個 PRESS
+//   - 按住超過 KEYPAD_LONG_MS 再多一個 LONG (一次)
+//   - 沒有二極體的矩陣按住三個鍵會多出一個「鬼鍵」(矩形的第四角)：這種取樣整個不算
+// 事件帶取樣當下的 tick。純 C、不碰 HAL，錄下來的 bitmap 可以直接在 host 上重播。
+
+#ifndef KEYPAD_FSM_H
+#define KEYPAD_FSM_H
+
+#include <stdint.h>
+
+#define KEYPAD_KEYS         16
+
+#ifndef KEYPAD_SAMPLE_MS
+#define KEYPAD_SAMPLE_MS    5
+#endif
+
+// 連續幾次一樣的取樣才改狀態 (4 x 5 ms = 20 ms)
+#ifndef KEYPAD_INTEG_MAX
+#define KEYPAD_INTEG_MAX    4
+#endif
+
+#ifndef KEYPAD_LONG_MS
+#define KEYPAD_LONG_MS      800
+#endif
+
+typedef enum
+{
+    KEYPAD_EV_PRESS = 0,
+    KEYPAD_EV_RELEASE,
+    KEYPAD_EV_LONG,
+} keypad_ev_type_t;
+
+typedef struct
+{
+    uint8_t  type;      // keypad_ev_type_t
+    char     key;       // '0'..'9', 'A'..'D', '*', '#'
+    uint32_t tick;      // 取樣的 tick (ms)
+} keypad_event_t;
+
+typedef struct
+{
+    uint8_t  integ[KEYPAD_KEYS];
+    uint16_t state;                 // 去彈跳之後按著的鍵
+    uint16_t long_sent;             // 這次按住已經送過 LONG
+    uint32_t down_at[KEYPAD_KEYS];  // 按下的 tick
+} keypad_fsm_t;
+
+void keypad_fsm_init(keypad_fsm_t *f);
+
+// 丟一個 raw bitmap 取樣，事件依 bit 順序寫進 ev[] (最多 max 個)，回傳幾個
+int keypad_fsm_sample(keypad_fsm_t *f, uint16_t raw, uint32_t tick, keypad_event_t *ev, int max);
+
+// 沒有鍵按著、計數器都歸零：driver 可以停掉取樣回去等 EXTI
+int keypad_fsm_idle(const keypad_fsm_t *f);
+
+// bit (row * 4 + col) → 鍵的字元
+char keypad_fsm_key(int bit);
+
+#endif // KEYPAD_FSM_H
@@ -0,0 +1,34 @@
+// lcd_fb.h  — LCD1602 shadow framebuffer
+//
+// 記住面板上現在顯示的 16x2 個字，新畫面進來時只送有變的字：
+//   - 不再每次 lcd1602_Clear (2ms + 整面閃一下)
+//   - 相鄰的變動合成一段，一段只下一次 SetCursor；游標剛好在那裡就連 SetCursor 都省掉
+//   - 例：PIN 畫面每按一個鍵只改一個 '*'，只會送 1 個 SetCursor + 1 個字
+//
+// 字串比 16 個字短的部分視為空白 (跟以前 Clear 後再印的結果一樣)。
+
+#ifndef LCD_FB_H
+#define LCD_FB_H
+
+#include <stdint.h>
+#include "lcd1602_i2c.h"
+
+#define LCD_FB_COLS     16
+#define LCD_FB_ROWS     2
+
+// 兩段變動中間隔幾個沒變的字以內就合成一段 (重送 1 個字跟 1 次 SetCursor 一樣貴)
+#ifndef LCD_FB_MERGE_GAP
+#define LCD_FB_MERGE_GAP    1
+#endif
+
+// 綁定面板；呼叫前面板必須已經 lcd1602_Init + lcd1602_Clear (全部空白)
+void lcd_fb_init(lcd1602_HandleTypeDef *lcd);
+
+// 畫一整個畫面 (line1/line2 是 NUL 結尾字串，超過 16 個字的部分不顯示)
+// 回傳實際送出的字數 (不含 SetCursor)
+uint32_t lcd_fb_show(const char *line1, const char *line2);
+
+// 下次 lcd_fb_show 整面重送 (例如 I2C 出錯、面板重新初始化之後)
+void lcd_fb_invalidate(void);
+
+#endif // LCD_FB_H
@@ -0,0 +1,32 @@
+// lcd_port.h  — LCD1602 的非同步 I2C 傳輸 (蓋掉 lcd1602_i2c.c 的 weak hook)
+//
+// lcd1602_BusWrite 不再 blocking：
+//   - PCF8574 的 port 序列先丟進一個 byte ring，馬上返回
+//   - I2C1 用 DMA (DMA1_Stream6) 一段一段送，傳完的 callback 直接在 ISR 裡接著送下一段
+//     (PCF8574 只是照順序把每個 byte 放到腳位上，所以不同呼叫的序列可以接在同一筆 DMA 裡)
+//   - ring 滿了才會讓呼叫的 task 睡一下等空間
+// lcd1602_Delay 先等 ring 送完，再用 vTaskDelay (不佔 CPU)。
+// scheduler 還沒啟動前兩個都退回 blocking 的 HAL 版本。
+
+#ifndef LCD_PORT_H
+#define LCD_PORT_H
+
+#include <stdint.h>
+#include "main.h"
+
+// ring 大小 (byte，必須是 2 的次方)；一行 16 個字大約 65 byte
+#ifndef LCD_PORT_RING_SIZE
+#define LCD_PORT_RING_SIZE  256U
+#endif
+
+// 等 DMA 的上限 (ms)；256 byte 在 100 kHz 大約 23 ms
+#define LCD_PORT_TIMEOUT_MS 50U
+
+// I2C1 DMA 傳完 / 出錯 (HAL_I2C_MasterTxCpltCallback / HAL_I2C_ErrorCallback 裡呼叫)
+void lcd_port_tx_cplt_isr(I2C_HandleTypeDef *hi2c);
+void lcd_port_error_isr(I2C_HandleTypeDef *hi2c);
+
+// 傳輸出錯而被丟掉的 byte 數
+uint32_t lcd_port_dropped(void);
+
+#endif // LCD_PORT_H
@@ -0,0 +1,47 @@
+// nfc_poll.h  — NFC 自適應輪詢排程
+//
+// 決定 vNfcTask 下一次 REQA 要隔多久 (兩次之間 RC522 進 soft power-down，天線關掉)：
+//   - 按鍵 / 刷卡之後 NFC_POLL_ACTIVE_MS 內：每 NFC_POLL_FAST_MS 掃一次 (人就在門口)
+//   - 之後沒事：從 NFC_POLL_IDLE_MIN_MS 開始每次沒卡就加倍，到 NFC_POLL_IDLE_MAX_MS 為止
+//
+// 時間單位都是 ms (FreeRTOS tick 是 1 ms)，32-bit 繞回沒關係。
+// 純 C、不碰 HAL，Host/nfc_poll_sim.c 直接拿同一份來跑模擬。
+
+#ifndef NFC_POLL_H
+#define NFC_POLL_H
+
+#include <stdint.h>
+
+#ifndef NFC_POLL_FAST_MS
+#define NFC_POLL_FAST_MS        40
+#endif
+
+#ifndef NFC_POLL_ACTIVE_MS
+#define NFC_POLL_ACTIVE_MS      10000
+#endif
+
+#ifndef NFC_POLL_IDLE_MIN_MS
+#define NFC_POLL_IDLE_MIN_MS    80
+#endif
+
+#ifndef NFC_POLL_IDLE_MAX_MS
+#define NFC_POLL_IDLE_MAX_MS    250
+#endif
+
+typedef struct
+{
+    uint32_t last_activity;     // 最近一次按鍵 / 刷卡
+    uint32_t interval;          // 目前的間隔 (back-off 用)
+} nfc_poll_t;
+
+void nfc_poll_init(nfc_poll_t *p, uint32_t now);
+
+// 有人在用 (按鍵、刷卡)：接下來 NFC_POLL_ACTIVE_MS 快速掃，back-off 重來。
+// t 比目前記住的還舊就忽略，所以可以每圈都把「最後一次按鍵時間」丟進來
+void nfc_poll_activity(nfc_poll_t *p, uint32_t t);
+
+// 一次 poll 做完之後呼叫，card_seen = 這次 REQA 有卡 (而且是新的一次刷卡)。
+// 回傳到下一次 poll 要睡幾 ms
+uint32_t nfc_poll_next(nfc_poll_t *p, uint32_t now, int card_seen);
+
+#endif /* NFC_POLL_H */
@@ -20,6 +20,7 @@ extern SPI_HandleTypeDef hspi1;
 /* RC522 接腳:
  *   SDA/CS -> PA8
  *   RST    -> PD8
+ *   IRQ    -> PB4 (EXTI4, 低電位有效)
  */
 #define MFRC522_CS_PORT      GPIOA
 #define MFRC522_CS_PIN       GPIO_PIN_8
@@ -27,9 +28,34 @@ extern SPI_HandleTypeDef hspi1;
 #define MFRC522_RST_PORT     GPIOD
 #define MFRC522_RST_PIN      GPIO_PIN_8
 
+#define MFRC522_IRQ_PORT     GPIOB
+#define MFRC522_IRQ_PIN      GPIO_PIN_4
+
+/* 等 IRQ 的保險時間 (ms)。正常情況下 RC522 自己的 timer (TimerIRq, 約 15ms)
+ * 會先到，這個只是防 IRQ 線沒接好之類的情況 */
+#define MFRC522_IRQ_TIMEOUT_MS   50
+
+/* RC522 timer 1 tick = 1 ms (MFRC522_Init 設的 prescaler)。平常 30 ms；
+ * 輪詢的 REQA 沒卡時只要等 ATQA (< 0.1 ms)，用短的省下開天線的時間 */
+#define MFRC522_TIMEOUT_MS       30
+#define MFRC522_POLL_TIMEOUT_MS  2
+/* soft power-down 醒來: 等振盪器的上限，再讓卡在天線場裡上電 (ISO 14443 至少 5 ms) */
+#define MFRC522_WAKE_TIMEOUT_MS  5
+#define MFRC522_FIELD_SETTLE_MS  5
+
+/* burst 一次最多幾個 byte (RC522 FIFO 是 64 byte) */
+#define MFRC522_BURST_MAX        64
+/* 一個 SPI frame 至少這麼長才走 DMA，短的直接 polling 比較快 */
+#define MFRC522_SPI_DMA_MIN      8
+#define MFRC522_SPI_TIMEOUT_MS   10
+
 /* Maximum length of the array */
 #define MAX_LEN              16
 
+/* 一次 poll 最多列出幾張卡 (錢包裡疊在一起的卡) */
+#define MFRC522_MAX_CARDS    4
+#define MFRC522_UID_MAX      10
+
 /* MFRC522 commands */
 #define PCD_IDLE             0x00
 #define PCD_AUTHENT          0x0E
@@ -43,6 +69,9 @@ extern SPI_HandleTypeDef hspi1;
 #define PICC_REQIDL          0x26
 #define PICC_REQALL          0x52
 #define PICC_ANTICOLL        0x93
+#define PICC_ANTICOLL_CL2    0x95
+#define PICC_ANTICOLL_CL3    0x97
+#define PICC_CASCADE_TAG     0x88
 #define PICC_SElECTTAG       0x93
 #define PICC_AUTHENT1A       0x60
 #define PICC_AUTHENT1B       0x61
@@ -58,6 +87,7 @@ extern SPI_HandleTypeDef hspi1;
 #define MI_OK                0
 #define MI_NOTAGERR          1
 #define MI_ERR               2
+#define MI_COLL              3      // 只在 anticollision 內部用: 收到的 bit 有碰撞
 
 /* MFRC522 registers: Page 0 */
 #define     Reserved00       0x00
@@ -131,20 +161,51 @@ extern SPI_HandleTypeDef hspi1;
 #define     Reserved33        0x3E
 #define     Reserved34        0x3F
 
+/* 一張卡: UID (4 / 7 / 10 byte) + 最後一層的 SAK */
+typedef struct
+{
+    uchar len;
+    uchar uid[MFRC522_UID_MAX];
+    uchar sak;
+} rc522_uid_t;
+
 /* 低階 SPI / register 操作 */
 uchar   Read_MFRC522(uchar addr);
 void    Write_MFRC522(uchar addr, uchar val);
 void    SetBitMask(uchar reg, uchar mask);
 void    ClearBitMask(uchar reg, uchar mask);
 
+/* burst：同一個 register 連續讀寫 (FIFODataReg)，或一次讀好幾個 register，都只拉一次 CS */
+void    Write_MFRC522_Burst(uchar addr, const uchar *data, uchar len);
+void    Read_MFRC522_Burst(uchar addr, uchar *data, uchar len);
+void    Read_MFRC522_Multi(const uchar *addrs, uchar *vals, uchar n);
+
 /* 對外 API */
 void  MFRC522_Init(void);
 uchar MFRC522_Request(uchar reqMode, uchar *TagType);
 uchar MFRC522_Anticoll(uchar *serNum);
 uchar MFRC522_SelectTag(uchar *serNum);
+/* cascade: PICC_ANTICOLL / PICC_ANTICOLL_CL2 / PICC_ANTICOLL_CL3 */
+uchar MFRC522_AnticollLevel(uchar cascade, uchar *serNum);
+uchar MFRC522_SelectLevel(uchar cascade, uchar *serNum, uchar *sak);
+/* 完整 UID: 依 SAK 走 CL1..CL3，uid 至少 10 byte，uidLen 回 4 / 7 / 10 */
+uchar MFRC522_ReadUid(uchar *uid, uchar *uidLen, uchar *sak);
+/* MFRC522_Request 成功之後呼叫: select 一張、HALT、再 REQA，直到場裡沒有卡，回傳張數 */
+uchar MFRC522_ReadAllUids(rc522_uid_t *cards, uchar max);
 uchar MFRC522_Auth(uchar authMode, uchar BlockAddr, uchar *Sectorkey, uchar *serNum);
 uchar MFRC522_Write(uchar blockAddr, uchar *writeData);
 uchar MFRC522_Read(uchar blockAddr, uchar *recvData);
 void  MFRC522_Halt(void);
 
+/* 兩次 poll 之間關天線 + 振盪器 (CommandReg.PowerDown)，register 內容都保留 */
+void  MFRC522_SoftPowerDown(void);
+uchar MFRC522_SoftPowerUp(void);
+void  MFRC522_SetTimeout(uint ms);
+
+/* IRQ 腳的 EXTI (HAL_GPIO_EXTI_Callback 裡呼叫) */
+void  MFRC522_IrqHandler(void);
+
+/* SPI1 DMA 完成 (HAL_SPI_TxRxCpltCallback / HAL_SPI_ErrorCallback 裡呼叫) */
+void  MFRC522_SpiCpltHandler(void);
+
 #endif /* __RC522_H__ */
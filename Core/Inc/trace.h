@@ -0,0 +1,42 @@
+// trace.h  — binary deferred-format trace (defmt 風格)
+//
+// TRACE(level, "fmt", args...) 不在板子上做 printf：
+//   - format 字串放在 .trace_fmt section，linker script 把它標成 (INFO)，
+//     只留在 ELF 裡、不會燒進 Flash；字串在 section 裡的位址就是它的 ID
+//   - 板子只送 [ID | level][時間 ms][每個參數 varint]，整包用 COBS 編碼、0x00 結尾，
+//     經 dbg_log ring buffer + DMA 送到 USART3
+//   - PC 上用 Host/trace_decode 讀 Project0.elf 的 .trace_fmt 把它還原成文字
+//
+// 參數一律當成 32-bit 整數 (%d %u %x %X %c 加寬度/補零都可以)，不支援 %s / %f。
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_MAX_ARGS      12
+
+// 一筆 trace 編碼後最多幾個 byte (COBS 之前)
+#define TRACE_FRAME_MAX     (5 + 5 + TRACE_MAX_ARGS * 5)
+
+void trace_write(uint8_t level, uint32_t fmt_id, const uint32_t *args, uint32_t nargs);
+
+// 把字串常數丟進 .trace_fmt，回傳它的位址當 ID (link 時就決定，不花執行時間)
+#define TRACE_FMT_ID(str)                                                      \
+    ({                                                                         \
+        static const char _trace_fmt[]                                         \
+            __attribute__((section(".trace_fmt"), used)) = str;                \
+        (uint32_t)(uintptr_t)_trace_fmt;                                       \
+    })
+
+#define TRACE(level, fmt, ...)                                                 \
+    do {                                                                       \
+        const uint32_t _trace_args[] = { 0, ##__VA_ARGS__ };                   \
+        typedef char _trace_nargs_check[                                       \
+            (sizeof(_trace_args) / sizeof(_trace_args[0]) - 1 <= TRACE_MAX_ARGS) ? 1 : -1] \
+            __attribute__((unused));                                           \
+        trace_write((level), TRACE_FMT_ID(fmt), &_trace_args[1],               \
+                    sizeof(_trace_args) / sizeof(_trace_args[0]) - 1);         \
+    } while (0)
+
+#endif // TRACE_H
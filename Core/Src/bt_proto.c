@@ -0,0 +1,380 @@
+#include "bt_proto.h"
+#include "bt_rx.h"
+#include "dbg_log.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#define FRAME_HDR_SIZE  5U     // SOF, type, seq, len_lo, len_hi
+#define FRAME_CRC_SIZE  2U
+
+typedef enum {
+    RX_IDLE = 0,
+    RX_TYPE,
+    RX_SEQ,
+    RX_LEN0,
+    RX_LEN1,
+    RX_PAYLOAD,
+    RX_CRC0,
+    RX_CRC1,
+    RX_SKIP,                   // Oversized frame: drop the rest of it
+} rx_state_t;
+
+static UART_HandleTypeDef      *g_huart;
+static const volatile uint8_t  *g_unlocked;
+
+// vBtTask (responses) and vBtNotifyTask (text) both write the UART; a blocking
+// HAL_UART_Transmit started while the other one runs would return HAL_BUSY.
+static SemaphoreHandle_t        g_tx_lock;
+static StaticSemaphore_t        g_tx_lock_sem;
+
+// Receiver state
+static rx_state_t g_state = RX_IDLE;
+static uint32_t   g_last_ms;
+static uint8_t    g_type;
+static uint8_t    g_seq;
+static uint32_t   g_len;
+static uint32_t   g_pos;
+static uint16_t   g_crc;
+static uint16_t   g_rx_crc;
+static uint8_t    g_rx[BT_PROTO_MAX_PAYLOAD];
+static uint32_t   g_bad_frames;
+
+// Response buffer (one frame)
+static uint8_t    g_tx[FRAME_HDR_SIZE + 1U + 4U + BT_PROTO_MAX_PAYLOAD + FRAME_CRC_SIZE];
+
+// --------- Helpers ---------------------------------------------------------
+
+static uint16_t crc16_ccitt_update(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int j = 0; j < 8; j++) {
+            if (crc & 0x8000) {
+                crc = (crc << 1) ^ 0x1021;
+            } else {
+                crc <<= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+// Payload of the response goes to g_tx + FRAME_HDR_SIZE before this is called.
+static void send_frame(uint8_t type, uint8_t seq, uint16_t len)
+{
+    g_tx[0] = BT_PROTO_SOF;
+    g_tx[1] = type;
+    g_tx[2] = seq;
+    put_u16(&g_tx[3], len);
+
+    uint16_t crc = crc16_ccitt_update(0xFFFF, &g_tx[1], FRAME_HDR_SIZE - 1U + len);
+    put_u16(&g_tx[FRAME_HDR_SIZE + len], crc);
+
+    bt_proto_write(g_tx, (uint16_t)(FRAME_HDR_SIZE + len + FRAME_CRC_SIZE));
+}
+
+// Response with just a status byte.
+static void send_status(uint8_t type, uint8_t seq, uint8_t st)
+{
+    g_tx[FRAME_HDR_SIZE] = st;
+    send_frame(type, seq, 1);
+}
+
+static uint8_t map_status(carddb_status_t st)
+{
+    switch (st) {
+    case CARDDB_OK:            return BT_PROTO_ST_OK;
+    case CARDDB_ERR_NOT_FOUND: return BT_PROTO_ST_OK;
+    case CARDDB_ERR_FULL:      return BT_PROTO_ST_FULL;
+    case CARDDB_ERR_UID:       return BT_PROTO_ST_UID;
+    default:                   return BT_PROTO_ST_FLASH;
+    }
+}
+
+// --------- Commands --------------------------------------------------------
+
+static void cmd_status(uint8_t rsp, uint8_t seq)
+{
+    carddb_stats_t s;
+    uint8_t       *p = &g_tx[FRAME_HDR_SIZE];
+
+    carddb_get_stats(&s);
+
+    p[0] = BT_PROTO_ST_OK;
+    p[1] = BT_PROTO_VERSION;
+    p[2] = *g_unlocked ? 1U : 0U;
+    put_u32(&p[3],  s.cards);
+    put_u32(&p[7],  s.max_cards);
+    put_u32(&p[11], s.log_used);
+    put_u32(&p[15], s.log_size);
+    put_u16(&p[19], s.last_seq);
+    p[21] = s.active_block;
+    put_u32(&p[22], bt_rx_dropped());
+    put_u32(&p[26], g_bad_frames);
+    put_u32(&p[30], s.long_cards);
+    send_frame(rsp, seq, 34);
+}
+
+static void cmd_batch(uint8_t rsp, uint8_t seq, int add)
+{
+    uint32_t n       = g_len / CARD_UID_SIZE;
+    uint32_t written = 0;
+    uint8_t *p       = &g_tx[FRAME_HDR_SIZE];
+
+    if (n == 0 || g_len % CARD_UID_SIZE != 0) {
+        send_status(rsp, seq, BT_PROTO_ST_LEN);
+        return;
+    }
+
+    carddb_status_t st = add ? carddb_add_batch(g_rx, n, &written)
+                             : carddb_remove_batch(g_rx, n, &written);
+
+    LOG_INFO("BT batch: add=%d n=%lu written=%lu st=%d\r\n", add,
+             (unsigned long)n, (unsigned long)written, (int)st);
+
+    p[0] = map_status(st);
+    put_u16(&p[1], (uint16_t)written);
+    put_u16(&p[3], (uint16_t)((st == CARDDB_OK) ? n - written : 0));
+    send_frame(rsp, seq, 5);
+}
+
+// Number of [len][UID] entries in len bytes (card_db has already checked them).
+static uint32_t uid_list_count(const uint8_t *p, uint32_t len)
+{
+    uint32_t n = 0;
+
+    for (uint32_t pos = 0; pos < len; pos += 1U + p[pos]) {
+        n++;
+    }
+    return n;
+}
+
+// Same as cmd_batch with [len][UID] entries, so 7- and 10-byte UIDs fit too.
+static void cmd_uids(uint8_t rsp, uint8_t seq, int add)
+{
+    uint32_t written = 0;
+    uint8_t *p       = &g_tx[FRAME_HDR_SIZE];
+
+    if (g_len == 0) {
+        send_status(rsp, seq, BT_PROTO_ST_LEN);
+        return;
+    }
+
+    carddb_status_t st = add ? carddb_add_uids(g_rx, g_len, &written)
+                             : carddb_remove_uids(g_rx, g_len, &written);
+    uint32_t        n  = (st == CARDDB_OK) ? uid_list_count(g_rx, g_len) : 0;
+
+    LOG_INFO("BT uids: add=%d n=%lu written=%lu st=%d\r\n", add,
+             (unsigned long)n, (unsigned long)written, (int)st);
+
+    p[0] = map_status(st);
+    put_u16(&p[1], (uint16_t)written);
+    put_u16(&p[3], (uint16_t)((st == CARDDB_OK) ? n - written : 0));
+    send_frame(rsp, seq, 5);
+}
+
+// One frame per BT_PROTO_EXPORT_UIDS cards, then an empty one that also
+// carries how many 7- / 10-byte cards this format could not include.
+static void cmd_export(uint8_t rsp, uint8_t seq)
+{
+    uint32_t cursor = 0;
+    uint16_t part   = 0;
+    uint32_t n;
+    uint8_t *p      = &g_tx[FRAME_HDR_SIZE];
+
+    do {
+        n = carddb_export(&cursor, &p[4], BT_PROTO_EXPORT_UIDS);
+        p[0] = BT_PROTO_ST_OK;
+        put_u16(&p[1], part++);
+        p[3] = (uint8_t)n;
+        if (n == 0) {
+            carddb_stats_t s;
+            carddb_get_stats(&s);
+            put_u32(&p[4], s.long_cards);
+            send_frame(rsp, seq, 8);
+        } else {
+            send_frame(rsp, seq, (uint16_t)(4U + n * CARD_UID_SIZE));
+        }
+    } while (n > 0);
+}
+
+// Every card as [len][UID] entries, as many as fit a frame, then an empty one.
+static void cmd_export_uids(uint8_t rsp, uint8_t seq)
+{
+    uint32_t cursor = 0;
+    uint16_t part   = 0;
+    uint32_t n;
+    uint8_t *p      = &g_tx[FRAME_HDR_SIZE];
+
+    do {
+        n = carddb_export_uids(&cursor, &p[4], BT_PROTO_MAX_PAYLOAD);
+
+        uint32_t size = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            size += 1U + p[4 + size];
+        }
+        p[0] = BT_PROTO_ST_OK;
+        put_u16(&p[1], part++);
+        p[3] = (uint8_t)n;
+        send_frame(rsp, seq, (uint16_t)(4U + size));
+    } while (n > 0);
+}
+
+static void dispatch(void)
+{
+    uint8_t rsp = g_type | BT_PROTO_RSP_FLAG;
+
+    if (g_type != BT_PROTO_CMD_STATUS && !*g_unlocked) {
+        send_status(rsp, g_seq, BT_PROTO_ST_LOCKED);
+        return;
+    }
+
+    switch (g_type) {
+    case BT_PROTO_CMD_STATUS:
+        cmd_status(rsp, g_seq);
+        break;
+    case BT_PROTO_CMD_ADD_BATCH:
+        cmd_batch(rsp, g_seq, 1);
+        break;
+    case BT_PROTO_CMD_DEL_BATCH:
+        cmd_batch(rsp, g_seq, 0);
+        break;
+    case BT_PROTO_CMD_ADD_UIDS:
+        cmd_uids(rsp, g_seq, 1);
+        break;
+    case BT_PROTO_CMD_DEL_UIDS:
+        cmd_uids(rsp, g_seq, 0);
+        break;
+    case BT_PROTO_CMD_EXPORT:
+        cmd_export(rsp, g_seq);
+        break;
+    case BT_PROTO_CMD_EXPORT_UIDS:
+        cmd_export_uids(rsp, g_seq);
+        break;
+    default:
+        send_status(rsp, g_seq, BT_PROTO_ST_CMD);
+        break;
+    }
+}
+
+// --------- Receiver --------------------------------------------------------
+
+void bt_proto_init(UART_HandleTypeDef *huart, const volatile uint8_t *unlocked)
+{
+    g_huart    = huart;
+    g_unlocked = unlocked;
+    g_state    = RX_IDLE;
+
+    if (g_tx_lock == NULL) {
+        g_tx_lock = xSemaphoreCreateMutexStatic(&g_tx_lock_sem);
+    }
+}
+
+void bt_proto_write(const uint8_t *buf, uint16_t len)
+{
+    int locked = (xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED);
+
+    if (locked) {
+        xSemaphoreTake(g_tx_lock, portMAX_DELAY);
+    }
+    HAL_UART_Transmit(g_huart, (uint8_t *)buf, len, HAL_MAX_DELAY);
+    if (locked) {
+        xSemaphoreGive(g_tx_lock);
+    }
+}
+
+int bt_proto_input(uint8_t ch, uint32_t now_ms)
+{
+    // A frame that stalled half way is dropped; this byte starts over.
+    if (g_state != RX_IDLE && now_ms - g_last_ms > BT_PROTO_TIMEOUT_MS) {
+        g_state = RX_IDLE;
+        g_bad_frames++;
+    }
+    g_last_ms = now_ms;
+
+    switch (g_state) {
+    case RX_IDLE:
+        if (ch != BT_PROTO_SOF) {
+            return 0;
+        }
+        g_crc   = 0xFFFF;
+        g_state = RX_TYPE;
+        return 1;
+
+    case RX_TYPE:
+        g_type  = ch;
+        g_state = RX_SEQ;
+        break;
+
+    case RX_SEQ:
+        g_seq   = ch;
+        g_state = RX_LEN0;
+        break;
+
+    case RX_LEN0:
+        g_len   = ch;
+        g_state = RX_LEN1;
+        break;
+
+    case RX_LEN1:
+        g_len  |= (uint16_t)ch << 8;
+        g_pos   = 0;
+        if (g_len > BT_PROTO_MAX_PAYLOAD) {
+            g_bad_frames++;
+            send_status(g_type | BT_PROTO_RSP_FLAG, g_seq, BT_PROTO_ST_LEN);
+            g_len  += FRAME_CRC_SIZE;
+            g_state = RX_SKIP;
+            return 1;
+        }
+        g_state = (g_len > 0) ? RX_PAYLOAD : RX_CRC0;
+        break;
+
+    case RX_PAYLOAD:
+        g_rx[g_pos++] = ch;
+        if (g_pos == g_len) {
+            g_state = RX_CRC0;
+        }
+        break;
+
+    case RX_CRC0:
+        g_rx_crc = ch;
+        g_state  = RX_CRC1;
+        return 1;
+
+    case RX_CRC1:
+        g_rx_crc |= (uint16_t)ch << 8;
+        g_state   = RX_IDLE;
+        if (g_rx_crc != g_crc) {
+            g_bad_frames++;
+            send_status(BT_PROTO_RSP_NAK, g_seq, BT_PROTO_ST_CRC);
+        } else {
+            dispatch();
+        }
+        return 1;
+
+    case RX_SKIP:
+        if (++g_pos >= g_len) {
+            g_state = RX_IDLE;
+        }
+        return 1;
+    }
+
+    // type, seq, length and payload are covered by the CRC.
+    g_crc = crc16_ccitt_update(g_crc, &ch, 1);
+    return 1;
+}
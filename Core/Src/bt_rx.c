@@ -0,0 +1,83 @@
+#include "bt_rx.h"
+#include "main.h"
+#include "FreeRTOS.h"
+#include "stream_buffer.h"
+
+static UART_HandleTypeDef  *g_huart;
+static uint8_t              g_dma_buf[BT_RX_DMA_SIZE];
+static uint16_t             g_old_pos;      // Already handed to the stream buffer up to here
+static StreamBufferHandle_t g_stream;
+static uint8_t              g_stream_buf[BT_RX_STREAM_SIZE + 1];   // A stream buffer keeps one byte free
+static StaticStreamBuffer_t g_stream_scb;
+static volatile uint32_t    g_dropped;
+
+static void rx_arm(void)
+{
+    g_old_pos = 0;
+    HAL_UARTEx_ReceiveToIdle_DMA(g_huart, g_dma_buf, sizeof(g_dma_buf));
+}
+
+static void rx_push(uint16_t from, uint16_t to, BaseType_t *pxWoken)
+{
+    size_t n = (size_t)(to - from);
+
+    if (n == 0) {
+        return;
+    }
+    size_t sent = xStreamBufferSendFromISR(g_stream, &g_dma_buf[from], n, pxWoken);
+    g_dropped += (uint32_t)(n - sent);
+}
+
+// pos = how far DMA has written into g_dma_buf (BT_RX_DMA_SIZE on transfer complete).
+// In circular mode the write position wraps, so pos < g_old_pos means it went round.
+void bt_rx_event_isr(UART_HandleTypeDef *huart, uint16_t pos)
+{
+    if (huart != g_huart || g_stream == NULL) {
+        return;
+    }
+
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (pos != g_old_pos) {
+        if (pos > g_old_pos) {
+            rx_push(g_old_pos, pos, &xHigherPriorityTaskWoken);
+        } else {
+            rx_push(g_old_pos, BT_RX_DMA_SIZE, &xHigherPriorityTaskWoken);
+            rx_push(0, pos, &xHigherPriorityTaskWoken);
+        }
+        g_old_pos = (pos == BT_RX_DMA_SIZE) ? 0 : pos;
+
+        HAL_GPIO_TogglePin(GPIOD, LD4_Pin);
+    }
+
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+void bt_rx_error_isr(UART_HandleTypeDef *huart)
+{
+    // Overrun / DMA errors stop the reception; noise / framing errors do not.
+    if (huart == g_huart && huart->RxState == HAL_UART_STATE_READY) {
+        rx_arm();
+    }
+}
+
+void bt_rx_start(UART_HandleTypeDef *huart)
+{
+    g_huart  = huart;
+    g_stream = xStreamBufferCreateStatic(BT_RX_STREAM_SIZE, 1, g_stream_buf, &g_stream_scb);
+    if (g_stream == NULL) {
+        Error_Handler();
+    }
+    rx_arm();
+}
+
+uint32_t bt_rx_read(uint8_t *buf, uint32_t max, uint32_t timeout_ms)
+{
+    TickType_t ticks = (timeout_ms == HAL_MAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    return (uint32_t)xStreamBufferReceive(g_stream, buf, max, ticks);
+}
+
+uint32_t bt_rx_dropped(void)
+{
+    return g_dropped;
+}
@@ -1,21 +1,6 @@
 #include "card_db.h"           // carddb_status_t, card_entry_t, CARD_UID_SIZE...
-#include "stm32f4xx_hal.h"     // HAL_FLASH_xxx, HAL_UART_xxx
-#include "usart.h"             // UART handle (huart3)
+#include "card_db_port.h"      // carddb_port_flash_xxx, CARDDB_LOG
 #include <string.h>            // memcpy, memcmp
-#include <stdio.h>             // snprintf
-
-// ========================= Debug UART selection =========================
-#define DBG_UART huart3
-
-static void carddb_debug_flash_error(const char *tag)
-{
-    uint32_t err = HAL_FLASH_GetError();
-    char buf[64];
-    int len = snprintf(buf, sizeof(buf),
-                       "%s: HAL_FLASH error=0x%08lX\r\n",
-                       tag, (unsigned long)err);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)buf, len, HAL_MAX_DELAY);
-}
 
 // ========================= Flash log basic constants ======================
 
@@ -25,6 +10,10 @@ static void carddb_debug_flash_error(const char *tag)
 
 // --------- Flash log record layout ---------------------------------
 // The structure size is a multiple of 4 bytes, which is convenient for Flash writes.
+// v1 (every block): ADD / DEL of a 4-byte UID, uid[] = UID + BCC.
+// v2 (blocks with CARD_FMT_UID_V2): ADD / DEL | CARD_LOG_OP_LONG for a 7 / 10-byte
+// UID is a header laid out like a transaction header (count 1, one blob record,
+// uid[4] + pad0 = CRC of the blob) followed by one record holding the long key.
 typedef struct {
     uint8_t  magic;                 // Fixed = CARD_FLASH_MAGIC (1 byte)
     uint8_t  op;                    // ADD / DEL (1 byte)
@@ -44,55 +33,207 @@ typedef char cardlog_size_check[(sizeof(card_log_t) % 4) == 0 ? 1 : -1];
 // --------- RAM whitelist data ---------------------------------------
 
 // --------- Flash blocks (for wear leveling) -------------------------
-// We use 2 Flash sectors as two blocks and alternate which one is active.
+// Every sector in CARD_DB_SECTORS is one block; one of them holds the live log.
+// Each block starts with two records:
+//
+//   [HDR ]  uid[0..3] = erase count, written right after every erase
+//   [OPEN]  uid[0..3] = generation, written once the block's first checkpoint
+//           is complete; the block with the highest generation is the live one
+//   [log ]  checkpoint, then ADD/DEL records, transactions, more checkpoints
+//
+// GC moves the whitelist into the least-worn other block, so the erase counts
+// survive reboots and every sector in the set wears at the same rate.
+
+typedef enum {
+    BLOCK_FREE = 0,       // HDR only, rest erased: ready to become the log
+    BLOCK_ACTIVE,         // The live log
+    BLOCK_DIRTY,          // Old / torn contents, needs an erase first
+} card_block_state_t;
 
 typedef struct {
     uint32_t sector;      // FLASH_SECTOR_x
     uint32_t base_addr;   // Start address
     uint32_t size;        // Block size in bytes
-    uint32_t erase_count; // In-RAM counter, just for wear-leveling demo
+    uint32_t erase_count; // Persisted in the HDR record
+    uint32_t gen;         // Generation from the OPEN record
+    uint8_t  state;       // card_block_state_t
+    uint8_t  fmt;         // Record format (CARD_FMT_xxx) from the HDR record
 } card_block_t;
 
-#define CARD_BLOCK_COUNT   2
+static const uint8_t g_sector_list[] = CARD_DB_SECTORS;
 
-// ★ Address and size must match your MCU; values below are typical for STM32F407.
-static card_block_t g_blocks[CARD_BLOCK_COUNT] = {
-    { FLASH_SECTOR_10, 0x080C0000U, 0x20000U, 0 },  // Block 0: 128KB
-    { FLASH_SECTOR_11, 0x080E0000U, 0x20000U, 0 },  // Block 1: 128KB
-};
+#define CARD_BLOCK_COUNT   ((int)sizeof(g_sector_list))
+#define CARD_BLOCK_HDR_SIZE (2U * CARD_LOG_SIZE)    // HDR + OPEN
+
+typedef char cardblock_count_check[(sizeof(g_sector_list) >= 2) ? 1 : -1];
+
+// Format written into freshly erased blocks: the configured CRC, always with long UIDs.
+#define CARD_FMT_NEW       ((uint8_t)(CARD_DB_FORMAT_VERSION | CARD_FMT_UID_V2))
+
+static card_block_t g_blocks[sizeof(g_sector_list)];
 
 static int      g_active_block = 0;  // Which block is currently active
+static uint32_t g_data_start   = 0;  // First log address in the active block (after HDR / OPEN)
 static uint16_t g_last_seq     = 0;  // Largest sequence number seen in log
 static uint32_t g_next_addr    = 0;  // Next log address inside the active block
+static uint32_t g_ops_since_ckpt = 0; // ADD/DEL records after the newest checkpoint
+
+// Incremental GC state (see carddb_gc_step)
+typedef enum {
+    GC_IDLE = 0,
+    GC_COPY,
+} card_gc_state_t;
 
-// Whitelist state stored in RAM
-static card_entry_t g_cards[CARD_DB_MAX_CARDS];
+// Packs keys into whole records, programmed CARD_BLOB_CHUNK bytes at a time
+// (checkpoint blobs, the GC copy).
+#define CARD_KEY_LONG      (1 + CARD_UID_MAX_LEN)   // Long key: UID length, then the UID (0-padded)
+#define CARD_BLOB_CHUNK    (5U * CARD_LOG_SIZE)     // 12 short keys per Flash write
+
+typedef struct {
+    uint32_t addr;                                  // Next Flash address
+    uint32_t fill;                                  // Bytes waiting in buf
+    uint8_t  buf[CARD_BLOB_CHUNK + CARD_KEY_LONG];
+} card_blob_writer_t;
+
+static uint8_t  g_gc_state = GC_IDLE;
+static int      g_gc_block;      // Target block
+static uint32_t g_gc_hdr;        // Checkpoint header address in the target
+static card_blob_writer_t g_gc_blob;    // Blob being written in the target
+static uint32_t g_gc_tail;       // Old-log address where the copy started
+static int      g_gc_cursor;     // Next slot to look at in g_gc_pending
+static uint16_t g_gc_count;      // Cards in the snapshot
+static uint16_t g_gc_long;       // ... of them long UIDs
+static uint16_t g_gc_seq;
+
+// Whitelist state stored in RAM (keys in CCMRAM on target, bitmaps in SRAM).
+// Keys are packed back to back; which slots are valid lives in a separate bitmap.
+// Slots [0, CARD_DB_MAX_CARDS) hold 4-byte UIDs as UID + BCC (the v1 key), the
+// CARD_DB_MAX_LONG_CARDS slots after them 7 / 10-byte UIDs, so looking up the
+// common 4-byte card still hashes 4 bytes and compares 5.
+#define CARD_SLOTS         (CARD_DB_MAX_CARDS + CARD_DB_MAX_LONG_CARDS)
+#define CARD_BITMAP_WORDS  ((CARD_SLOTS + 31) / 32)
+
+static uint8_t  g_card_uids[CARD_DB_MAX_CARDS][CARD_UID_SIZE]      CARD_DB_CCMRAM;
+static uint8_t  g_card_long[CARD_DB_MAX_LONG_CARDS][CARD_KEY_LONG] CARD_DB_CCMRAM;
+static uint32_t g_card_used[CARD_BITMAP_WORDS];    // SRAM: CCMRAM is full of keys
+static int      g_card_count = 0;   // Number of used slots
+static int      g_long_count = 0;   // ... of them long UIDs
+static int      g_free_hint  = 0;   // No free short slot below word g_free_hint
+
+// Slots in the running GC snapshot that are not copied yet (see carddb_gc_step):
+// kept out of card_alloc_slot so their UID bytes stay as they were at GC start.
+static uint32_t g_gc_pending[CARD_BITMAP_WORDS];
+
+#if CARD_DB_HASH_INDEX
+// --------- UID hash index (open addressing, linear probing) ----------------
+// Each slot holds an index into g_card_uids[], or EMPTY / TOMBSTONE.
+// Deleting only leaves a tombstone, so a lookup never has to move entries;
+// the table is rebuilt once tombstones take up a quarter of the slots.
+
+#define CARD_HASH_SLOTS      (1U << CARD_DB_HASH_BITS)
+#define CARD_HASH_MASK       (CARD_HASH_SLOTS - 1U)
+#define CARD_IDX_EMPTY       0xFFFFU
+#define CARD_IDX_TOMBSTONE   0xFFFEU
+
+// Compile-time checks: load factor <= 75%, and card indices fit in 16 bits.
+typedef char cardhash_size_check[(3U * CARD_HASH_SLOTS >= 4U * CARD_SLOTS) ? 1 : -1];
+typedef char cardhash_idx_check[(CARD_SLOTS < CARD_IDX_TOMBSTONE) ? 1 : -1];
+
+static uint16_t g_index[CARD_HASH_SLOTS];
+static uint32_t g_index_tombstones = 0;
+#endif
 
 // Convenience macros
 #define CUR_BLOCK      (g_blocks[g_active_block])
-#define CUR_BASE_ADDR  (CUR_BLOCK.base_addr)
 #define CUR_BLOCK_SIZE (CUR_BLOCK.size)
 
 
-// --------- Small helpers: UID compare / copy ------------------------------
+// --------- Small helpers: keys ---------------------------------------------
+// A whitelist key as it is stored in RAM and in the log: CARD_UID_SIZE bytes
+// (UID + BCC) for a 4-byte UID, CARD_KEY_LONG bytes for a 7 / 10-byte one.
+
+typedef struct {
+    uint8_t len;                    // CARD_UID_SIZE or CARD_KEY_LONG
+    uint8_t b[CARD_KEY_LONG];
+} card_key_t;
+
+// Key of a card UID; 0 if the length is not 4 / 7 / 10.
+static int key_from_uid(card_key_t *k, const card_uid_t *uid)
+{
+    if (uid->len == 4) {
+        k->len = CARD_UID_SIZE;
+        memcpy(k->b, uid->uid, 4);
+        k->b[4] = uid->uid[0] ^ uid->uid[1] ^ uid->uid[2] ^ uid->uid[3];   // BCC
+        return 1;
+    }
+    if (uid->len == 7 || uid->len == 10) {
+        memset(k->b, 0, sizeof(k->b));
+        k->len  = CARD_KEY_LONG;
+        k->b[0] = uid->len;
+        memcpy(&k->b[1], uid->uid, uid->len);
+        return 1;
+    }
+    return 0;
+}
+
+// Key from its packed form (log blobs, batches).
+static void key_load(card_key_t *k, const uint8_t *p, uint8_t len)
+{
+    k->len = len;
+    memcpy(k->b, p, len);
+}
+
+static int key_is_long(const card_key_t *k)
+{
+    return k->len == CARD_KEY_LONG;
+}
+
+// Key bytes of a slot, and their length.
+static uint8_t *slot_key(int slot)
+{
+    return (slot < CARD_DB_MAX_CARDS) ? g_card_uids[slot]
+                                      : g_card_long[slot - CARD_DB_MAX_CARDS];
+}
 
-static int uid_equal(const uint8_t a[CARD_UID_SIZE],
-                     const uint8_t b[CARD_UID_SIZE])
+static uint8_t slot_key_len(int slot)
 {
-    return (memcmp(a, b, CARD_UID_SIZE) == 0);
+    return (slot < CARD_DB_MAX_CARDS) ? CARD_UID_SIZE : CARD_KEY_LONG;
 }
 
-static void uid_copy(uint8_t dst[CARD_UID_SIZE],
-                     const uint8_t src[CARD_UID_SIZE])
+static int slot_matches(int slot, const card_key_t *k)
 {
-    memcpy(dst, src, CARD_UID_SIZE);
+    if (k->len == CARD_UID_SIZE) {
+        return slot < CARD_DB_MAX_CARDS &&
+               memcmp(g_card_uids[slot], k->b, CARD_UID_SIZE) == 0;
+    }
+    return slot >= CARD_DB_MAX_CARDS &&
+           memcmp(g_card_long[slot - CARD_DB_MAX_CARDS], k->b, CARD_KEY_LONG) == 0;
 }
 
-// --------- Simple CRC16 (nice to mention in interviews) ---------------
+static void slot_to_uid(int slot, card_uid_t *out)
+{
+    const uint8_t *p = slot_key(slot);
 
-static uint16_t crc16_ccitt(const uint8_t *data, uint32_t len)
+    memset(out, 0, sizeof(*out));
+    if (slot < CARD_DB_MAX_CARDS) {
+        out->len = 4;
+        memcpy(out->uid, p, 4);
+    } else {
+        out->len = (p[0] <= CARD_UID_MAX_LEN) ? p[0] : CARD_UID_MAX_LEN;
+        memcpy(out->uid, &p[1], out->len);
+    }
+}
+
+// --------- Checksums ------------------------------------------------------
+// The format version in each block's HDR record picks the checksum of every
+// record and blob in that block (HDR / OPEN themselves always use CRC16):
+//   CARD_FMT_CRC16  CRC16-CCITT over the bytes; slice-by-4 tables, or one bit
+//                   at a time with CARD_DB_CRC16_SLICES = 0
+//   CARD_FMT_CRC32  CRC32 over 32-bit words (carddb_port_crc32: the F407 CRC
+//                   unit on target), low 16 bits stored
+
+static uint16_t crc16_ccitt_update(uint16_t crc, const uint8_t *data, uint32_t len)
 {
-    uint16_t crc = 0xFFFF;
     for (uint32_t i = 0; i < len; i++) {
         crc ^= (uint16_t)data[i] << 8;
         for (int j = 0; j < 8; j++) {
@@ -106,11 +247,73 @@ static uint16_t crc16_ccitt(const uint8_t *data, uint32_t len)
     return crc;
 }
 
-static uint16_t card_log_crc(const card_log_t *rec)
+#if CARD_DB_CRC16_SLICES
+// g_crc16_tab[k][i]: byte i followed by k zero bytes.
+static uint16_t g_crc16_tab[4][256];
+
+static void crc16_table_init(void)
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint8_t b = (uint8_t)i;
+        g_crc16_tab[0][i] = crc16_ccitt_update(0, &b, 1);
+    }
+    for (uint32_t k = 1; k < 4; k++) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint16_t t = g_crc16_tab[k - 1][i];
+            g_crc16_tab[k][i] = (uint16_t)((t << 8) ^ g_crc16_tab[0][t >> 8]);
+        }
+    }
+}
+
+// Four bytes per step, then one byte per step for the rest.
+static uint16_t crc16_ccitt_fast(uint16_t crc, const uint8_t *data, uint32_t len)
+{
+    while (len >= 4) {
+        crc = g_crc16_tab[3][(crc >> 8) ^ data[0]] ^
+              g_crc16_tab[2][(crc & 0xFF) ^ data[1]] ^
+              g_crc16_tab[1][data[2]] ^
+              g_crc16_tab[0][data[3]];
+        data += 4;
+        len  -= 4;
+    }
+    while (len-- > 0) {
+        crc = (uint16_t)((crc << 8) ^ g_crc16_tab[0][(crc >> 8) ^ *data++]);
+    }
+    return crc;
+}
+#else
+static void crc16_table_init(void)
+{
+}
+
+#define crc16_ccitt_fast    crc16_ccitt_update
+#endif
+
+static uint16_t crc16_ccitt(const uint8_t *data, uint32_t len)
+{
+    return crc16_ccitt_fast(0xFFFF, data, len);
+}
+
+// Checksum of len bytes in the given record format.
+static uint16_t card_crc(uint8_t fmt, const void *data, uint32_t len)
+{
+    if ((fmt & CARD_FMT_CRC_MASK) == CARD_FMT_CRC32) {
+        return (uint16_t)carddb_port_crc32((const uint8_t *)data, len);
+    }
+    return crc16_ccitt((const uint8_t *)data, len);
+}
+
+static uint8_t g_log_fmt = CARD_FMT_CRC16;  // Format of the active block
+
+static uint16_t card_log_crc_fmt(const card_log_t *rec, uint8_t fmt)
 {
     // Compute CRC over all fields except the crc field itself.
-    return crc16_ccitt((const uint8_t *)rec,
-                       sizeof(card_log_t) - sizeof(rec->crc));
+    return card_crc(fmt, rec, sizeof(card_log_t) - sizeof(rec->crc));
+}
+
+static uint16_t card_log_crc(const card_log_t *rec)
+{
+    return card_log_crc_fmt(rec, g_log_fmt);
 }
 
 // --------- Flash helper functions -----------------------------------------
@@ -118,7 +321,7 @@ static uint16_t card_log_crc(const card_log_t *rec)
 // Check whether a flash region is all 0xFF (i.e., never programmed).
 static int flash_region_is_erased(uint32_t addr, uint32_t len)
 {
-    const uint8_t *p = (const uint8_t *)addr;
+    const uint8_t *p = carddb_port_flash_ptr(addr);
     for (uint32_t i = 0; i < len; i++) {
         if (p[i] != 0xFF) {
             return 0; // Not empty
@@ -130,478 +333,1578 @@ static int flash_region_is_erased(uint32_t addr, uint32_t len)
 // Read one log record from Flash (basically just treating Flash as const memory).
 static void flash_read_log(uint32_t addr, card_log_t *out)
 {
-    memcpy(out, (const void *)addr, sizeof(card_log_t));
+    memcpy(out, carddb_port_flash_ptr(addr), sizeof(card_log_t));
 }
 
-// Write one log record to Flash (word-by-word).
-static carddb_status_t flash_write_log(uint32_t addr, const card_log_t *rec)
+// Program len bytes (multiple of 4); the caller has unlocked the Flash.
+static carddb_status_t flash_program(uint32_t addr, const void *data, uint32_t len)
 {
-    HAL_StatusTypeDef hal_status;
-
     // Flash programming requires 32-bit aligned addresses.
-    if ((addr % 4) != 0) {
+    if ((addr % 4) != 0 || (len % 4) != 0) {
         // ★ Extra: log an error when alignment is wrong.
-        carddb_debug_flash_error("ALIGN_ERR");
+        CARDDB_LOG("ALIGN_ERR: HAL_FLASH error=0x%08lX\r\n", (unsigned long)carddb_port_flash_error());
         return CARDDB_ERR_FLASH;
     }
 
-    HAL_FLASH_Unlock();
+    if (carddb_port_flash_program(addr, (const uint8_t *)data, len) != CARDDB_OK) {
+        // ★ Extra: print HAL_FLASH_GetError() when programming fails.
+        CARDDB_LOG("PROG_ERR: HAL_FLASH error=0x%08lX\r\n", (unsigned long)carddb_port_flash_error());
+        return CARDDB_ERR_FLASH;
+    }
+    return CARDDB_OK;
+}
 
-    const uint8_t *p = (const uint8_t *)rec;
-    uint32_t current_addr = addr;
+// Write len bytes (multiple of 4) to Flash in one unlock window.
+static carddb_status_t flash_write_bytes(uint32_t addr, const void *data, uint32_t len)
+{
+    carddb_port_flash_unlock();
+    carddb_status_t st = flash_program(addr, data, len);
+    carddb_port_flash_lock();
+    return st;
+}
 
-    // Program in units of 4 bytes.
-    for (uint32_t i = 0; i < sizeof(card_log_t); i += 4) {
-        uint32_t word = 0xFFFFFFFFU;
-        // For the last partial word, remaining bytes stay as 0xFF.
-        memcpy(&word, p + i, 4);
+// Write one log record to Flash.
+static carddb_status_t flash_write_log(uint32_t addr, const card_log_t *rec)
+{
+    return flash_write_bytes(addr, rec, sizeof(card_log_t));
+}
 
-        hal_status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD,
-                                       current_addr,
-                                       word);
-        if (hal_status != HAL_OK) {
-            // ★ Extra: print HAL_FLASH_GetError() when programming fails.
-            carddb_debug_flash_error("PROG_ERR");
-            HAL_FLASH_Lock();
-            return CARDDB_ERR_FLASH;
-        }
+// Build a block HDR / OPEN record carrying a 32-bit value (and HDR: the format).
+static void block_rec_fill(card_log_t *rec, uint8_t op, uint32_t value, uint8_t fmt)
+{
+    memset(rec, 0xFF, sizeof(*rec));
+    rec->magic  = CARD_FLASH_MAGIC;
+    rec->op     = op;
+    rec->uid[0] = (uint8_t)(value);
+    rec->uid[1] = (uint8_t)(value >> 8);
+    rec->uid[2] = (uint8_t)(value >> 16);
+    rec->uid[3] = (uint8_t)(value >> 24);
+    rec->uid[4] = fmt;
+    rec->crc    = card_log_crc_fmt(rec, CARD_FMT_CRC16);
+}
 
-        current_addr += 4;
-    }
+static int block_rec_valid(const card_log_t *rec)
+{
+    return rec->magic == CARD_FLASH_MAGIC && rec->crc == card_log_crc_fmt(rec, CARD_FMT_CRC16);
+}
 
-    HAL_FLASH_Lock();
-    return CARDDB_OK;
+static uint32_t block_rec_value(const card_log_t *rec)
+{
+    return (uint32_t)rec->uid[0] | ((uint32_t)rec->uid[1] << 8) |
+           ((uint32_t)rec->uid[2] << 16) | ((uint32_t)rec->uid[3] << 24);
+}
+
+// Write the HDR record with the block's current erase count (block must be erased).
+static carddb_status_t block_write_hdr(int block_idx)
+{
+    card_log_t rec;
+    block_rec_fill(&rec, CARD_LOG_OP_HDR, g_blocks[block_idx].erase_count, g_blocks[block_idx].fmt);
+    return flash_write_log(g_blocks[block_idx].base_addr, &rec);
 }
 
-// Erase the entire sector corresponding to the given block and update erase_count.
+// Erase the entire sector corresponding to the given block, bump erase_count
+// and persist it in a fresh HDR record.  The block is FREE afterwards.
 static carddb_status_t flash_erase_block(int block_idx)
 {
-    HAL_StatusTypeDef      hal_status;
-    FLASH_EraseInitTypeDef erase_init;
-    uint32_t               sector_error = 0;
+    carddb_status_t st;
 
     if (block_idx < 0 || block_idx >= CARD_BLOCK_COUNT) {
         return CARDDB_ERR_FLASH;
     }
 
-    erase_init.TypeErase    = FLASH_TYPEERASE_SECTORS;
-    erase_init.Sector       = g_blocks[block_idx].sector;
-    erase_init.NbSectors    = 1;
-    erase_init.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+    carddb_port_flash_unlock();
+    st = carddb_port_flash_erase_sector(g_blocks[block_idx].sector);
+    carddb_port_flash_lock();
 
-    HAL_FLASH_Unlock();
-    hal_status = HAL_FLASHEx_Erase(&erase_init, &sector_error);
-    HAL_FLASH_Lock();
-
-    if (hal_status != HAL_OK) {
+    g_blocks[block_idx].state = BLOCK_DIRTY;
+    if (st != CARDDB_OK) {
         return CARDDB_ERR_FLASH;
     }
 
     g_blocks[block_idx].erase_count++;
+    g_blocks[block_idx].gen = 0;
+    g_blocks[block_idx].fmt = CARD_FMT_NEW;
+
+    st = block_write_hdr(block_idx);
+    if (st != CARDDB_OK) {
+        return st;
+    }
+    g_blocks[block_idx].state = BLOCK_FREE;
 
-    char dbg[64];
-    int len = snprintf(dbg, sizeof(dbg),
-                       "FLASH ERASE OK: block=%d erase_count=%lu\r\n",
-                       block_idx,
-                       (unsigned long)g_blocks[block_idx].erase_count);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
+    CARDDB_LOG("FLASH ERASE OK: block=%d erase_count=%lu\r\n",
+               block_idx,
+               (unsigned long)g_blocks[block_idx].erase_count);
 
     return CARDDB_OK;
 }
 
 // --------- Operations on the whitelist in RAM ---------------------------------
 
-// Find UID index in RAM whitelist, return -1 if not found.
-static int carddb_find_in_ram(const uint8_t uid[CARD_UID_SIZE])
+// Return the first set bit >= from in a slot bitmap, or -1.
+static int bitmap_next(const uint32_t *bm, int from)
 {
-    for (int i = 0; i < CARD_DB_MAX_CARDS; i++) {
-        if (g_cards[i].in_use && uid_equal(g_cards[i].uid, uid)) {
-            return i;
+    if (from >= CARD_SLOTS) {
+        return -1;
+    }
+
+    int      w    = from >> 5;
+    uint32_t bits = bm[w] & (0xFFFFFFFFU << (from & 31));
+
+    while (bits == 0) {
+        if (++w >= CARD_BITMAP_WORDS) {
+            return -1;
         }
+        bits = bm[w];
     }
-    return -1;
+    return (w << 5) + __builtin_ctz(bits);
 }
 
-// Add UID to RAM whitelist; if it already exists, treat as success.
-static void carddb_ram_add(const uint8_t uid[CARD_UID_SIZE])
+// Return the first used slot >= from, or -1.
+static int card_next_used(int from)
 {
-    int idx = carddb_find_in_ram(uid);
-    if (idx >= 0) {
-        return; // Already exists
-    }
+    return bitmap_next(g_card_used, from);
+}
 
-    for (int i = 0; i < CARD_DB_MAX_CARDS; i++) {
-        if (!g_cards[i].in_use) {
-            uid_copy(g_cards[i].uid, uid);
-            g_cards[i].in_use = 1;
-            return;
+// Claim the lowest free slot in [from, limit), or return -1.
+static int card_alloc_in(int from, int limit)
+{
+    for (int w = from >> 5; w < CARD_BITMAP_WORDS; w++) {
+        uint32_t taken = g_card_used[w] | g_gc_pending[w];
+        if (w == (from >> 5)) {
+            taken |= (1U << (from & 31)) - 1U;     // Slots below from
+        }
+        if (taken != 0xFFFFFFFFU) {
+            int i = (w << 5) + __builtin_ctz(~taken);
+            if (i >= limit) {
+                return -1;
+            }
+            g_card_used[w] |= 1U << (i & 31);
+            return i;
         }
     }
+    return -1;
 }
 
-// Remove UID from RAM whitelist.
-static void carddb_ram_del(const uint8_t uid[CARD_UID_SIZE])
+// Claim a slot in the short (4-byte UID) or the long table, or -1 if it is full.
+static int card_alloc_slot(int is_long)
 {
-    int idx = carddb_find_in_ram(uid);
-    if (idx >= 0) {
-        g_cards[idx].in_use = 0;
+    if (is_long) {
+        return card_alloc_in(CARD_DB_MAX_CARDS, CARD_SLOTS);
     }
+
+    int i = card_alloc_in(g_free_hint << 5, CARD_DB_MAX_CARDS);
+    g_free_hint = (i >= 0) ? (i >> 5) : CARD_BITMAP_WORDS;
+    return i;
 }
 
-// --------- Replay Flash log at boot (supports multiple blocks) ----------------
-static void carddb_replay_from_flash(void)
+static void card_free_slot(int i)
 {
-    memset(g_cards, 0, sizeof(g_cards));
-    g_last_seq  = 0;
-    g_next_addr = 0;
-    g_active_block = 0;
+    g_card_used[i >> 5] &= ~(1U << (i & 31));
+    if (i < CARD_DB_MAX_CARDS && (i >> 5) < g_free_hint) {
+        g_free_hint = i >> 5;
+    }
+}
 
-    char dbg[128];
+#if CARD_DB_HASH_INDEX
+// Fibonacci hash of the 4 UID bytes (the 5th byte of a short key is the BCC,
+// it adds nothing); a long key folds its other bytes in first.
+static uint32_t key_hash(const card_key_t *k)
+{
+    uint32_t h = ((uint32_t)k->b[0] << 24) | ((uint32_t)k->b[1] << 16) |
+                 ((uint32_t)k->b[2] << 8)  |  (uint32_t)k->b[3];
 
-    HAL_UART_Transmit(&DBG_UART,
-                      (uint8_t*)"carddb_replay_from_flash BEGIN\r\n",
-                      strlen("carddb_replay_from_flash BEGIN\r\n"),
-                      HAL_MAX_DELAY);
+    if (key_is_long(k)) {
+        for (uint32_t i = 4; i < CARD_KEY_LONG; i++) {
+            h = (h ^ k->b[i]) * 16777619U;
+        }
+    }
+    return (h * 2654435761U) >> (32 - CARD_DB_HASH_BITS);
+}
 
-    // 1) First, find which block actually has data (not all 0xFF).
-    int found_block = -1;
-    for (int i = 0; i < CARD_BLOCK_COUNT; i++) {
-        uint32_t addr = g_blocks[i].base_addr;
+// Return the hash slot holding this key, or -1.
+static int index_lookup(const card_key_t *k)
+{
+    uint32_t pos = key_hash(k);
 
-        if (!flash_region_is_erased(addr, CARD_LOG_SIZE)) {
-            // If the first record of this block is not all 0xFF, treat this block as having valid data.
-            found_block = i;
-            break;
+    for (uint32_t n = 0; n < CARD_HASH_SLOTS; n++) {
+        uint16_t v = g_index[pos];
+        if (v == CARD_IDX_EMPTY) {
+            return -1;
         }
+        if (v != CARD_IDX_TOMBSTONE && slot_matches(v, k)) {
+            return (int)pos;
+        }
+        pos = (pos + 1) & CARD_HASH_MASK;
     }
+    return -1;
+}
 
-    if (found_block < 0) {
-        // No logs found at all; start fresh using block 0.
-        g_active_block = 0;
-        g_next_addr    = g_blocks[0].base_addr;
-
-        HAL_UART_Transmit(&DBG_UART,
-                          (uint8_t*)"REPLAY: no valid block, start fresh on block 0\r\n",
-                          strlen("REPLAY: no valid block, start fresh on block 0\r\n"),
-                          HAL_MAX_DELAY);
-        return;
+// Insert a card index; the key must not already be in the table.
+static void index_insert(const card_key_t *k, uint16_t card_idx)
+{
+    uint32_t pos = key_hash(k);
+
+    while (g_index[pos] != CARD_IDX_EMPTY && g_index[pos] != CARD_IDX_TOMBSTONE) {
+        pos = (pos + 1) & CARD_HASH_MASK;
+    }
+    if (g_index[pos] == CARD_IDX_TOMBSTONE) {
+        g_index_tombstones--;
     }
+    g_index[pos] = card_idx;
+}
 
-    g_active_block = found_block;
+// Rebuild the table from the card bitmap to drop all tombstones.
+static void index_rebuild(void)
+{
+    memset(g_index, 0xFF, sizeof(g_index));
+    g_index_tombstones = 0;
 
-    uint32_t addr     = g_blocks[g_active_block].base_addr;
-    uint32_t end_addr = addr + g_blocks[g_active_block].size;
+    for (int i = card_next_used(0); i >= 0; i = card_next_used(i + 1)) {
+        card_key_t k;
+        key_load(&k, slot_key(i), slot_key_len(i));
+        index_insert(&k, (uint16_t)i);
+    }
+}
 
-    uint16_t max_seq = 0;
+static void index_remove_slot(int pos)
+{
+    g_index[pos] = CARD_IDX_TOMBSTONE;
+    g_index_tombstones++;
 
-    while (addr + CARD_LOG_SIZE <= end_addr) {
-        // If this record is all 0xFF, the rest is also empty.
-        if (flash_region_is_erased(addr, CARD_LOG_SIZE)) {
-            int len = snprintf(dbg, sizeof(dbg),
-                               "REPLAY: block=%d addr=0x%08lX ERASED, stop\r\n",
-                               g_active_block, (unsigned long)addr);
-            HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
-            break;
-        }
+    if (g_index_tombstones > CARD_HASH_SLOTS / 4) {
+        index_rebuild();
+    }
+}
+#endif
 
-        card_log_t rec;
-        flash_read_log(addr, &rec);
+// Clear the RAM whitelist (and its index).
+// The CCMRAM table is not touched by the startup code, so this is its only init.
+static void carddb_ram_reset(void)
+{
+    memset(g_card_uids, 0, sizeof(g_card_uids));
+    memset(g_card_long, 0, sizeof(g_card_long));
+    memset(g_card_used, 0, sizeof(g_card_used));
+    memset(g_gc_pending, 0, sizeof(g_gc_pending));
+    g_card_count = 0;
+    g_long_count = 0;
+    g_free_hint  = 0;
+
+#if CARD_DB_HASH_INDEX
+    memset(g_index, 0xFF, sizeof(g_index));
+    g_index_tombstones = 0;
+#endif
+}
 
-        int len = snprintf(dbg, sizeof(dbg),
-                           "REPLAY: block=%d addr=0x%08lX magic=0x%02X op=%u "
-                           "uid=%02X %02X %02X %02X %02X seq=%u crc=0x%04X\r\n",
-                           g_active_block,
-                           (unsigned long)addr,
-                           rec.magic,
-                           (unsigned)rec.op,
-                           rec.uid[0], rec.uid[1], rec.uid[2], rec.uid[3], rec.uid[4],
-                           (unsigned)rec.seq,
-                           rec.crc);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
-
-        // magic check
-        if (rec.magic != CARD_FLASH_MAGIC) {
-            HAL_UART_Transmit(&DBG_UART,
-                              (uint8_t*)"REPLAY: bad magic, stop\r\n",
-                              strlen("REPLAY: bad magic, stop\r\n"),
-                              HAL_MAX_DELAY);
-            break;
+// Find the key's slot in the RAM whitelist, return -1 if not found.
+static int carddb_find_in_ram(const card_key_t *k)
+{
+#if CARD_DB_HASH_INDEX
+    int pos = index_lookup(k);
+    return (pos >= 0) ? (int)g_index[pos] : -1;
+#else
+    int from = key_is_long(k) ? CARD_DB_MAX_CARDS : 0;
+    for (int i = card_next_used(from); i >= 0; i = card_next_used(i + 1)) {
+        if (slot_matches(i, k)) {
+            return i;
         }
+    }
+    return -1;
+#endif
+}
 
-        // CRC check
-        uint16_t crc = card_log_crc(&rec);
-        if (crc != rec.crc) {
-            len = snprintf(dbg, sizeof(dbg),
-                           "REPLAY: bad CRC calc=0x%04X stored=0x%04X, stop\r\n",
-                           crc, rec.crc);
-            HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
-            break;
-        }
+// Store a key that is not in the whitelist yet; -1 if its table is full.
+static int carddb_ram_store(const card_key_t *k)
+{
+    int slot = card_alloc_slot(key_is_long(k));
+    if (slot < 0) {
+        return -1; // RAM whitelist full
+    }
 
-        // Update max seq
-        if (rec.seq > max_seq) {
-            max_seq = rec.seq;
-        }
+    memcpy(slot_key(slot), k->b, k->len);
+    g_card_count++;
+    if (key_is_long(k)) {
+        g_long_count++;
+    }
 
-        // Apply operation to RAM whitelist
-        if (rec.op == CARD_LOG_OP_ADD) {
-            carddb_ram_add(rec.uid);
-        } else if (rec.op == CARD_LOG_OP_DEL) {
-            carddb_ram_del(rec.uid);
-        }
+#if CARD_DB_HASH_INDEX
+    index_insert(k, (uint16_t)slot);
+#endif
+    return slot;
+}
 
-        addr += CARD_LOG_SIZE;
+// Add a key to the RAM whitelist; if it already exists, treat as success.
+// Returns 1 = added, 0 = already there, -1 = RAM whitelist full.
+static int carddb_ram_add(const card_key_t *k)
+{
+    if (carddb_find_in_ram(k) >= 0) {
+        return 0; // Already exists
     }
+    return (carddb_ram_store(k) >= 0) ? 1 : -1;
+}
 
-    g_last_seq  = max_seq;
-    g_next_addr = addr;
+// Bulk load from a checkpoint: the keys there are already unique, so no lookup first.
+static void carddb_ram_load(const uint8_t *p, uint8_t len)
+{
+    card_key_t k;
+    key_load(&k, p, len);
+    carddb_ram_store(&k);
+}
+
+// Remove a key from the RAM whitelist.
+static void carddb_ram_del(const card_key_t *k)
+{
+#if CARD_DB_HASH_INDEX
+    int pos = index_lookup(k);
+    if (pos < 0) {
+        return;
+    }
+    int idx = (int)g_index[pos];
+    index_remove_slot(pos);
+#else
+    int idx = carddb_find_in_ram(k);
+    if (idx < 0) {
+        return;
+    }
+#endif
 
-    int len = snprintf(dbg, sizeof(dbg),
-                       "REPLAY DONE: active_block=%d last_seq=%u, next_addr=0x%08lX\r\n",
-                       g_active_block,
-                       (unsigned)g_last_seq,
-                       (unsigned long)g_next_addr);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
+    card_free_slot(idx);
+    g_card_count--;
+    if (idx >= CARD_DB_MAX_CARDS) {
+        g_long_count--;
+    }
 }
 
-// --------- Public API implementations -----------------------------------------
-static void carddb_dump_flash(void);   
+// --------- Checkpoints ------------------------------------------------------
+// A checkpoint is a snapshot of the whole RAM whitelist, written into the log
+// so replay can start from it instead of from the beginning of the block:
+//
+//   [CKPT header]  uid[0..1] = card count, uid[2..3] = blob length in records,
+//                  uid[4] + pad0 = how many of the cards are long UIDs (v2; 0xFFFF in v1)
+//   [UID blob   ]  the short keys (CARD_UID_SIZE each), then the long keys
+//                  (CARD_KEY_LONG each), 0xFF-padded to whole records
+//   [CKPT_END   ]  same count / length, uid[4] + pad0 = CRC16 of the keys
+//
+// The END record is written last, so a checkpoint without a valid END (power
+// loss in the middle) is simply ignored.  Blob bytes are never parsed as records.
 
-void carddb_init(void)
+typedef struct {
+    uint16_t count;       // Cards in the snapshot
+    uint16_t blob_recs;   // Blob length in CARD_LOG_SIZE units
+    uint16_t blob_crc;    // CRC16 of the packed keys (END record only)
+    uint16_t n_long;      // Long keys among them (header only)
+} card_ckpt_info_t;
+
+static uint32_t recs_for(uint32_t bytes)
 {
-    carddb_replay_from_flash();
+    return (bytes + CARD_LOG_SIZE - 1) / CARD_LOG_SIZE;
+}
+
+// Packed size of n keys of which n_long are long.
+static uint32_t ckpt_blob_bytes(uint32_t n, uint32_t n_long)
+{
+    return (n - n_long) * CARD_UID_SIZE + n_long * CARD_KEY_LONG;
+}
 
-    int cnt = carddb_get_all(NULL, 0);  // Count only, don't fill array
+static uint32_t ckpt_blob_recs(uint32_t n, uint32_t n_long)
+{
+    return recs_for(ckpt_blob_bytes(n, n_long));
+}
+
+// Total checkpoint size in bytes (header + blob + END).
+static uint32_t ckpt_size(uint32_t n, uint32_t n_long)
+{
+    return (2 + ckpt_blob_recs(n, n_long)) * CARD_LOG_SIZE;
+}
 
-    char dbg[96];
-    int len = snprintf(dbg, sizeof(dbg),
-                       "carddb_init: RAM cards=%d, active_block=%d last_seq=%u, next_addr=0x%08lX\r\n",
-                       cnt,
-                       g_active_block,
-                       (unsigned)g_last_seq,
-                       (unsigned long)g_next_addr);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
+// Transactions (carddb_txn_xxx) use the same header / blob / END layout with
+// op TXN / TXN_END; each blob entry is the op byte followed by the key
+// (op | CARD_LOG_OP_LONG: a long key).
+#define CARD_TXN_ENTRY_SIZE  (1U + CARD_UID_SIZE)
+#define CARD_TXN_ENTRY_LONG  (1U + CARD_KEY_LONG)
 
-    carddb_dump_flash();
+static uint32_t txn_blob_bytes(uint32_t n, uint32_t n_long)
+{
+    return (n - n_long) * CARD_TXN_ENTRY_SIZE + n_long * CARD_TXN_ENTRY_LONG;
 }
 
+static uint32_t txn_blob_recs(uint32_t n, uint32_t n_long)
+{
+    return recs_for(txn_blob_bytes(n, n_long));
+}
 
-// Check whether a UID is in the whitelist.
-int carddb_check(const uint8_t uid[CARD_UID_SIZE])
+static uint32_t txn_size(uint32_t n, uint32_t n_long)
 {
-    return (carddb_find_in_ram(uid) >= 0) ? 1 : 0;
+    return (2 + txn_blob_recs(n, n_long)) * CARD_LOG_SIZE;
 }
 
-// Get all whitelist entries (useful for debug / displaying).
-int carddb_get_all(card_entry_t *out_array, int max_items)
+// END records and the long ADD / DEL header carry the blob CRC in uid[4] + pad0,
+// CKPT / TXN headers the long-key count.
+static int rec_has_blob_crc(uint8_t op)
 {
-    int count = 0;
-    for (int i = 0; i < CARD_DB_MAX_CARDS; i++) {
-        if (g_cards[i].in_use) {
-            if (count < max_items) {
-                out_array[count] = g_cards[i];
-            }
-            count++;
-        }
-    }
-    return count; // Real whitelist count (may be > max_items)
+    return op == CARD_LOG_OP_CKPT_END || op == CARD_LOG_OP_TXN_END ||
+           (op & CARD_LOG_OP_LONG) != 0;
 }
 
-// --------- Garbage collection (GC): move data and do simple wear leveling ----
+static void ckpt_info_pack(card_log_t *rec, const card_ckpt_info_t *info)
+{
+    uint16_t aux = rec_has_blob_crc(rec->op) ? info->blob_crc : info->n_long;
+
+    rec->uid[0] = (uint8_t)(info->count);
+    rec->uid[1] = (uint8_t)(info->count >> 8);
+    rec->uid[2] = (uint8_t)(info->blob_recs);
+    rec->uid[3] = (uint8_t)(info->blob_recs >> 8);
+    rec->uid[4] = (uint8_t)(aux);
+    rec->pad0   = (uint8_t)(aux >> 8);
+}
 
-// Select the next block to write (simple round-robin here; you could use erase_count for smarter wear leveling).
-static int select_next_block_for_gc(void)
+static void ckpt_info_unpack(const card_log_t *rec, card_ckpt_info_t *info)
 {
-    // Simple version: just alternate between two blocks.
-    return (g_active_block + 1) % CARD_BLOCK_COUNT;
+    uint16_t aux = (uint16_t)(rec->uid[4] | (rec->pad0 << 8));
+
+    info->count     = (uint16_t)(rec->uid[0] | (rec->uid[1] << 8));
+    info->blob_recs = (uint16_t)(rec->uid[2] | (rec->uid[3] << 8));
+    info->blob_crc  = rec_has_blob_crc(rec->op) ? aux : 0xFFFF;
+    info->n_long    = rec_has_blob_crc(rec->op) ? 0 : ((aux == 0xFFFF) ? 0 : aux);
 }
 
-static carddb_status_t carddb_gc(void)
+// Record has the right magic and CRC.
+static int log_rec_valid(const card_log_t *rec)
 {
-    char dbg[128];
+    return rec->magic == CARD_FLASH_MAGIC && rec->crc == card_log_crc(rec);
+}
 
-    HAL_UART_Transmit(&DBG_UART,
-                      (uint8_t*)"GC: START\r\n",
-                      strlen("GC: START\r\n"),
-                      HAL_MAX_DELAY);
+// If addr holds a valid CKPT / TXN / long ADD / long DEL header whose blob (and
+// END record, if it has one) fits before end_addr, return the header's extent
+// (header + blob) in bytes and its op; otherwise 0.
+static uint32_t blob_header_extent(uint32_t addr, uint32_t end_addr,
+                                   uint8_t *op, card_ckpt_info_t *info)
+{
+    card_log_t rec;
+    flash_read_log(addr, &rec);
 
-    // Count valid cards in RAM.
-    int valid_count = 0;
-    for (int i = 0; i < CARD_DB_MAX_CARDS; i++) {
-        if (g_cards[i].in_use) {
-            valid_count++;
-        }
+    if ((rec.op != CARD_LOG_OP_CKPT && rec.op != CARD_LOG_OP_TXN &&
+         rec.op != (CARD_LOG_OP_ADD | CARD_LOG_OP_LONG) &&
+         rec.op != (CARD_LOG_OP_DEL | CARD_LOG_OP_LONG)) || !log_rec_valid(&rec)) {
+        return 0;
+    }
+    ckpt_info_unpack(&rec, info);
+    *op = rec.op;
+
+    uint32_t extent = (1U + info->blob_recs) * CARD_LOG_SIZE;
+    uint32_t end    = CARD_LOG_SIZE;
+    int      shape_ok;
+
+    if (rec.op == CARD_LOG_OP_CKPT) {
+        shape_ok = info->count <= CARD_SLOTS && info->n_long <= info->count &&
+                   info->blob_recs == ckpt_blob_recs(info->count, info->n_long);
+    } else if (rec.op == CARD_LOG_OP_TXN) {
+        shape_ok = info->count <= CARD_DB_TXN_MAX && info->n_long <= info->count &&
+                   info->blob_recs == txn_blob_recs(info->count, info->n_long);
+    } else {
+        shape_ok = info->count == 1 && info->blob_recs == 1;
+        end      = 0;
     }
 
-    int len = snprintf(dbg, sizeof(dbg),
-                       "GC: valid cards=%d\r\n", valid_count);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
-
-    // Estimate minimum space needed after GC (one ADD log per valid card).
-    uint32_t needed = (uint32_t)valid_count * CARD_LOG_SIZE;
+    if (!shape_ok || addr + extent + end > end_addr) {
+        return 0;
+    }
+    return extent;
+}
 
-    // Select the next block as the new active block.
-    int new_block = select_next_block_for_gc();
-    int old_block = g_active_block;
+static void blob_begin(card_blob_writer_t *w, uint32_t addr)
+{
+    w->addr = addr;
+    w->fill = 0;
+}
 
-    if (needed > g_blocks[new_block].size) {
-        int len2 = snprintf(dbg, sizeof(dbg),
-                            "GC: needed=%lu > block_size=%lu, FULL\r\n",
-                            (unsigned long)needed,
-                            (unsigned long)g_blocks[new_block].size);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len2, HAL_MAX_DELAY);
-        return CARDDB_ERR_FULL;
+static carddb_status_t blob_put(card_blob_writer_t *w, const uint8_t *p, uint32_t len)
+{
+    memcpy(&w->buf[w->fill], p, len);
+    w->fill += len;
+    if (w->fill < CARD_BLOB_CHUNK) {
+        return CARDDB_OK;
     }
 
-    // 2) First erase the new block.
-    carddb_status_t est = flash_erase_block(new_block);
-    if (est != CARDDB_OK) {
-        int len2 = snprintf(dbg, sizeof(dbg),
-                            "GC: flash_erase_block(new) FAIL, st=%d\r\n", (int)est);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len2, HAL_MAX_DELAY);
-        return est;
+    carddb_status_t st = flash_write_bytes(w->addr, w->buf, CARD_BLOB_CHUNK);
+    w->addr += CARD_BLOB_CHUNK;
+    w->fill -= CARD_BLOB_CHUNK;
+    memmove(w->buf, &w->buf[CARD_BLOB_CHUNK], w->fill);
+    return st;
+}
+
+// Write out the last, partial record (0xFF-padded).
+static carddb_status_t blob_flush(card_blob_writer_t *w)
+{
+    if (w->fill == 0) {
+        return CARDDB_OK;
     }
 
-    // 3) For every in_use card in RAM, write an ADD log into the new block.
-    uint32_t addr     = g_blocks[new_block].base_addr;
-    uint16_t new_seq  = 0;
+    uint32_t padded = recs_for(w->fill) * CARD_LOG_SIZE;
+    memset(&w->buf[w->fill], 0xFF, padded - w->fill);
 
-    for (int i = 0; i < CARD_DB_MAX_CARDS; i++) {
-        if (!g_cards[i].in_use)
-            continue;
+    carddb_status_t st = flash_write_bytes(w->addr, w->buf, padded);
+    w->addr += padded;
+    w->fill  = 0;
+    return st;
+}
 
-        card_log_t rec;
-        memset(&rec, 0xFF, sizeof(rec));
-
-        rec.magic = CARD_FLASH_MAGIC;
-        rec.op    = CARD_LOG_OP_ADD;
-        uid_copy(rec.uid, g_cards[i].uid);
-        rec.seq   = ++new_seq;           // After GC, sequence numbers are re-numbered starting from 1.
-        rec.crc   = card_log_crc(&rec);
-
-        int len2 = snprintf(dbg, sizeof(dbg),
-                            "GC WRITE: block=%d addr=0x%08lX seq=%u "
-                            "uid=%02X %02X %02X %02X %02X crc=0x%04X\r\n",
-                            new_block,
-                            (unsigned long)addr,
-                            (unsigned)rec.seq,
-                            rec.uid[0], rec.uid[1], rec.uid[2], rec.uid[3], rec.uid[4],
-                            rec.crc);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len2, HAL_MAX_DELAY);
-
-        carddb_status_t st = flash_write_log(addr, &rec);
+// Write a checkpoint of the RAM whitelist at addr; *out_next gets the address after it.
+static carddb_status_t carddb_write_ckpt(uint32_t addr, uint32_t *out_next)
+{
+    card_ckpt_info_t info;
+    card_log_t       rec;
+    carddb_status_t  st;
+    uint16_t         seq = ++g_last_seq;
+
+    info.count     = (uint16_t)g_card_count;
+    info.n_long    = (uint16_t)g_long_count;
+    info.blob_recs = (uint16_t)ckpt_blob_recs(info.count, info.n_long);
+    info.blob_crc  = 0xFFFF;
+
+    // 1) Header
+    memset(&rec, 0xFF, sizeof(rec));
+    rec.magic = CARD_FLASH_MAGIC;
+    rec.op    = CARD_LOG_OP_CKPT;
+    ckpt_info_pack(&rec, &info);
+    rec.seq    = seq;
+    rec.crc    = card_log_crc(&rec);
+
+    *out_next = addr + (2U + info.blob_recs) * CARD_LOG_SIZE;
+
+    st = flash_write_log(addr, &rec);
+    if (st != CARDDB_OK) {
+        return st;
+    }
+    addr += CARD_LOG_SIZE;
+
+    // 2) Key blob in slot order (short keys first), 60 bytes per Flash write.
+    card_blob_writer_t w;
+    uint32_t           blob = addr;
+
+    blob_begin(&w, addr);
+    for (int i = card_next_used(0); i >= 0; i = card_next_used(i + 1)) {
+        st = blob_put(&w, slot_key(i), slot_key_len(i));
         if (st != CARDDB_OK) {
-            int len3 = snprintf(dbg, sizeof(dbg),
-                                "GC WRITE FAIL at addr=0x%08lX st=%d\r\n",
-                                (unsigned long)addr, (int)st);
-            HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len3, HAL_MAX_DELAY);
             return st;
         }
-
-        addr += CARD_LOG_SIZE;
     }
-
-    // 4) After the new block is fully written, erase the old block to free space.
-    est = flash_erase_block(old_block);
-    if (est != CARDDB_OK) {
-        int len2 = snprintf(dbg, sizeof(dbg),
-                            "GC: flash_erase_block(old) FAIL, st=%d\r\n", (int)est);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len2, HAL_MAX_DELAY);
-        // At this point, data already lives in new_block, so even if erasing old_block fails, data is still safe.
-        // We still return an error, but we keep the state switched to new_block.
+    st = blob_flush(&w);
+    if (st != CARDDB_OK) {
+        return st;
     }
+    addr = w.addr;
+
+    // 3) END record commits the checkpoint (CRC of the blob as it is in Flash).
+    info.blob_crc = card_crc(g_log_fmt, carddb_port_flash_ptr(blob),
+                             ckpt_blob_bytes(info.count, info.n_long));
+    memset(&rec, 0xFF, sizeof(rec));
+    rec.magic = CARD_FLASH_MAGIC;
+    rec.op    = CARD_LOG_OP_CKPT_END;
+    ckpt_info_pack(&rec, &info);
+    rec.seq   = seq;
+    rec.crc   = card_log_crc(&rec);
 
-    // 5) Update global state: new active block, valid seq, and g_next_addr.
-    g_active_block = new_block;
-    g_last_seq     = new_seq;
-    g_next_addr    = addr;
+    st = flash_write_log(addr, &rec);
+    if (st != CARDDB_OK) {
+        return st;
+    }
 
-    int len4 = snprintf(dbg, sizeof(dbg),
-                        "GC: DONE, active_block=%d last_seq=%u, next_addr=0x%08lX\r\n",
-                        g_active_block,
-                        (unsigned)g_last_seq,
-                        (unsigned long)g_next_addr);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len4, HAL_MAX_DELAY);
+    CARDDB_LOG("CKPT: block=%d cards=%u seq=%u next_addr=0x%08lX\r\n",
+               g_active_block, (unsigned)info.count, (unsigned)seq,
+               (unsigned long)*out_next);
 
     return CARDDB_OK;
 }
 
-static carddb_status_t carddb_append_log(uint8_t op,
-                                         const uint8_t uid[CARD_UID_SIZE])
+// Write a checkpoint once the tail since the last one is at least as long as
+// the checkpoint itself, so replay work stays bounded by the whitelist size
+// while checkpoints cost at most half of the log space.
+static void carddb_maybe_checkpoint(void)
 {
-    uint32_t end_addr = CUR_BASE_ADDR + CUR_BLOCK_SIZE;
+    uint32_t size = ckpt_size((uint32_t)g_card_count, (uint32_t)g_long_count);
 
-    // ==== If there is not enough space, run GC first (which may switch to another block). ====
-    if (g_next_addr == 0) {
-        // Safety: if g_next_addr is not initialized yet, set it to the start of the current active block.
-        g_next_addr = CUR_BASE_ADDR;
+    if (g_gc_state != GC_IDLE ||           // The GC copies the tail as-is
+        g_ops_since_ckpt < CARD_DB_CKPT_MIN_OPS ||
+        g_ops_since_ckpt * CARD_LOG_SIZE < size ||
+        g_next_addr + size > CUR_BLOCK.base_addr + CUR_BLOCK_SIZE) {
+        return; // Not worth it yet, or no room (the next GC writes one anyway).
     }
 
-    if (g_next_addr + CARD_LOG_SIZE > end_addr) {
-        char dbg[64];
-        int len = snprintf(dbg, sizeof(dbg),
-                           "APPEND_LOG: no space in block=%d, try GC\r\n",
-                           g_active_block);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
+    uint32_t next;
+    carddb_status_t st = carddb_write_ckpt(g_next_addr, &next);
 
-        carddb_status_t gcst = carddb_gc();
-        if (gcst != CARDDB_OK) {
-            int len2 = snprintf(dbg, sizeof(dbg),
-                                "APPEND_LOG: GC FAIL, st=%d\r\n", (int)gcst);
-            HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len2, HAL_MAX_DELAY);
-            return gcst;
-        }
+    // Even a failed checkpoint has used up its space.
+    g_next_addr      = next;
+    g_ops_since_ckpt = 0;
+
+    if (st != CARDDB_OK) {
+        CARDDB_LOG("CKPT: write FAIL, replay falls back to the previous one\r\n");
+    }
+}
+
+// Load the checkpoint whose END record is at end_rec_addr into RAM.
+// Returns 1 if the header matches and the UID blob CRC is good.
+static int ckpt_load(uint32_t base_addr, uint32_t end_rec_addr, const card_log_t *end_rec)
+{
+    card_ckpt_info_t info, hinfo;
+    ckpt_info_unpack(end_rec, &info);
+
+    uint32_t extent = (1U + info.blob_recs) * CARD_LOG_SIZE;
+    if (end_rec_addr < base_addr + extent) {
+        return 0;
+    }
+
+    uint32_t hdr_addr = end_rec_addr - extent;
+    card_log_t hdr;
+    uint8_t    op;
+    flash_read_log(hdr_addr, &hdr);
+
+    if (blob_header_extent(hdr_addr, end_rec_addr + CARD_LOG_SIZE, &op, &hinfo) != extent ||
+        op != CARD_LOG_OP_CKPT || hinfo.count != info.count || hdr.seq != end_rec->seq) {
+        return 0;
+    }
+
+    const uint8_t *blob = carddb_port_flash_ptr(hdr_addr + CARD_LOG_SIZE);
+    if (card_crc(g_log_fmt, blob, ckpt_blob_bytes(info.count, hinfo.n_long)) != info.blob_crc) {
+        return 0;
+    }
+
+    uint32_t n_short = (uint32_t)info.count - hinfo.n_long;
+
+    carddb_ram_reset();
+    for (uint32_t i = 0; i < info.count; i++) {
+        uint8_t len = (i < n_short) ? CARD_UID_SIZE : CARD_KEY_LONG;
+        carddb_ram_load(blob, len);
+        blob += len;
+    }
+    return 1;
+}
+
+// Apply n packed transaction entries to the RAM whitelist.
+static void txn_apply(const uint8_t *e, uint32_t n)
+{
+    for (uint32_t i = 0; i < n; i++) {
+        uint8_t    len = (e[0] & CARD_LOG_OP_LONG) ? CARD_KEY_LONG : CARD_UID_SIZE;
+        card_key_t k;
+
+        key_load(&k, &e[1], len);
+        if ((e[0] & ~CARD_LOG_OP_LONG) == CARD_LOG_OP_ADD) {
+            carddb_ram_add(&k);
+        } else if ((e[0] & ~CARD_LOG_OP_LONG) == CARD_LOG_OP_DEL) {
+            carddb_ram_del(&k);
+        }
+        e += 1U + len;
+    }
+}
+
+// The transaction whose header at hdr_addr spans `extent` bytes counts only if
+// a matching TXN_END (same seq and count, blob CRC good) follows it before head.
+// Returns 1 and applies its entries to RAM if so.
+static int txn_replay(uint32_t hdr_addr, uint32_t extent, uint32_t head)
+{
+    card_log_t       hdr, end;
+    card_ckpt_info_t hinfo, info;
+
+    if (hdr_addr + extent + CARD_LOG_SIZE > head) {
+        return 0;
+    }
+    flash_read_log(hdr_addr, &hdr);
+    flash_read_log(hdr_addr + extent, &end);
+    ckpt_info_unpack(&hdr, &hinfo);
+    ckpt_info_unpack(&end, &info);
+
+    if (end.op != CARD_LOG_OP_TXN_END || !log_rec_valid(&end) ||
+        end.seq != hdr.seq || info.count != hinfo.count) {
+        return 0;
+    }
+
+    const uint8_t *blob = carddb_port_flash_ptr(hdr_addr + CARD_LOG_SIZE);
+    if (card_crc(g_log_fmt, blob, txn_blob_bytes(info.count, hinfo.n_long)) != info.blob_crc) {
+        return 0;
+    }
+
+    txn_apply(blob, info.count);
+    return 1;
+}
+
+// The long ADD / DEL whose header is at hdr_addr: apply it if its key record is good.
+static int long_rec_replay(uint32_t hdr_addr, uint8_t op, const card_ckpt_info_t *info)
+{
+    const uint8_t *p = carddb_port_flash_ptr(hdr_addr + CARD_LOG_SIZE);
+    card_key_t     k;
+
+    if (card_crc(g_log_fmt, p, CARD_KEY_LONG) != info->blob_crc) {
+        return 0;
+    }
+
+    key_load(&k, p, CARD_KEY_LONG);
+    if (op == (CARD_LOG_OP_ADD | CARD_LOG_OP_LONG)) {
+        carddb_ram_add(&k);
+    } else {
+        carddb_ram_del(&k);
+    }
+    return 1;
+}
+
+// --------- Log head (first erased record) ---------------------------------
+
+// Walk forward from addr, stepping over checkpoint / transaction blobs.
+static uint32_t find_head_linear(uint32_t addr, uint32_t end_addr)
+{
+    card_ckpt_info_t info;
+    uint8_t          op;
+
+    while (addr + CARD_LOG_SIZE <= end_addr &&
+           !flash_region_is_erased(addr, CARD_LOG_SIZE)) {
+        uint32_t extent = blob_header_extent(addr, end_addr, &op, &info);
+        addr += extent ? extent : CARD_LOG_SIZE;
+    }
+    return addr;
+}
+
+#if CARD_DB_FAST_MOUNT
+// The log is append-only and erased Flash is all 0xFF, so "record is erased"
+// is monotonic over record boundaries: binary search for the first erased one.
+// The only exception is the unwritten part of a torn checkpoint blob; replay
+// notices that when the tail walk meets its header, and falls back to a linear scan.
+static uint32_t find_head_bsearch(uint32_t base, uint32_t end_addr)
+{
+    uint32_t lo = 0;
+    uint32_t hi = (end_addr - base) / CARD_LOG_SIZE;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (flash_region_is_erased(base + mid * CARD_LOG_SIZE, CARD_LOG_SIZE)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return base + lo * CARD_LOG_SIZE;
+}
+#endif
+
+// --------- Block headers -------------------------------------------------
+
+// Turn a FREE block into the live log: first a checkpoint of the RAM whitelist
+// right after HDR / OPEN, then the OPEN record with the new generation.
+// A power cut before OPEN leaves the block without it, and it is ignored.
+static carddb_status_t block_activate(int block_idx, uint32_t gen, uint32_t *out_next)
+{
+    card_block_t   *b = &g_blocks[block_idx];
+    card_log_t      rec;
+    carddb_status_t st;
+
+    b->state  = BLOCK_DIRTY;    // Until OPEN is down
+    g_log_fmt = b->fmt;         // The checkpoint is the first record of the new log
+
+    st = carddb_write_ckpt(b->base_addr + CARD_BLOCK_HDR_SIZE, out_next);
+    if (st != CARDDB_OK) {
+        return st;
+    }
+
+    block_rec_fill(&rec, CARD_LOG_OP_OPEN, gen, 0xFF);
+    st = flash_write_log(b->base_addr + CARD_LOG_SIZE, &rec);
+    if (st != CARDDB_OK) {
+        return st;
+    }
+
+    b->gen   = gen;
+    b->state = BLOCK_ACTIVE;
+    return CARDDB_OK;
+}
+
+// Least-worn block other than `skip` (-1: any); ties go round-robin after skip.
+static int block_least_worn(int skip)
+{
+    int best = -1;
+
+    for (int k = 1; k <= CARD_BLOCK_COUNT; k++) {
+        int i = (skip + k + CARD_BLOCK_COUNT) % CARD_BLOCK_COUNT;
+        if (i == skip) {
+            continue;
+        }
+        if (best < 0 || g_blocks[i].erase_count < g_blocks[best].erase_count) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+// Read the HDR / OPEN records of every block in CARD_DB_SECTORS.
+// Returns the block holding the live log (highest OPEN generation), or -1.
+// *legacy is set when that block predates the headers (log starts at its base).
+static int blocks_scan(int *legacy)
+{
+    uint32_t max_erase = 0;
+    int      active    = -1;
+    uint8_t  blank[sizeof(g_sector_list)];
+
+    *legacy = 0;
+
+    for (int i = 0; i < CARD_BLOCK_COUNT; i++) {
+        card_block_t *b = &g_blocks[i];
+        card_log_t    hdr, open;
+
+        b->sector      = g_sector_list[i];
+        b->base_addr   = carddb_port_sector_addr(b->sector);
+        b->size        = carddb_port_sector_size(b->sector);
+        b->erase_count = 0;
+        b->gen         = 0;
+        b->state       = BLOCK_DIRTY;
+        b->fmt         = CARD_FMT_NEW;
+        blank[i]       = 0;
+
+        flash_read_log(b->base_addr, &hdr);
+        flash_read_log(b->base_addr + CARD_LOG_SIZE, &open);
+
+        if (flash_region_is_erased(b->base_addr, CARD_BLOCK_HDR_SIZE + CARD_LOG_SIZE)) {
+            blank[i] = 1;       // Never used (or erased by the old two-sector code)
+            continue;
+        }
+
+        if (hdr.op == CARD_LOG_OP_HDR && block_rec_valid(&hdr)) {
+            b->erase_count = block_rec_value(&hdr);
+            b->fmt         = (hdr.uid[4] == 0xFF) ? CARD_FMT_CRC16 : hdr.uid[4];
+            if (b->erase_count > max_erase) {
+                max_erase = b->erase_count;
+            }
+
+            uint8_t crc_kind = b->fmt & CARD_FMT_CRC_MASK;
+            if ((crc_kind != CARD_FMT_CRC16 && crc_kind != CARD_FMT_CRC32) ||
+                (b->fmt & ~(CARD_FMT_CRC_MASK | CARD_FMT_UID_V2)) != 0) {
+                // Written by a newer firmware: cannot be read, reused after an erase.
+            } else if (open.op == CARD_LOG_OP_OPEN && block_rec_valid(&open)) {
+                b->gen   = block_rec_value(&open);
+                b->state = BLOCK_ACTIVE;
+            } else if (flash_region_is_erased(b->base_addr + CARD_LOG_SIZE,
+                                              CARD_BLOCK_HDR_SIZE)) {
+                b->state = BLOCK_FREE;
+            }
+        } else if (block_rec_valid(&hdr) && hdr.op != CARD_LOG_OP_OPEN) {
+            // Log written before block headers existed: its records start at base, CRC16.
+            b->state = BLOCK_ACTIVE;
+            b->fmt   = CARD_FMT_CRC16;
+        }
+
+        if (b->state == BLOCK_ACTIVE &&
+            (active < 0 || b->gen > g_blocks[active].gen)) {
+            active = i;
+        }
+    }
+
+    // Only one live log; any other OPEN block is the old side of an unfinished GC.
+    for (int i = 0; i < CARD_BLOCK_COUNT; i++) {
+        if (g_blocks[i].state == BLOCK_ACTIVE && i != active) {
+            g_blocks[i].state = BLOCK_DIRTY;
+        }
+    }
+    if (active >= 0) {
+        *legacy = (g_blocks[active].gen == 0);
+    }
+
+    // A blank block's count is unknown: assume it has worn as much as the worst one.
+    for (int i = 0; i < CARD_BLOCK_COUNT; i++) {
+        if (blank[i]) {
+            g_blocks[i].erase_count = max_erase;
+            if (block_write_hdr(i) == CARDDB_OK) {
+                g_blocks[i].state = BLOCK_FREE;
+            }
+        }
+    }
+
+    return active;
+}
+
+// --------- Replay Flash log at boot (supports multiple blocks) ----------------
+// 0) Read the block headers and pick the block with the newest OPEN record.
+// 1) Find the log head (first erased record): binary search, or a linear walk
+//    stepping over checkpoint blobs when CARD_DB_FAST_MOUNT is 0.
+// 2) Walk back from the head to the newest complete checkpoint and load it.
+// 3) Apply only the ADD/DEL records after it.
+static void carddb_replay_from_flash(void)
+{
+    carddb_ram_reset();
+    g_last_seq       = 0;
+    g_next_addr      = 0;
+    g_active_block   = 0;
+    g_ops_since_ckpt = 0;
+
+    CARDDB_LOG("carddb_replay_from_flash BEGIN\r\n");
+
+    int legacy;
+    int found_block = blocks_scan(&legacy);
+
+    if (found_block < 0) {
+        // No log anywhere: open the least-worn block with an empty checkpoint.
+        int fresh = block_least_worn(-1);
+        if (g_blocks[fresh].state != BLOCK_FREE) {
+            flash_erase_block(fresh);
+        }
+
+        g_active_block = fresh;
+        g_data_start   = CUR_BLOCK.base_addr + CARD_BLOCK_HDR_SIZE;
+        if (block_activate(fresh, 1, &g_next_addr) != CARDDB_OK) {
+            CARDDB_LOG("REPLAY: cannot open block %d\r\n", fresh);
+        }
+
+        CARDDB_LOG("REPLAY: no valid block, start fresh on block %d\r\n", fresh);
+        return;
+    }
+
+    g_active_block = found_block;
+    g_data_start   = CUR_BLOCK.base_addr + (legacy ? 0U : CARD_BLOCK_HDR_SIZE);
+    g_log_fmt      = CUR_BLOCK.fmt;
+
+    uint32_t base     = g_data_start;
+    uint32_t end_addr = CUR_BLOCK.base_addr + CUR_BLOCK_SIZE;
+    card_ckpt_info_t info;
+
+    // 1) Log head
+#if CARD_DB_FAST_MOUNT
+    uint32_t head = find_head_bsearch(base, end_addr);
+#else
+    uint32_t head = find_head_linear(base, end_addr);
+#endif
+
+    // 2) Newest complete checkpoint
+    uint32_t start    = base;
+    uint16_t max_seq  = 0;
+    int      ckpt_cnt = -1;
+
+    for (uint32_t a = head; a >= base + CARD_LOG_SIZE; a -= CARD_LOG_SIZE) {
+        card_log_t rec;
+        flash_read_log(a - CARD_LOG_SIZE, &rec);
+
+        if (rec.op == CARD_LOG_OP_CKPT_END && log_rec_valid(&rec) &&
+            ckpt_load(base, a - CARD_LOG_SIZE, &rec)) {
+            start    = a;
+            max_seq  = rec.seq;
+            ckpt_cnt = g_card_count;
+            break;
+        }
+    }
+
+    if (ckpt_cnt >= 0) {
+        CARDDB_LOG("REPLAY: checkpoint cards=%d seq=%u, tail from 0x%08lX\r\n",
+                   ckpt_cnt, (unsigned)max_seq, (unsigned long)start);
+    }
+
+    // 3) Tail
+    uint32_t addr = start;
+    while (addr < head) {
+        uint8_t  op;
+        uint32_t extent = blob_header_extent(addr, end_addr, &op, &info);
+        if (extent) {
+            if (addr + extent > head) {
+                // The "head" was the unwritten part of this blob; there may be records after it.
+                head = find_head_linear(addr, end_addr);
+                CARDDB_LOG("REPLAY: torn blob at 0x%08lX, head=0x%08lX\r\n",
+                           (unsigned long)addr, (unsigned long)head);
+            }
+
+            // A committed transaction is applied as a whole, an uncommitted one not at all.
+            // (Any checkpoint here never got its END record: skip the blob.)
+            if (op == CARD_LOG_OP_TXN && txn_replay(addr, extent, head)) {
+                card_log_t hdr;
+                flash_read_log(addr, &hdr);
+                if (hdr.seq > max_seq) {
+                    max_seq = hdr.seq;
+                }
+                g_ops_since_ckpt += info.count;
+                addr += extent + CARD_LOG_SIZE;
+            } else if ((op & CARD_LOG_OP_LONG) && long_rec_replay(addr, op, &info)) {
+                card_log_t hdr;
+                flash_read_log(addr, &hdr);
+                if (hdr.seq > max_seq) {
+                    max_seq = hdr.seq;
+                }
+                g_ops_since_ckpt++;
+                addr += extent;
+            } else {
+                addr += extent;
+            }
+            continue;
+        }
+
+        card_log_t rec;
+        flash_read_log(addr, &rec);
+
+#if CARD_DB_REPLAY_VERBOSE
+        CARDDB_LOG("REPLAY: block=%d addr=0x%08lX magic=0x%02X op=%u "
+                   "uid=%02X %02X %02X %02X %02X seq=%u crc=0x%04X\r\n",
+                   g_active_block,
+                   (unsigned long)addr,
+                   rec.magic,
+                   (unsigned)rec.op,
+                   rec.uid[0], rec.uid[1], rec.uid[2], rec.uid[3], rec.uid[4],
+                   (unsigned)rec.seq,
+                   rec.crc);
+#endif
+
+        addr += CARD_LOG_SIZE;
+
+        // Torn / corrupted record: skip it, the log continues after it.
+        if (!log_rec_valid(&rec)) {
+            CARDDB_LOG("REPLAY: bad record at 0x%08lX, skip\r\n",
+                       (unsigned long)(addr - CARD_LOG_SIZE));
+            continue;
+        }
+
+        // Update max seq
+        if (rec.seq > max_seq) {
+            max_seq = rec.seq;
+        }
+
+        // Apply operation to RAM whitelist
+        card_key_t k;
+        key_load(&k, rec.uid, CARD_UID_SIZE);
+        if (rec.op == CARD_LOG_OP_ADD) {
+            carddb_ram_add(&k);
+            g_ops_since_ckpt++;
+        } else if (rec.op == CARD_LOG_OP_DEL) {
+            carddb_ram_del(&k);
+            g_ops_since_ckpt++;
+        }
+    }
+
+    g_last_seq  = max_seq;
+    g_next_addr = head;
+
+    CARDDB_LOG("REPLAY DONE: active_block=%d last_seq=%u, next_addr=0x%08lX tail_ops=%lu\r\n",
+               g_active_block,
+               (unsigned)g_last_seq,
+               (unsigned long)g_next_addr,
+               (unsigned long)g_ops_since_ckpt);
+}
+
+// --------- Public API implementations -----------------------------------------
+static void carddb_dump_flash(void);   
+
+void carddb_init(void)
+{
+    carddb_port_init();
+    crc16_table_init();
+    g_gc_state = GC_IDLE;
+    carddb_replay_from_flash();
+
+    CARDDB_LOG("carddb_init: RAM cards=%d, active_block=%d last_seq=%u, next_addr=0x%08lX\r\n",
+               g_card_count,
+               g_active_block,
+               (unsigned)g_last_seq,
+               (unsigned long)g_next_addr);
+
+    carddb_dump_flash();
+}
+
+
+// Check whether a UID is in the whitelist.
+int carddb_check(const card_uid_t *uid)
+{
+    card_key_t k;
+    if (!key_from_uid(&k, uid)) {
+        return 0;
+    }
+
+    carddb_port_lock();
+    int found = (carddb_find_in_ram(&k) >= 0) ? 1 : 0;
+    carddb_port_unlock();
+    return found;
+}
+
+// Get all whitelist entries (useful for debug / displaying).
+int carddb_get_all(card_entry_t *out_array, int max_items)
+{
+    if (out_array == NULL || max_items <= 0) {
+        return g_card_count;
+    }
+
+    carddb_port_lock();
+    int count = 0;
+    for (int i = card_next_used(0); i >= 0 && count < max_items; i = card_next_used(i + 1)) {
+        slot_to_uid(i, &out_array[count].uid);
+        out_array[count].in_use = 1;
+        count++;
+    }
+    int total = g_card_count;
+    carddb_port_unlock();
+
+    return (count < max_items) ? count : total; // Real whitelist count (may be > max_items)
+}
+
+uint32_t carddb_export(uint32_t *cursor, uint8_t *out, uint32_t max)
+{
+    uint32_t n = 0;
+
+    if (*cursor >= CARD_DB_MAX_CARDS) {
+        return 0;
+    }
+
+    // Short slots only: a long key does not fit the CARD_UID_SIZE export format.
+    carddb_port_lock();
+    for (int i = card_next_used((int)*cursor);
+         i >= 0 && i < CARD_DB_MAX_CARDS && n < max; i = card_next_used(i + 1)) {
+        memcpy(out + n * CARD_UID_SIZE, g_card_uids[i], CARD_UID_SIZE);
+        n++;
+        *cursor = (uint32_t)i + 1U;
+    }
+    carddb_port_unlock();
+
+    return n;
+}
+
+uint32_t carddb_export_uids(uint32_t *cursor, uint8_t *out, uint32_t max_bytes)
+{
+    uint32_t   n    = 0;
+    uint32_t   used = 0;
+    card_uid_t uid;
+
+    if (*cursor >= CARD_SLOTS) {
+        return 0;
+    }
+
+    carddb_port_lock();
+    for (int i = card_next_used((int)*cursor); i >= 0; i = card_next_used(i + 1)) {
+        slot_to_uid(i, &uid);
+        if (used + 1U + uid.len > max_bytes) {
+            break;
+        }
+        out[used] = uid.len;
+        memcpy(out + used + 1, uid.uid, uid.len);
+        used += 1U + uid.len;
+        n++;
+        *cursor = (uint32_t)i + 1U;
+    }
+    carddb_port_unlock();
+
+    return n;
+}
+
+void carddb_get_stats(carddb_stats_t *out)
+{
+    carddb_port_lock();
+    out->cards        = (uint32_t)g_card_count;
+    out->max_cards    = CARD_DB_MAX_CARDS;
+    out->long_cards   = (uint32_t)g_long_count;
+    out->log_used     = g_next_addr ? g_next_addr - CUR_BLOCK.base_addr : 0;
+    out->log_size     = CUR_BLOCK_SIZE;
+    out->last_seq     = g_last_seq;
+    out->active_block = (uint8_t)g_active_block;
+    out->blocks       = (uint8_t)CARD_BLOCK_COUNT;
+    out->erase_min    = g_blocks[0].erase_count;
+    out->erase_max    = g_blocks[0].erase_count;
+    for (int i = 1; i < CARD_BLOCK_COUNT; i++) {
+        if (g_blocks[i].erase_count < out->erase_min) {
+            out->erase_min = g_blocks[i].erase_count;
+        }
+        if (g_blocks[i].erase_count > out->erase_max) {
+            out->erase_max = g_blocks[i].erase_count;
+        }
+    }
+    carddb_port_unlock();
+}
+
+// --------- Garbage collection (GC): move data and do simple wear leveling ----
+// GC copies the whitelist into another block as one checkpoint, a few dozen
+// UIDs per step, so it can run from a low-priority task (carddb_gc_step)
+// between taps instead of inside carddb_add:
+//
+//   begin   pick a FREE block, write the checkpoint header, snapshot the card
+//           bitmap into g_gc_pending (those slots are not reused until copied)
+//   copy    CARD_DB_GC_STEP_UIDS snapshot UIDs per step into the blob
+//   finish  END record, then the records appended to the old log since begin
+//           (copied as-is), then OPEN: from here on the new block is the log
+//   erase   blocks left DIRTY are erased later, ahead of the next GC
+//
+// Adds / removes keep going to the old log while the copy runs, so the
+// checkpoint is the whitelist as it was at begin and the copied tail brings
+// the new block up to date.  A power cut before OPEN leaves the old log live.
+// Only when the old log fills up before the background is done does
+// carddb_reserve run the remaining steps itself (and erase, if no block is FREE).
+
+// Select the next block to write: the least-worn FREE one, by the persisted
+// erase counts, or the least-worn of all when none is erased yet.
+static int select_next_block_for_gc(void)
+{
+    int best = -1;
+
+    for (int k = 1; k < CARD_BLOCK_COUNT; k++) {
+        int i = (g_active_block + k) % CARD_BLOCK_COUNT;
+        if (g_blocks[i].state == BLOCK_FREE &&
+            (best < 0 || g_blocks[i].erase_count < g_blocks[best].erase_count)) {
+            best = i;
+        }
+    }
+    return (best >= 0) ? best : block_least_worn(g_active_block);
+}
+
+static void gc_abort(void)
+{
+    g_blocks[g_gc_block].state = BLOCK_DIRTY;
+    memset(g_gc_pending, 0, sizeof(g_gc_pending));
+    g_free_hint = 0;
+    g_gc_state  = GC_IDLE;
+}
+
+// Start a GC into the next block; may_erase = 0 gives up if it is not FREE.
+static carddb_status_t gc_begin(int may_erase)
+{
+    card_ckpt_info_t info;
+    card_log_t       rec;
+    carddb_status_t  st;
+    int              target = select_next_block_for_gc();
+
+    // Room for the checkpoint plus the tail written meanwhile (at most the rest of the old log).
+    uint32_t needed = CARD_BLOCK_HDR_SIZE +
+                      ckpt_size((uint32_t)g_card_count, (uint32_t)g_long_count) +
+                      (CUR_BLOCK.base_addr + CUR_BLOCK_SIZE - g_next_addr);
+    if (needed > g_blocks[target].size) {
+        CARDDB_LOG("GC: needed=%lu > block_size=%lu, FULL\r\n",
+                   (unsigned long)needed,
+                   (unsigned long)g_blocks[target].size);
+        return CARDDB_ERR_FULL;
+    }
+
+    if (g_blocks[target].state != BLOCK_FREE) {
+        if (!may_erase) {
+            return CARDDB_ERR_FULL;
+        }
+        st = flash_erase_block(target);
+        if (st != CARDDB_OK) {
+            CARDDB_LOG("GC: flash_erase_block(new) FAIL, st=%d\r\n", (int)st);
+            return st;
+        }
+    }
+
+    // After GC, sequence numbers are re-numbered starting from 1.
+    g_last_seq  = 0;
+    g_gc_seq    = ++g_last_seq;
+    g_gc_block  = target;
+    g_gc_count  = (uint16_t)g_card_count;
+    g_gc_long   = (uint16_t)g_long_count;
+    g_gc_hdr    = g_blocks[target].base_addr + CARD_BLOCK_HDR_SIZE;
+    g_gc_tail   = g_next_addr;
+    g_gc_cursor = 0;
+    blob_begin(&g_gc_blob, g_gc_hdr + CARD_LOG_SIZE);
+
+    info.count     = g_gc_count;
+    info.n_long    = g_gc_long;
+    info.blob_recs = (uint16_t)ckpt_blob_recs(g_gc_count, g_gc_long);
+    info.blob_crc  = 0xFFFF;
+
+    memset(&rec, 0xFF, sizeof(rec));
+    rec.magic = CARD_FLASH_MAGIC;
+    rec.op    = CARD_LOG_OP_CKPT;
+    ckpt_info_pack(&rec, &info);
+    rec.seq    = g_gc_seq;
+    rec.crc    = card_log_crc_fmt(&rec, g_blocks[target].fmt);
+
+    g_blocks[target].state = BLOCK_DIRTY;   // Until OPEN is down
+    st = flash_write_log(g_gc_hdr, &rec);
+    if (st != CARDDB_OK) {
+        return st;
+    }
+
+    memcpy(g_gc_pending, g_card_used, sizeof(g_gc_pending));
+    g_gc_state = GC_COPY;
+
+    CARDDB_LOG("GC: START block=%d -> %d cards=%u\r\n",
+               g_active_block, target, (unsigned)g_gc_count);
+    return CARDDB_OK;
+}
+
+// Copy up to max_uids snapshot keys into the blob (Flash writes are whole
+// 60-byte chunks, the rest waits in g_gc_blob for the next step).
+// Returns 1 once the whole snapshot is in the blob.
+static int gc_copy_step(uint32_t max_uids, carddb_status_t *st)
+{
+    uint32_t copied = 0;
+    int      i;
+
+    *st = CARDDB_OK;
+    while ((i = bitmap_next(g_gc_pending, g_gc_cursor)) >= 0) {
+        if (copied >= max_uids) {
+            return 0;
+        }
+        *st = blob_put(&g_gc_blob, slot_key(i), slot_key_len(i));
+        if (*st != CARDDB_OK) {
+            return 1;
+        }
+        g_gc_pending[i >> 5] &= ~(1U << (i & 31));
+        g_gc_cursor = i + 1;
+        copied++;
+    }
+
+    *st = blob_flush(&g_gc_blob);
+    return 1;
+}
+
+// END record, the old-log tail, then OPEN; switch to the new block.
+static carddb_status_t gc_finish(void)
+{
+    card_ckpt_info_t info;
+    card_log_t       rec;
+    carddb_status_t  st;
+    int              old_block = g_active_block;
+    uint8_t          fmt       = g_blocks[g_gc_block].fmt;
+    uint32_t         tail_len  = g_next_addr - g_gc_tail;
+    uint32_t         end_addr  = g_blocks[g_gc_block].base_addr + g_blocks[g_gc_block].size;
+
+    if (g_gc_blob.addr + CARD_LOG_SIZE + tail_len > end_addr) {
+        return CARDDB_ERR_FULL;
+    }
+
+    info.count     = g_gc_count;
+    info.n_long    = g_gc_long;
+    info.blob_recs = (uint16_t)ckpt_blob_recs(g_gc_count, g_gc_long);
+    info.blob_crc  = card_crc(fmt, carddb_port_flash_ptr(g_gc_hdr + CARD_LOG_SIZE),
+                              ckpt_blob_bytes(g_gc_count, g_gc_long));
+
+    memset(&rec, 0xFF, sizeof(rec));
+    rec.magic = CARD_FLASH_MAGIC;
+    rec.op    = CARD_LOG_OP_CKPT_END;
+    ckpt_info_pack(&rec, &info);
+    rec.seq   = g_gc_seq;
+    rec.crc   = card_log_crc_fmt(&rec, fmt);
+
+    st = flash_write_log(g_gc_blob.addr, &rec);
+    if (st != CARDDB_OK) {
+        return st;
+    }
+    g_gc_blob.addr += CARD_LOG_SIZE;
+
+    if (tail_len > 0) {
+        st = flash_write_bytes(g_gc_blob.addr, carddb_port_flash_ptr(g_gc_tail), tail_len);
+        if (st != CARDDB_OK) {
+            return st;
+        }
+        g_gc_blob.addr += tail_len;
+    }
+
+    block_rec_fill(&rec, CARD_LOG_OP_OPEN, g_blocks[old_block].gen + 1U, 0xFF);
+    st = flash_write_log(g_blocks[g_gc_block].base_addr + CARD_LOG_SIZE, &rec);
+    if (st != CARDDB_OK) {
+        return st;
+    }
+
+    g_blocks[g_gc_block].gen   = g_blocks[old_block].gen + 1U;
+    g_blocks[g_gc_block].state = BLOCK_ACTIVE;
+    g_blocks[old_block].state  = BLOCK_DIRTY;   // Erased later, ahead of the next GC
+
+    g_active_block   = g_gc_block;
+    g_log_fmt        = fmt;
+    g_data_start     = g_gc_hdr;
+    g_next_addr      = g_gc_blob.addr;
+    g_ops_since_ckpt = tail_len / CARD_LOG_SIZE;
+    g_gc_state       = GC_IDLE;
+
+    CARDDB_LOG("GC: DONE, active_block=%d last_seq=%u, next_addr=0x%08lX tail=%lu\r\n",
+               g_active_block,
+               (unsigned)g_last_seq,
+               (unsigned long)g_next_addr,
+               (unsigned long)tail_len);
+    return CARDDB_OK;
+}
+
+// Run GC to completion (begin if needed, every remaining copy step, finish).
+static carddb_status_t carddb_gc(void)
+{
+    carddb_status_t st = CARDDB_OK;
+
+    if (g_gc_state == GC_IDLE) {
+        st = gc_begin(1);
+        if (st != CARDDB_OK) {
+            return st;
+        }
+    }
+
+    while (!gc_copy_step(CARD_DB_MAX_CARDS, &st)) {
+    }
+    if (st == CARDDB_OK) {
+        st = gc_finish();
+    }
+    if (st != CARDDB_OK) {
+        CARDDB_LOG("GC WRITE FAIL at addr=0x%08lX st=%d\r\n",
+                   (unsigned long)g_gc_blob.addr, (int)st);
+        gc_abort();
+    }
+    return st;
+}
+
+// Active log is past CARD_DB_GC_START_PCT: time to start moving it.
+static int gc_due(void)
+{
+    return (uint64_t)(g_next_addr - CUR_BLOCK.base_addr) * 100U >=
+           (uint64_t)CUR_BLOCK_SIZE * CARD_DB_GC_START_PCT;
+}
+
+int carddb_gc_step(int allow_erase)
+{
+    carddb_status_t st   = CARDDB_OK;
+    int             more = 1;
+
+    carddb_port_lock();
+
+    if (g_gc_state == GC_COPY) {
+        if (gc_copy_step(CARD_DB_GC_STEP_UIDS, &st) && st == CARDDB_OK) {
+            st = gc_finish();
+        }
+        if (st != CARDDB_OK) {
+            CARDDB_LOG("GC step FAIL st=%d\r\n", (int)st);
+            gc_abort();
+        }
+    } else {
+        int dirty = -1;
+        for (int i = 0; i < CARD_BLOCK_COUNT; i++) {
+            if (i != g_active_block && g_blocks[i].state == BLOCK_DIRTY &&
+                (dirty < 0 || g_blocks[i].erase_count < g_blocks[dirty].erase_count)) {
+                dirty = i;
+            }
+        }
+
+        if (allow_erase && dirty >= 0) {
+            flash_erase_block(dirty);           // Pre-erase, ahead of need
+        } else if (!gc_due()) {
+            more = 0;
+        } else if (g_blocks[select_next_block_for_gc()].fmt != g_log_fmt) {
+            // Moving to a new record format: the tail cannot be copied as-is,
+            // so this one GC runs in a single step (no erase if the target is FREE).
+            if (g_blocks[select_next_block_for_gc()].state != BLOCK_FREE || carddb_gc() != CARDDB_OK) {
+                more = 0;
+            }
+        } else if (gc_begin(0) != CARDDB_OK) {
+            more = 0;
+        }
+    }
+
+    carddb_port_unlock();
+    return more;
+}
+
+// Make sure `len` bytes fit after g_next_addr, running GC if they do not.
+static carddb_status_t carddb_reserve(uint32_t len)
+{
+    uint32_t end_addr = CUR_BLOCK.base_addr + CUR_BLOCK_SIZE;
+
+    // ==== If there is not enough space, run GC first (which may switch to another block). ====
+    if (g_next_addr == 0) {
+        // Safety: if g_next_addr is not initialized yet, set it to the start of the current active block.
+        g_next_addr = g_data_start;
+    }
+
+    if (g_next_addr + len > end_addr) {
+        CARDDB_LOG("APPEND_LOG: no space in block=%d, try GC\r\n",
+                   g_active_block);
+
+        carddb_status_t gcst = carddb_gc();
+        if (gcst != CARDDB_OK) {
+            CARDDB_LOG("APPEND_LOG: GC FAIL, st=%d\r\n", (int)gcst);
+            return gcst;
+        }
 
         // After GC, active_block and g_next_addr are updated; check free space again.
-        end_addr = CUR_BASE_ADDR + CUR_BLOCK_SIZE;
-        if (g_next_addr + CARD_LOG_SIZE > end_addr) {
-            HAL_UART_Transmit(&DBG_UART,
-                              (uint8_t*)"APPEND_LOG: still FULL after GC\r\n",
-                              strlen("APPEND_LOG: still FULL after GC\r\n"),
-                              HAL_MAX_DELAY);
+        end_addr = CUR_BLOCK.base_addr + CUR_BLOCK_SIZE;
+        if (g_next_addr + len > end_addr) {
+            CARDDB_LOG("APPEND_LOG: still FULL after GC\r\n");
             return CARDDB_ERR_FULL;
         }
     }
     // =========================================================================================
+    return CARDDB_OK;
+}
 
-    card_log_t rec;
-    memset(&rec, 0xFF, sizeof(rec)); // Keep unused bytes as 0xFF.
+// Long keys need a v2 block: a log still in an older format is moved to a
+// fresh block first (one GC, run to completion since the formats differ).
+static carddb_status_t carddb_need_long_keys(void)
+{
+    if (g_log_fmt & CARD_FMT_UID_V2) {
+        return CARDDB_OK;
+    }
 
-    rec.magic = CARD_FLASH_MAGIC;
-    rec.op    = op;
-    uid_copy(rec.uid, uid);
-    rec.seq   = ++g_last_seq;
-    rec.crc   = card_log_crc(&rec);
+    CARDDB_LOG("APPEND_LOG: block=%d has no long UIDs, GC to a new block\r\n",
+               g_active_block);
+    carddb_status_t st = carddb_gc();
+    if (st == CARDDB_OK && !(g_log_fmt & CARD_FMT_UID_V2)) {
+        st = CARDDB_ERR_FLASH;
+    }
+    return st;
+}
+
+// Build an ADD/DEL record with the next sequence number.
+static void log_rec_fill(card_log_t *rec, uint8_t op, const card_key_t *k)
+{
+    memset(rec, 0xFF, sizeof(*rec)); // Keep unused bytes as 0xFF.
+
+    rec->magic = CARD_FLASH_MAGIC;
+    rec->op    = op;
+    memcpy(rec->uid, k->b, CARD_UID_SIZE);
+    rec->seq   = ++g_last_seq;
+    rec->crc   = card_log_crc(rec);
+}
+
+// v2 ADD / DEL of a long key: header + one record with the key.
+static void log_rec_fill_long(card_log_t rec[2], uint8_t op, const card_key_t *k)
+{
+    card_ckpt_info_t info;
+    uint8_t         *key = (uint8_t *)&rec[1];
+
+    memset(rec, 0xFF, 2U * sizeof(*rec));
+    memcpy(key, k->b, CARD_KEY_LONG);
+
+    info.count     = 1;
+    info.n_long    = 1;
+    info.blob_recs = 1;
+    info.blob_crc  = card_crc(g_log_fmt, key, CARD_KEY_LONG);
+
+    rec[0].magic = CARD_FLASH_MAGIC;
+    rec[0].op    = op | CARD_LOG_OP_LONG;
+    ckpt_info_pack(&rec[0], &info);
+    rec[0].seq   = ++g_last_seq;
+    rec[0].crc   = card_log_crc(&rec[0]);
+}
+
+static carddb_status_t carddb_append_log(uint8_t op, const card_key_t *k)
+{
+    uint32_t        len = key_is_long(k) ? 2U * CARD_LOG_SIZE : CARD_LOG_SIZE;
+    carddb_status_t rst = key_is_long(k) ? carddb_need_long_keys() : CARDDB_OK;
+
+    if (rst == CARDDB_OK) {
+        rst = carddb_reserve(len);
+    }
+    if (rst != CARDDB_OK) {
+        return rst;
+    }
+
+    card_log_t rec[2];
+    if (key_is_long(k)) {
+        log_rec_fill_long(rec, op, k);
+    } else {
+        log_rec_fill(&rec[0], op, k);
+    }
 
     // Debug print before writing the record.
-    {
-        char dbg[128];
-        int len = snprintf(dbg, sizeof(dbg),
-                           "APPEND_LOG: block=%d addr=0x%08lX op=%u seq=%u "
-                           "uid=%02X %02X %02X %02X %02X crc=0x%04X\r\n",
-                           g_active_block,
-                           (unsigned long)g_next_addr,
-                           (unsigned)rec.op,
-                           (unsigned)rec.seq,
-                           rec.uid[0], rec.uid[1], rec.uid[2], rec.uid[3], rec.uid[4],
-                           rec.crc);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
-    }
-
-    carddb_status_t st = flash_write_log(g_next_addr, &rec);
+    CARDDB_LOG("APPEND_LOG: block=%d addr=0x%08lX op=%u seq=%u "
+               "uid=%02X %02X %02X %02X %02X crc=0x%04X\r\n",
+               g_active_block,
+               (unsigned long)g_next_addr,
+               (unsigned)rec[0].op,
+               (unsigned)rec[0].seq,
+               k->b[0], k->b[1], k->b[2], k->b[3], k->b[4],
+               rec[0].crc);
+
+    carddb_status_t st = flash_write_bytes(g_next_addr, rec, len);
     if (st == CARDDB_OK) {
-        g_next_addr += CARD_LOG_SIZE;
+        g_next_addr += len;
+        g_ops_since_ckpt++;
 
-        char dbg2[64];
-        int len2 = snprintf(dbg2, sizeof(dbg2),
-                            "APPEND_LOG OK, next_addr=0x%08lX\r\n",
-                            (unsigned long)g_next_addr);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg2, len2, HAL_MAX_DELAY);
+        CARDDB_LOG("APPEND_LOG OK, next_addr=0x%08lX\r\n",
+                   (unsigned long)g_next_addr);
     } else {
-        char dbg2[64];
-        int len2 = snprintf(dbg2, sizeof(dbg2),
-                            "APPEND_LOG FAIL, st=%d\r\n", (int)st);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg2, len2, HAL_MAX_DELAY);
+        CARDDB_LOG("APPEND_LOG FAIL, st=%d\r\n", (int)st);
+    }
+
+    if (st == CARDDB_OK) {
+        carddb_maybe_checkpoint();
     }
 
     return st;
@@ -609,14 +1912,10 @@ static carddb_status_t carddb_append_log(uint8_t op,
 
 static void carddb_dump_flash(void)
 {
-    char dbg[128];
-    uint32_t addr = CARD_FLASH_ADDR;
-    const uint32_t end_addr = CARD_FLASH_ADDR + 4 * CARD_LOG_SIZE; // Dump first 4 records for debug
+    uint32_t addr = CUR_BLOCK.base_addr;
+    const uint32_t end_addr = addr + 4 * CARD_LOG_SIZE; // Dump first 4 records of the active block for debug
 
-    HAL_UART_Transmit(&DBG_UART,
-                      (uint8_t*)"FLASH DUMP BEGIN\r\n",
-                      strlen("FLASH DUMP BEGIN\r\n"),
-                      HAL_MAX_DELAY);
+    CARDDB_LOG("FLASH DUMP BEGIN\r\n");
 
     while (addr + CARD_LOG_SIZE <= end_addr)
     {
@@ -625,54 +1924,391 @@ static void carddb_dump_flash(void)
 
         // If the entire record is 0xFF, treat it as empty.
         if (flash_region_is_erased(addr, CARD_LOG_SIZE)) {
-            int len = snprintf(dbg, sizeof(dbg),
-                               "0x%08lX: ERASED\r\n",
-                               (unsigned long)addr);
-            HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
+            CARDDB_LOG("0x%08lX: ERASED\r\n",
+                       (unsigned long)addr);
         } else {
             uint16_t crc_calc = card_log_crc(&rec);
-            int len = snprintf(dbg, sizeof(dbg),
-                               "0x%08lX: magic=0x%02X op=%u "
-                               "uid=%02X %02X %02X %02X %02X "
-                               "seq=%u crc=0x%04X calc=0x%04X\r\n",
-                               (unsigned long)addr,
-                               rec.magic,
-                               (unsigned)rec.op,
-                               rec.uid[0], rec.uid[1], rec.uid[2], rec.uid[3], rec.uid[4],
-                               (unsigned)rec.seq,
-                               rec.crc,
-                               crc_calc);
-            HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, len, HAL_MAX_DELAY);
+            CARDDB_LOG("0x%08lX: magic=0x%02X op=%u "
+                       "uid=%02X %02X %02X %02X %02X "
+                       "seq=%u crc=0x%04X calc=0x%04X\r\n",
+                       (unsigned long)addr,
+                       rec.magic,
+                       (unsigned)rec.op,
+                       rec.uid[0], rec.uid[1], rec.uid[2], rec.uid[3], rec.uid[4],
+                       (unsigned)rec.seq,
+                       rec.crc,
+                       crc_calc);
         }
 
         addr += CARD_LOG_SIZE;
     }
 
-    HAL_UART_Transmit(&DBG_UART,
-                      (uint8_t*)"FLASH DUMP END\r\n",
-                      strlen("FLASH DUMP END\r\n"),
-                      HAL_MAX_DELAY);
+    CARDDB_LOG("FLASH DUMP END\r\n");
 }
 
-carddb_status_t carddb_add(const uint8_t uid[CARD_UID_SIZE])
+carddb_status_t carddb_add(const card_uid_t *uid)
 {
-    // First update RAM whitelist.
-    carddb_ram_add(uid);
+    card_key_t      k;
+    carddb_status_t st;
+
+    if (!key_from_uid(&k, uid)) {
+        return CARDDB_ERR_UID;
+    }
 
-    // Then append an ADD log to Flash.
-    return carddb_append_log(CARD_LOG_OP_ADD, uid);
+    carddb_port_lock();
+
+    // First update RAM whitelist, then append an ADD log to Flash.
+    if (carddb_ram_add(&k) < 0) {
+        st = CARDDB_ERR_FULL;           // That table is full
+    } else {
+        st = carddb_append_log(CARD_LOG_OP_ADD, &k);
+    }
+
+    carddb_port_unlock();
+    return st;
 }
 
-carddb_status_t carddb_remove(const uint8_t uid[CARD_UID_SIZE])
+carddb_status_t carddb_remove(const card_uid_t *uid)
 {
-    int idx = carddb_find_in_ram(uid);
-    if (idx < 0) {
+    carddb_status_t st = CARDDB_ERR_NOT_FOUND;
+    card_key_t      k;
+
+    if (!key_from_uid(&k, uid)) {
+        return CARDDB_ERR_UID;
+    }
+
+    carddb_port_lock();
+
+    int idx = carddb_find_in_ram(&k);
+    if (idx >= 0) {
+        // Update RAM state first.
+        carddb_ram_del(&k);
+
+        // Then append a DEL log.
+        st = carddb_append_log(CARD_LOG_OP_DEL, &k);
+    }
+
+    carddb_port_unlock();
+    return st;
+}
+
+// --------- Transactions ----------------------------------------------------
+// carddb_txn_begin / _add / _remove / _commit.  Staged changes stay in RAM
+// until commit, which programs them as one blob in a single unlock window:
+//
+//   [TXN header]   count / blob length, like a checkpoint header
+//   [entry blob]   count * (op, UID[5]) or (op | LONG, long key), 0xFF-padded to whole records
+//   [TXN_END   ]   commit marker: same seq / count + CRC16 of the entries
+//
+// Replay applies a transaction only when its END record is there, so a batch
+// cut by power loss is either completely in the whitelist or not at all.
+// Entries take 6 bytes instead of a 12-byte record each (12 for a long key).
+
+#define CARD_TXN_BLOB_BYTES  (((CARD_DB_TXN_MAX * CARD_TXN_ENTRY_LONG + CARD_LOG_SIZE - 1) \
+                               / CARD_LOG_SIZE) * CARD_LOG_SIZE)
+
+static uint8_t  g_txn_buf[CARD_TXN_BLOB_BYTES];
+static uint32_t g_txn_count = 0;    // Staged entries
+static uint32_t g_txn_long  = 0;    // ... of them long keys
+static uint32_t g_txn_bytes = 0;    // Bytes used in g_txn_buf
+static int32_t  g_txn_net   = 0;    // Staged adds minus deletes (table-full check)
+static int32_t  g_txn_net_long = 0; // Same, long keys only
+static int      g_txn_open  = 0;
+
+// Is the key in the whitelist once the staged entries are applied?
+static int txn_uid_present(const card_key_t *k)
+{
+    int present = -1;
+
+    for (uint32_t off = 0; off < g_txn_bytes; ) {
+        const uint8_t *e   = &g_txn_buf[off];
+        uint8_t        len = (e[0] & CARD_LOG_OP_LONG) ? CARD_KEY_LONG : CARD_UID_SIZE;
+
+        if (len == k->len && memcmp(&e[1], k->b, len) == 0) {
+            present = (e[0] & ~CARD_LOG_OP_LONG) == CARD_LOG_OP_ADD;   // The last one wins
+        }
+        off += 1U + len;
+    }
+    return (present >= 0) ? present : (carddb_find_in_ram(k) >= 0);
+}
+
+static carddb_status_t txn_stage(uint8_t op, const card_key_t *k)
+{
+    int is_long = key_is_long(k);
+
+    if (!g_txn_open) {
+        return CARDDB_ERR_TXN;
+    }
+
+    int present = txn_uid_present(k);
+    if (op == CARD_LOG_OP_ADD && present) {
+        return CARDDB_OK;               // Already there, nothing to stage
+    }
+    if (op == CARD_LOG_OP_DEL && !present) {
         return CARDDB_ERR_NOT_FOUND;
     }
+    if (op == CARD_LOG_OP_ADD &&
+        (is_long ? g_long_count + g_txn_net_long >= CARD_DB_MAX_LONG_CARDS
+                 : (g_card_count - g_long_count) + (g_txn_net - g_txn_net_long) >= CARD_DB_MAX_CARDS)) {
+        return CARDDB_ERR_FULL;
+    }
+    if (g_txn_count >= CARD_DB_TXN_MAX) {
+        return CARDDB_ERR_TXN;          // Commit, then start another transaction
+    }
+
+    uint8_t *e = &g_txn_buf[g_txn_bytes];
+    e[0] = is_long ? (uint8_t)(op | CARD_LOG_OP_LONG) : op;
+    memcpy(&e[1], k->b, k->len);
+    g_txn_bytes += 1U + k->len;
+    g_txn_count++;
+    g_txn_net += (op == CARD_LOG_OP_ADD) ? 1 : -1;
+    if (is_long) {
+        g_txn_long++;
+        g_txn_net_long += (op == CARD_LOG_OP_ADD) ? 1 : -1;
+    }
+    return CARDDB_OK;
+}
+
+static void txn_reset(void)
+{
+    g_txn_count    = 0;
+    g_txn_long     = 0;
+    g_txn_bytes    = 0;
+    g_txn_net      = 0;
+    g_txn_net_long = 0;
+}
+
+static void txn_close(void)
+{
+    txn_reset();
+    g_txn_open  = 0;
+    carddb_port_unlock();
+}
+
+carddb_status_t carddb_txn_begin(void)
+{
+    carddb_port_lock();
+    if (g_txn_open) {
+        carddb_port_unlock();
+        return CARDDB_ERR_TXN;          // No nesting
+    }
+    g_txn_open  = 1;
+    txn_reset();
+    return CARDDB_OK;
+}
+
+carddb_status_t carddb_txn_add(const card_uid_t *uid)
+{
+    card_key_t k;
+    return key_from_uid(&k, uid) ? txn_stage(CARD_LOG_OP_ADD, &k) : CARDDB_ERR_UID;
+}
+
+carddb_status_t carddb_txn_remove(const card_uid_t *uid)
+{
+    card_key_t k;
+    return key_from_uid(&k, uid) ? txn_stage(CARD_LOG_OP_DEL, &k) : CARDDB_ERR_UID;
+}
+
+uint32_t carddb_txn_pending(void)
+{
+    return g_txn_open ? g_txn_count : 0;
+}
+
+void carddb_txn_abort(void)
+{
+    if (g_txn_open) {
+        txn_close();
+    }
+}
+
+carddb_status_t carddb_txn_commit(uint32_t *written)
+{
+    card_ckpt_info_t info;
+    card_log_t       hdr, end;
+    uint32_t         n      = g_txn_count;
+    uint32_t         n_long = g_txn_long;
+    carddb_status_t  st;
+
+    if (written != NULL) {
+        *written = 0;
+    }
+    if (!g_txn_open) {
+        return CARDDB_ERR_TXN;
+    }
+    if (n == 0) {
+        txn_close();
+        return CARDDB_OK;
+    }
 
-    // Update RAM state first.
-    g_cards[idx].in_use = 0;
+    // May GC; the staged entries are not in RAM yet.
+    uint32_t size = txn_size(n, n_long);
+    st = (n_long > 0) ? carddb_need_long_keys() : CARDDB_OK;
+    if (st == CARDDB_OK) {
+        st = carddb_reserve(size);
+    }
+    if (st != CARDDB_OK) {
+        txn_close();
+        return st;
+    }
+
+    uint32_t blob_len = txn_blob_recs(n, n_long) * CARD_LOG_SIZE;
+    memset(&g_txn_buf[g_txn_bytes], 0xFF, blob_len - g_txn_bytes);
+
+    info.count     = (uint16_t)n;
+    info.n_long    = (uint16_t)n_long;
+    info.blob_recs = (uint16_t)txn_blob_recs(n, n_long);
+    info.blob_crc  = 0xFFFF;
+
+    memset(&hdr, 0xFF, sizeof(hdr));
+    hdr.magic = CARD_FLASH_MAGIC;
+    hdr.op    = CARD_LOG_OP_TXN;
+    ckpt_info_pack(&hdr, &info);
+    hdr.seq    = ++g_last_seq;
+    hdr.crc    = card_log_crc(&hdr);
+
+    info.blob_crc = card_crc(g_log_fmt, g_txn_buf, g_txn_bytes);
+    memset(&end, 0xFF, sizeof(end));
+    end.magic = CARD_FLASH_MAGIC;
+    end.op    = CARD_LOG_OP_TXN_END;
+    ckpt_info_pack(&end, &info);
+    end.seq   = hdr.seq;
+    end.crc   = card_log_crc(&end);
+
+    // Header, entries, then the commit marker, all in one unlock window.
+    uint32_t addr = g_next_addr;
+    carddb_port_flash_unlock();
+    st = flash_program(addr, &hdr, CARD_LOG_SIZE);
+    if (st == CARDDB_OK) {
+        st = flash_program(addr + CARD_LOG_SIZE, g_txn_buf, blob_len);
+    }
+    if (st == CARDDB_OK) {
+        st = flash_program(addr + CARD_LOG_SIZE + blob_len, &end, CARD_LOG_SIZE);
+    }
+    carddb_port_flash_lock();
+
+    // Even a failed transaction has used up its space; without END it is ignored.
+    g_next_addr = addr + size;
+
+    if (st == CARDDB_OK) {
+        txn_apply(g_txn_buf, n);
+        g_ops_since_ckpt += n;
+        if (written != NULL) {
+            *written = n;
+        }
+        carddb_maybe_checkpoint();
+    }
+
+    CARDDB_LOG("TXN: seq=%u entries=%lu st=%d cards=%d next_addr=0x%08lX\r\n",
+               (unsigned)hdr.seq, (unsigned long)n, (int)st, g_card_count,
+               (unsigned long)g_next_addr);
+
+    txn_close();
+    return st;
+}
+
+// --------- Batched add / remove --------------------------------------------
+// One transaction per CARD_DB_TXN_MAX UIDs that actually change the whitelist.
+// A batch is either packed CARD_UID_SIZE keys (UID + BCC) or [len][UID] entries.
+
+// Key of the batch entry at buf[pos]; returns its size in bytes, 0 if it is malformed.
+static uint32_t batch_key(const uint8_t *buf, uint32_t size, uint32_t pos, int prefixed,
+                          card_key_t *k)
+{
+    if (!prefixed) {
+        const uint8_t *p = buf + pos;
+        if (size - pos < CARD_UID_SIZE) {
+            return 0;
+        }
+        // A tap always builds its key with the computed BCC, so a key with a
+        // wrong one could never match.
+        if ((uint8_t)(p[0] ^ p[1] ^ p[2] ^ p[3]) != p[4]) {
+            return 0;
+        }
+        key_load(k, p, CARD_UID_SIZE);
+        return CARD_UID_SIZE;
+    }
+
+    card_uid_t uid;
+    uid.len = buf[pos];
+    if (uid.len > CARD_UID_MAX_LEN || size - pos < 1U + uid.len) {
+        return 0;
+    }
+    memcpy(uid.uid, buf + pos + 1, uid.len);
+    return key_from_uid(k, &uid) ? 1U + uid.len : 0;
+}
+
+static carddb_status_t carddb_apply_batch(uint8_t op, const uint8_t *buf, uint32_t size,
+                                          int prefixed, uint32_t *applied)
+{
+    uint32_t        done = 0;
+    uint32_t        pos  = 0;
+    uint32_t        used;
+    card_key_t      k;
+    carddb_status_t st   = CARDDB_OK;
+
+    if (applied != NULL) {
+        *applied = 0;
+    }
 
-    // Then append a DEL log.
-    return carddb_append_log(CARD_LOG_OP_DEL, uid);
+    // Refuse the whole batch before anything is written if any entry is bad.
+    for (pos = 0; pos < size; pos += used) {
+        used = batch_key(buf, size, pos, prefixed, &k);
+        if (used == 0) {
+            return CARDDB_ERR_UID;
+        }
+    }
+
+    pos = 0;
+    while (pos < size && st == CARDDB_OK) {
+        st = carddb_txn_begin();
+        if (st != CARDDB_OK) {
+            break;
+        }
+
+        for (; pos < size; pos += used) {
+            used = batch_key(buf, size, pos, prefixed, &k);
+
+            carddb_status_t sst = txn_stage(op, &k);
+            if (sst == CARDDB_ERR_TXN) {
+                break;                  // Transaction full: commit and go on
+            }
+            if (sst == CARDDB_ERR_FULL) {
+                st = sst;
+                break;
+            }
+            // OK, or NOT_FOUND / already there: nothing staged for this UID.
+        }
+
+        uint32_t        w;
+        carddb_status_t cst = carddb_txn_commit(&w);
+        done += w;
+        if (st == CARDDB_OK) {
+            st = cst;
+        }
+    }
+
+    if (applied != NULL) {
+        *applied = done;
+    }
+    return st;
+}
+
+carddb_status_t carddb_add_batch(const uint8_t *uids, uint32_t n, uint32_t *applied)
+{
+    return carddb_apply_batch(CARD_LOG_OP_ADD, uids, n * CARD_UID_SIZE, 0, applied);
+}
+
+carddb_status_t carddb_remove_batch(const uint8_t *uids, uint32_t n, uint32_t *applied)
+{
+    return carddb_apply_batch(CARD_LOG_OP_DEL, uids, n * CARD_UID_SIZE, 0, applied);
+}
+
+carddb_status_t carddb_add_uids(const uint8_t *buf, uint32_t size, uint32_t *applied)
+{
+    return carddb_apply_batch(CARD_LOG_OP_ADD, buf, size, 1, applied);
+}
+
+carddb_status_t carddb_remove_uids(const uint8_t *buf, uint32_t size, uint32_t *applied)
+{
+    return carddb_apply_batch(CARD_LOG_OP_DEL, buf, size, 1, applied);
 }
@@ -0,0 +1,151 @@
+#include "card_db_port.h"      // carddb_port_xxx
+#include "stm32f4xx_hal.h"     // HAL_FLASH_xxx
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include <string.h>            // memcpy
+
+// Program / erase parallelism follows the supply range.  FLASH_VOLTAGE_RANGE_4
+// (2.7-3.6 V plus 8-9 V on VPP) allows x64 double-word programming, half the
+// program operations; the Discovery board has no VPP, so the default is x32.
+#ifndef CARD_PORT_VOLTAGE_RANGE
+#define CARD_PORT_VOLTAGE_RANGE     FLASH_VOLTAGE_RANGE_3
+#endif
+
+static SemaphoreHandle_t g_lock;
+static StaticSemaphore_t g_lock_sem;
+
+uint32_t carddb_port_sector_addr(uint32_t sector)
+{
+    if (sector < 4) {
+        return FLASH_BASE + sector * 0x4000U;
+    }
+    if (sector == 4) {
+        return FLASH_BASE + 0x10000U;
+    }
+    return FLASH_BASE + 0x20000U + (sector - 5) * 0x20000U;
+}
+
+uint32_t carddb_port_sector_size(uint32_t sector)
+{
+    if (sector < 4) {
+        return 0x4000U;
+    }
+    if (sector == 4) {
+        return 0x10000U;
+    }
+    return 0x20000U;
+}
+
+void carddb_port_flash_unlock(void)
+{
+    HAL_FLASH_Unlock();
+}
+
+void carddb_port_flash_lock(void)
+{
+    HAL_FLASH_Lock();
+}
+
+carddb_status_t carddb_port_flash_program(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    uint32_t i = 0;
+
+#if CARD_PORT_VOLTAGE_RANGE == FLASH_VOLTAGE_RANGE_4
+    // Leading word up to 8-byte alignment, then double words.
+    if ((addr & 7U) != 0 && len >= 4) {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, word) != HAL_OK) {
+            return CARDDB_ERR_FLASH;
+        }
+        i = 4;
+    }
+    for (; i + 8 <= len; i += 8) {
+        uint64_t dword;
+        memcpy(&dword, data + i, 8);
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr + i, dword) != HAL_OK) {
+            return CARDDB_ERR_FLASH;
+        }
+    }
+#endif
+
+    for (; i < len; i += 4) {
+        uint32_t word;
+        memcpy(&word, data + i, 4);
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr + i, word) != HAL_OK) {
+            return CARDDB_ERR_FLASH;
+        }
+    }
+    return CARDDB_OK;
+}
+
+carddb_status_t carddb_port_flash_erase_sector(uint32_t sector)
+{
+    FLASH_EraseInitTypeDef erase_init;
+    uint32_t               sector_error = 0;
+
+    erase_init.TypeErase    = FLASH_TYPEERASE_SECTORS;
+    erase_init.Sector       = sector;
+    erase_init.NbSectors    = 1;
+    erase_init.VoltageRange = CARD_PORT_VOLTAGE_RANGE;
+
+    if (HAL_FLASHEx_Erase(&erase_init, &sector_error) != HAL_OK) {
+        return CARDDB_ERR_FLASH;
+    }
+    return CARDDB_OK;
+}
+
+uint32_t carddb_port_crc32(const uint8_t *data, uint32_t len)
+{
+    uint32_t word;
+
+    CRC->CR = CRC_CR_RESET;
+    for (; len >= 4; data += 4, len -= 4) {
+        memcpy(&word, data, 4);
+        CRC->DR = word;
+    }
+    if (len > 0) {
+        word = 0xFFFFFFFFU;
+        memcpy(&word, data, len);
+        CRC->DR = word;
+    }
+    return CRC->DR;
+}
+
+uint32_t carddb_port_flash_error(void)
+{
+    return HAL_FLASH_GetError();
+}
+
+const uint8_t *carddb_port_flash_ptr(uint32_t addr)
+{
+    // Flash is memory-mapped on the MCU.
+    return (const uint8_t *)addr;
+}
+
+// Recursive: a transaction holds the lock from begin to commit, and the
+// same task may call the other card_db functions in between.
+void carddb_port_init(void)
+{
+    __HAL_RCC_CRC_CLK_ENABLE();     // carddb_port_crc32; only card_db uses the CRC unit
+
+    if (g_lock == NULL) {
+        g_lock = xSemaphoreCreateRecursiveMutexStatic(&g_lock_sem);
+    }
+}
+
+// Before the scheduler runs there is only one caller, no lock needed.
+void carddb_port_lock(void)
+{
+    if (g_lock != NULL && xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+        xSemaphoreTakeRecursive(g_lock, portMAX_DELAY);
+    }
+}
+
+void carddb_port_unlock(void)
+{
+    if (g_lock != NULL && xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED) {
+        xSemaphoreGiveRecursive(g_lock);
+    }
+}
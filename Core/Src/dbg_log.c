@@ -0,0 +1,222 @@
+#include "dbg_log.h"
+#include "main.h"
+#include "usart.h"             // huart3
+#include "FreeRTOS.h"
+#include "task.h"
+#include <stdarg.h>            // va_list
+#include <stdio.h>             // vsnprintf
+#include <string.h>            // memcpy
+
+#define DBG_UART  huart3
+
+// ========================= Ring buffer layout ===============================
+// Every message is [4-byte header][text, padded to 4 bytes].
+// header = COMMIT | PAD | length.  A producer first reserves space by moving
+// g_wr with compare-and-swap, copies its text, then publishes the header.
+// If a message does not fit before the end of the ring, the producer also
+// reserves the rest of the ring as a PAD message and starts again at offset 0,
+// so every message is contiguous.  The single consumer (LOG task) copies
+// committed messages out, zeroes everything they covered (header, text,
+// padding, PAD regions) and only then moves g_rd forward.  A header slot
+// that has been reserved but not yet published therefore always reads 0,
+// never a stale COBS / text byte from the previous lap.
+
+#define RING_MASK       (DBG_LOG_RING_SIZE - 1U)
+#define HDR_SIZE        4U
+#define HDR_COMMIT      0x80000000U
+#define HDR_PAD         0x40000000U
+#define HDR_LEN_MASK    0x0000FFFFU
+
+#define TX_CHUNK        256U    // DMA bounce buffer, also the longest message
+#define LOG_POLL_MS     10U     // how often the LOG task looks for new messages
+#define LOG_TX_TIMEOUT  100U    // ms; 256 bytes at 115200 baud take ~22 ms
+
+typedef char dbglog_ring_check[((DBG_LOG_RING_SIZE & RING_MASK) == 0 &&
+                                 DBG_LOG_RING_SIZE >= 4U * TX_CHUNK) ? 1 : -1];
+
+static uint8_t  g_ring[DBG_LOG_RING_SIZE] __attribute__((aligned(4)));
+static uint32_t g_wr;                   // Reserved up to here (free-running)
+static uint32_t g_rd;                   // Consumed up to here (free-running)
+static uint32_t g_dropped;
+static volatile uint8_t g_level = DBG_LOG_LEVEL;
+
+static uint8_t      g_tx_buf[TX_CHUNK]; // Only touched by the consumer / DMA
+static TaskHandle_t g_log_task = NULL;
+
+#define LOG_STACK_WORDS 128U
+static StackType_t  g_log_stack[LOG_STACK_WORDS];
+static StaticTask_t g_log_tcb;
+
+static uint32_t *hdr_ptr(uint32_t pos)
+{
+    return (uint32_t *)(void *)&g_ring[pos];
+}
+
+// --------- Consumer side ---------------------------------------------------
+
+// Copy committed messages into dst (at most max bytes) and free their ring space.
+static uint32_t ring_take(uint8_t *dst, uint32_t max)
+{
+    uint32_t n  = 0;
+    uint32_t rd = g_rd;
+
+    while (rd != __atomic_load_n(&g_wr, __ATOMIC_ACQUIRE)) {
+        uint32_t pos = rd & RING_MASK;
+        uint32_t hdr = __atomic_load_n(hdr_ptr(pos), __ATOMIC_ACQUIRE);
+
+        if ((hdr & HDR_COMMIT) == 0) {
+            break;      // Reserved but the producer is still copying
+        }
+
+        uint32_t len  = hdr & HDR_LEN_MASK;
+        uint32_t span = HDR_SIZE + ((len + 3U) & ~3U);
+        if ((hdr & HDR_PAD) == 0) {
+            if (n + len > max) {
+                break;  // Next DMA chunk
+            }
+            memcpy(dst + n, &g_ring[pos + HDR_SIZE], len);
+            n += len;
+        }
+
+        // All of it, not just the header: see the layout note above
+        memset(&g_ring[pos], 0, span);
+        rd += span;
+        __atomic_store_n(&g_rd, rd, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+// Before the scheduler runs there is no LOG task: print synchronously.
+static void dbg_log_flush_blocking(void)
+{
+    uint32_t n;
+    while ((n = ring_take(g_tx_buf, sizeof(g_tx_buf))) > 0) {
+        HAL_UART_Transmit(&DBG_UART, g_tx_buf, (uint16_t)n, HAL_MAX_DELAY);
+    }
+}
+
+static void vLogTask(void *argument)
+{
+    for (;;) {
+        uint32_t n = ring_take(g_tx_buf, sizeof(g_tx_buf));
+        if (n == 0) {
+            vTaskDelay(pdMS_TO_TICKS(LOG_POLL_MS));
+            continue;
+        }
+
+        // Clear a stale notification, start DMA, sleep until TxCplt.
+        ulTaskNotifyTake(pdTRUE, 0);
+        if (HAL_UART_Transmit_DMA(&DBG_UART, g_tx_buf, (uint16_t)n) != HAL_OK) {
+            vTaskDelay(pdMS_TO_TICKS(LOG_POLL_MS));
+            continue;
+        }
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_TX_TIMEOUT)) == 0) {
+            HAL_UART_AbortTransmit(&DBG_UART);
+        }
+    }
+}
+
+void dbg_log_tx_cplt_isr(void)
+{
+    if (g_log_task != NULL) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(g_log_task, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    }
+}
+
+// --------- Producer side ---------------------------------------------------
+
+int dbg_log_write(uint8_t level, const char *buf, int len)
+{
+    if (level > g_level || len <= 0) {
+        return 1;
+    }
+    if ((uint32_t)len > TX_CHUNK) {
+        len = TX_CHUNK;
+    }
+
+    uint32_t need = HDR_SIZE + (((uint32_t)len + 3U) & ~3U);
+    uint32_t head, pos, contig, total;
+
+    // Reserve space; lock-free, so an ISR can preempt a task in the middle.
+    do {
+        head   = __atomic_load_n(&g_wr, __ATOMIC_RELAXED);
+        pos    = head & RING_MASK;
+        contig = DBG_LOG_RING_SIZE - pos;
+        total  = (need <= contig) ? need : contig + need;
+
+        if (head + total - __atomic_load_n(&g_rd, __ATOMIC_ACQUIRE) > DBG_LOG_RING_SIZE) {
+            __atomic_fetch_add(&g_dropped, 1U, __ATOMIC_RELAXED);
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&g_wr, &head, head + total, 0,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    if (total != need) {
+        __atomic_store_n(hdr_ptr(pos), HDR_COMMIT | HDR_PAD | (contig - HDR_SIZE),
+                         __ATOMIC_RELEASE);
+        pos = 0;
+    }
+
+    memcpy(&g_ring[pos + HDR_SIZE], buf, (uint32_t)len);
+    __atomic_store_n(hdr_ptr(pos), HDR_COMMIT | (uint32_t)len, __ATOMIC_RELEASE);
+
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+        dbg_log_flush_blocking();
+    }
+    return 1;
+}
+
+void dbg_log_printf(uint8_t level, const char *fmt, ...)
+{
+    if (level > g_level) {
+        return;
+    }
+
+    char    buf[DBG_LOG_LINE_MAX];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (len <= 0) {
+        return;
+    }
+    if (len >= (int)sizeof(buf)) {
+        len = (int)sizeof(buf) - 1;
+    }
+    dbg_log_write(level, buf, len);
+}
+
+// --------- Setup / control -------------------------------------------------
+
+void dbg_log_init(void)
+{
+    memset(g_ring, 0, sizeof(g_ring));
+    g_wr      = 0;
+    g_rd      = 0;
+    g_dropped = 0;
+}
+
+void dbg_log_start_task(void)
+{
+    g_log_task = xTaskCreateStatic(vLogTask, "LOG", LOG_STACK_WORDS, NULL, tskIDLE_PRIORITY + 1,
+                                   g_log_stack, &g_log_tcb);
+}
+
+void dbg_log_set_level(uint8_t level)
+{
+    g_level = (level > DBG_LOG_LEVEL) ? DBG_LOG_LEVEL : level;
+}
+
+uint8_t dbg_log_get_level(void)
+{
+    return g_level;
+}
+
+uint32_t dbg_log_dropped(void)
+{
+    return __atomic_load_n(&g_dropped, __ATOMIC_RELAXED);
+}
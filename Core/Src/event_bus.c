@@ -0,0 +1,64 @@
+#include "event_bus.h"
+#include "task.h"
+#include <string.h>
+
+typedef struct {
+    QueueHandle_t q;
+    uint32_t      mask;
+    TickType_t    wait;
+} bus_sub_t;
+
+// Filled before the scheduler starts and read-only afterwards, so publish needs no lock.
+static bus_sub_t         g_subs[EVENT_BUS_MAX_SUBS];
+static int               g_nsubs;
+static volatile uint32_t g_dropped;
+
+int event_bus_subscribe(QueueHandle_t q, uint32_t mask, TickType_t wait)
+{
+    if (q == NULL || g_nsubs >= EVENT_BUS_MAX_SUBS) {
+        return 0;
+    }
+    g_subs[g_nsubs].q    = q;
+    g_subs[g_nsubs].mask = mask;
+    g_subs[g_nsubs].wait = wait;
+    g_nsubs++;
+    return 1;
+}
+
+int event_bus_publish(app_event_t *ev)
+{
+    uint32_t bit = EV_BIT(ev->type);
+    int      n   = 0;
+
+    ev->tick = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+    for (int i = 0; i < g_nsubs; i++) {
+        if (!(g_subs[i].mask & bit)) {
+            continue;
+        }
+        if (xQueueSend(g_subs[i].q, ev, g_subs[i].wait) == pdTRUE) {
+            n++;
+        } else {
+            taskENTER_CRITICAL();
+            g_dropped++;
+            taskEXIT_CRITICAL();
+        }
+    }
+    return n;
+}
+
+int event_bus_post(uint8_t type, uint8_t source, uint8_t code)
+{
+    app_event_t ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type   = type;
+    ev.source = source;
+    ev.code   = code;
+    return event_bus_publish(&ev);
+}
+
+uint32_t event_bus_dropped(void)
+{
+    return g_dropped;
+}
@@ -0,0 +1,114 @@
+#include "keypad.h"
+#include "task.h"
+#include "queue.h"
+#include "timers.h"
+
+static const uint16_t g_row_pins[4] = { GPIO_PIN_7, GPIO_PIN_8, GPIO_PIN_9, GPIO_PIN_10 };
+static const uint16_t g_col_pins[4] = { GPIO_PIN_11, GPIO_PIN_12, GPIO_PIN_13, GPIO_PIN_14 };
+
+static QueueHandle_t  g_keyq  = NULL;
+static TimerHandle_t  g_timer = NULL;
+static keypad_event_t g_keyq_buf[KEYPAD_QUEUE_LEN];
+static StaticQueue_t  g_keyq_qcb;
+static StaticTimer_t  g_sample_tmr;
+static keypad_fsm_t   g_fsm;
+static keypad_event_t g_ev[2 * KEYPAD_KEYS];    // One sample's events (timer task only)
+static volatile uint32_t g_dropped;
+
+// Busy-wait a few microseconds (runs in the timer task, must not block).
+static void settle_delay(void)
+{
+    volatile uint32_t n = (SystemCoreClock / 1000000U) * KEYPAD_SETTLE_US / 4U;
+    while (n--) {
+    }
+}
+
+// Drive one column low at a time and read all rows: bit (row * 4 + col) = pressed.
+// Columns are parked low again afterwards.
+static uint16_t keypad_scan(void)
+{
+    uint16_t bitmap = 0;
+
+    for (int col = 0; col < 4; col++) {
+        HAL_GPIO_WritePin(KEYPAD_COL_PORT, KEYPAD_COL_PINS, GPIO_PIN_SET);
+        HAL_GPIO_WritePin(KEYPAD_COL_PORT, g_col_pins[col], GPIO_PIN_RESET);
+        settle_delay();
+
+        uint32_t idr = KEYPAD_ROW_PORT->IDR;
+        for (int row = 0; row < 4; row++) {
+            if (!(idr & g_row_pins[row])) {
+                bitmap |= (uint16_t)(1U << (row * 4 + col));
+            }
+        }
+    }
+
+    HAL_GPIO_WritePin(KEYPAD_COL_PORT, KEYPAD_COL_PINS, GPIO_PIN_RESET);
+    return bitmap;
+}
+
+// Columns are low: clear stale edges and unmask the row EXTI lines.  A key
+// pressed between the last scan and here gives no edge, so check the level too.
+static void keypad_arm(void)
+{
+    __HAL_GPIO_EXTI_CLEAR_IT(KEYPAD_ROW_PINS);
+    SET_BIT(EXTI->IMR, KEYPAD_ROW_PINS);
+
+    if ((KEYPAD_ROW_PORT->IDR & KEYPAD_ROW_PINS) != KEYPAD_ROW_PINS) {
+        CLEAR_BIT(EXTI->IMR, KEYPAD_ROW_PINS);
+        xTimerStart(g_timer, 0);
+    }
+}
+
+static void keypad_timer_cb(TimerHandle_t t)
+{
+    uint16_t raw = keypad_scan();
+    uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    int      n   = keypad_fsm_sample(&g_fsm, raw, now, g_ev, 2 * KEYPAD_KEYS);
+
+    for (int i = 0; i < n; i++) {
+        if (xQueueSend(g_keyq, &g_ev[i], 0) != pdTRUE) {
+            g_dropped++;
+        }
+    }
+
+    if (keypad_fsm_idle(&g_fsm)) {
+        xTimerStop(t, 0);
+        keypad_arm();
+    }
+}
+
+void keypad_init(void)
+{
+    keypad_fsm_init(&g_fsm);
+    g_keyq  = xQueueCreateStatic(KEYPAD_QUEUE_LEN, sizeof(keypad_event_t), (uint8_t *)g_keyq_buf,
+                                 &g_keyq_qcb);
+    g_timer = xTimerCreateStatic("KEYSMP", pdMS_TO_TICKS(KEYPAD_SAMPLE_MS), pdTRUE, NULL,
+                                 keypad_timer_cb, &g_sample_tmr);
+
+    HAL_GPIO_WritePin(KEYPAD_COL_PORT, KEYPAD_COL_PINS, GPIO_PIN_RESET);
+    keypad_arm();
+}
+
+BaseType_t keypad_get(keypad_event_t *ev, TickType_t wait)
+{
+    return xQueueReceive(g_keyq, ev, wait);
+}
+
+uint32_t keypad_dropped(void)
+{
+    return g_dropped;
+}
+
+void keypad_exti_isr(uint16_t pin)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (!(pin & KEYPAD_ROW_PINS) || g_timer == NULL) {
+        return;
+    }
+
+    // Bounces must not re-enter; the sampling timer runs until all keys are released.
+    CLEAR_BIT(EXTI->IMR, KEYPAD_ROW_PINS);
+    xTimerStartFromISR(g_timer, &woken);
+    portYIELD_FROM_ISR(woken);
+}
@@ -0,0 +1,91 @@
+#include "keypad_fsm.h"
+#include <string.h>
+
+static const char g_keymap[KEYPAD_KEYS] = {
+    '1','2','3','A',
+    '4','5','6','B',
+    '7','8','9','C',
+    '*','0','#','D'
+};
+
+char keypad_fsm_key(int bit)
+{
+    return g_keymap[bit & (KEYPAD_KEYS - 1)];
+}
+
+// Three keys on the corners of a rectangle make the fourth one read as pressed
+// too (no diodes): any two rows sharing two or more columns is ambiguous.
+static int is_ghosted(uint16_t raw)
+{
+    for (int a = 0; a < 4; a++) {
+        uint16_t ra = (raw >> (a * 4)) & 0xFU;
+        for (int b = a + 1; b < 4; b++) {
+            uint16_t common = ra & ((raw >> (b * 4)) & 0xFU);
+            if (common & (common - 1U)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int push(keypad_event_t *ev, int n, int max, uint8_t type, int bit, uint32_t tick)
+{
+    if (n < max) {
+        ev[n].type = type;
+        ev[n].key  = g_keymap[bit];
+        ev[n].tick = tick;
+        n++;
+    }
+    return n;
+}
+
+void keypad_fsm_init(keypad_fsm_t *f)
+{
+    memset(f, 0, sizeof(*f));
+}
+
+int keypad_fsm_sample(keypad_fsm_t *f, uint16_t raw, uint32_t tick, keypad_event_t *ev, int max)
+{
+    int n = 0;
+
+    if (is_ghosted(raw)) {
+        raw = f->state;     // Hold the debounced state, neither press nor release
+    }
+
+    for (int bit = 0; bit < KEYPAD_KEYS; bit++) {
+        uint16_t m = (uint16_t)(1U << bit);
+
+        if (raw & m) {
+            if (f->integ[bit] < KEYPAD_INTEG_MAX && ++f->integ[bit] == KEYPAD_INTEG_MAX &&
+                !(f->state & m)) {
+                f->state       |= m;
+                f->long_sent   &= (uint16_t)~m;
+                f->down_at[bit] = tick;
+                n = push(ev, n, max, KEYPAD_EV_PRESS, bit, tick);
+            }
+        } else if (f->integ[bit] > 0 && --f->integ[bit] == 0 && (f->state & m)) {
+            f->state &= (uint16_t)~m;
+            n = push(ev, n, max, KEYPAD_EV_RELEASE, bit, tick);
+        }
+
+        if ((f->state & m) && !(f->long_sent & m) && tick - f->down_at[bit] >= KEYPAD_LONG_MS) {
+            f->long_sent |= m;
+            n = push(ev, n, max, KEYPAD_EV_LONG, bit, tick);
+        }
+    }
+    return n;
+}
+
+int keypad_fsm_idle(const keypad_fsm_t *f)
+{
+    if (f->state != 0) {
+        return 0;
+    }
+    for (int bit = 0; bit < KEYPAD_KEYS; bit++) {
+        if (f->integ[bit] != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,104 @@
+#include "lcd_fb.h"
+#include <string.h>
+
+#define CURSOR_UNKNOWN  0xFFU
+
+static lcd1602_HandleTypeDef *g_lcd;
+static char    g_shadow[LCD_FB_ROWS][LCD_FB_COLS];  // What the panel shows now
+static uint8_t g_valid;                              // 0 = redraw every cell
+static uint8_t g_cursor = CURSOR_UNKNOWN;            // DDRAM address counter
+
+static uint8_t ddram_addr(uint8_t row, uint8_t col)
+{
+    return (uint8_t)(col + 0x40U * row);
+}
+
+// Copy at most LCD_FB_COLS chars of src, pad with spaces.
+static void fill_row(char *dst, const char *src)
+{
+    uint8_t i = 0;
+
+    if (src != NULL) {
+        for (; i < LCD_FB_COLS && src[i] != '\0'; i++) {
+            dst[i] = src[i];
+        }
+    }
+    for (; i < LCD_FB_COLS; i++) {
+        dst[i] = ' ';
+    }
+}
+
+// Send row[from..to] and update the shadow; returns the number of chars sent.
+static uint32_t send_run(uint8_t row, uint8_t from, uint8_t to, const char *cells)
+{
+    char    buf[LCD_FB_COLS + 1];
+    uint8_t n = (uint8_t)(to - from + 1U);
+
+    if (g_cursor != ddram_addr(row, from)) {
+        lcd1602_SetCursor(g_lcd, from, row);
+    }
+
+    memcpy(buf, &cells[from], n);
+    buf[n] = '\0';
+    lcd1602_Print(g_lcd, (uint8_t *)buf);
+
+    memcpy(&g_shadow[row][from], &cells[from], n);
+    g_cursor = ddram_addr(row, (uint8_t)(to + 1U));
+    return n;
+}
+
+static uint32_t show_row(uint8_t row, const char *text)
+{
+    char     cells[LCD_FB_COLS];
+    uint32_t sent = 0;
+    int      run_start = -1;
+    int      run_end   = -1;
+
+    fill_row(cells, text);
+
+    for (int col = 0; col < LCD_FB_COLS; col++) {
+        if (g_valid && cells[col] == g_shadow[row][col]) {
+            continue;
+        }
+        if (run_start >= 0 && col - run_end - 1 > LCD_FB_MERGE_GAP) {
+            sent += send_run(row, (uint8_t)run_start, (uint8_t)run_end, cells);
+            run_start = -1;
+        }
+        if (run_start < 0) {
+            run_start = col;
+        }
+        run_end = col;
+    }
+    if (run_start >= 0) {
+        sent += send_run(row, (uint8_t)run_start, (uint8_t)run_end, cells);
+    }
+    return sent;
+}
+
+void lcd_fb_init(lcd1602_HandleTypeDef *lcd)
+{
+    g_lcd = lcd;
+    memset(g_shadow, ' ', sizeof(g_shadow));
+    g_valid  = 1;
+    g_cursor = CURSOR_UNKNOWN;
+}
+
+uint32_t lcd_fb_show(const char *line1, const char *line2)
+{
+    uint32_t sent;
+
+    if (g_lcd == NULL) {
+        return 0;
+    }
+
+    sent  = show_row(0, line1);
+    sent += show_row(1, line2);
+    g_valid = 1;
+    return sent;
+}
+
+void lcd_fb_invalidate(void)
+{
+    g_valid  = 0;
+    g_cursor = CURSOR_UNKNOWN;
+}
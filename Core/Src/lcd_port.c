@@ -0,0 +1,172 @@
+#include "lcd_port.h"
+#include "lcd1602_i2c.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include <string.h>            // memcpy
+
+// ========================= Byte ring =======================================
+// The LCD task is the only producer (moves g_head), the I2C completion ISR is
+// the only consumer (moves g_tail).  Bytes in [g_tail, g_tail + g_inflight)
+// are owned by the running DMA transfer; each transfer is the contiguous part
+// of the ring up to its end, the ISR starts the next part right away.
+
+#define RING_MASK   (LCD_PORT_RING_SIZE - 1U)
+
+typedef char lcdport_ring_check[((LCD_PORT_RING_SIZE & RING_MASK) == 0) ? 1 : -1];
+
+static uint8_t  g_ring[LCD_PORT_RING_SIZE];
+static volatile uint32_t g_head;            // Queued up to here (free-running)
+static volatile uint32_t g_tail;            // Sent up to here (free-running)
+static volatile uint32_t g_inflight;        // Bytes in the running DMA transfer
+static volatile uint8_t  g_busy;
+static volatile uint32_t g_dropped;
+
+static I2C_HandleTypeDef *g_hi2c;
+static uint16_t           g_addr;
+static TaskHandle_t volatile g_waiter = NULL;
+
+// Start the next DMA transfer if idle.  Caller has interrupts masked
+// (task: critical section, or the I2C ISR itself).
+static void ring_kick(void)
+{
+    if (g_busy || g_head == g_tail) {
+        return;
+    }
+
+    uint32_t pos = g_tail & RING_MASK;
+    uint32_t n   = g_head - g_tail;
+    if (n > LCD_PORT_RING_SIZE - pos) {
+        n = LCD_PORT_RING_SIZE - pos;
+    }
+
+    g_busy     = 1;
+    g_inflight = n;
+    if (HAL_I2C_Master_Transmit_DMA(g_hi2c, g_addr, &g_ring[pos], (uint16_t)n) != HAL_OK) {
+        g_dropped += n;
+        g_tail    += n;
+        g_inflight = 0;
+        g_busy     = 0;
+    }
+}
+
+static void ring_done_isr(I2C_HandleTypeDef *hi2c, int ok)
+{
+    if (hi2c != g_hi2c || !g_busy) {
+        return;
+    }
+
+    if (!ok) {
+        g_dropped += g_inflight;
+    }
+    g_tail    += g_inflight;
+    g_inflight = 0;
+    g_busy     = 0;
+    ring_kick();
+
+    TaskHandle_t waiter = g_waiter;
+    if (waiter != NULL) {
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        vTaskNotifyGiveFromISR(waiter, &xHigherPriorityTaskWoken);
+        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    }
+}
+
+void lcd_port_tx_cplt_isr(I2C_HandleTypeDef *hi2c)
+{
+    ring_done_isr(hi2c, 1);
+}
+
+void lcd_port_error_isr(I2C_HandleTypeDef *hi2c)
+{
+    ring_done_isr(hi2c, 0);
+}
+
+// The bus hung (no completion within LCD_PORT_TIMEOUT_MS): re-init I2C1 and
+// drop whatever is still queued.
+static void ring_recover(void)
+{
+    taskENTER_CRITICAL();
+    HAL_I2C_DeInit(g_hi2c);
+    HAL_I2C_Init(g_hi2c);
+    g_dropped += g_head - g_tail;
+    g_tail     = g_head;
+    g_inflight = 0;
+    g_busy     = 0;
+    taskEXIT_CRITICAL();
+}
+
+// Sleep until at least `need` bytes of the ring are free
+// (need == LCD_PORT_RING_SIZE: everything sent and the bus idle).
+static void ring_wait_free(uint32_t need)
+{
+    for (;;) {
+        taskENTER_CRITICAL();
+        uint32_t used = g_head - g_tail;
+        if (LCD_PORT_RING_SIZE - used < need) {
+            g_waiter = xTaskGetCurrentTaskHandle();
+        }
+        taskEXIT_CRITICAL();
+
+        if (LCD_PORT_RING_SIZE - used >= need) {
+            break;
+        }
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LCD_PORT_TIMEOUT_MS)) == 0) {
+            ring_recover();
+            break;
+        }
+    }
+    g_waiter = NULL;
+}
+
+// --------- lcd1602_i2c.c hooks ---------------------------------------------
+
+HAL_StatusTypeDef lcd1602_BusWrite(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *buf, uint16_t len)
+{
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        return HAL_I2C_Master_Transmit(lcd1602_Handle->hi2c, lcd1602_Handle->address,
+                                       (uint8_t *)buf, len, I2C_TIMEOUT);
+    }
+
+    g_hi2c = lcd1602_Handle->hi2c;
+    g_addr = lcd1602_Handle->address;
+
+    while (len > 0) {
+        uint32_t n = (len < LCD_PORT_RING_SIZE) ? len : LCD_PORT_RING_SIZE;
+        ring_wait_free(n);
+
+        // Only the producer writes the free part of the ring, no lock needed for the copy.
+        uint32_t pos   = g_head & RING_MASK;
+        uint32_t first = LCD_PORT_RING_SIZE - pos;
+        if (first > n) {
+            first = n;
+        }
+        memcpy(&g_ring[pos], buf, first);
+        memcpy(&g_ring[0], buf + first, n - first);
+
+        taskENTER_CRITICAL();
+        g_head += n;
+        ring_kick();
+        taskEXIT_CRITICAL();
+
+        buf += n;
+        len -= (uint16_t)n;
+    }
+    return HAL_OK;
+}
+
+void lcd1602_Delay(uint32_t ms)
+{
+    if (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING) {
+        HAL_Delay(ms);
+        return;
+    }
+
+    // The HD44780 timing starts once the preceding instruction is on the wire.
+    ring_wait_free(LCD_PORT_RING_SIZE);
+    vTaskDelay(pdMS_TO_TICKS(ms) + 1);
+}
+
+uint32_t lcd_port_dropped(void)
+{
+    return g_dropped;
+}
@@ -30,22 +30,24 @@
 #include "task.h"
 #include "queue.h"
 #include "lcd1602_i2c.h"
+#include "lcd_fb.h"
+#include "lcd_port.h"
+#include "bt_rx.h"
+#include "bt_proto.h"
 #include "usart.h"     
 #include "rc522.h"  
 #include "card_db.h" 
+#include "nfc_poll.h"
+#include "keypad.h"
+#include "event_bus.h"
+#include "dbg_log.h"
 #include <string.h>    
 #include <stdio.h>   
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
-// NFC mode: normal or add-card
-typedef enum {
-    NFC_MODE_NORMAL = 0,
-    NFC_MODE_ADD_CARD = 1,
-    NFC_MODE_DELETE_CARD = 2
-} NfcMode_t;
-
+// NFC mode: normal / add-card / delete-card (只有 vStateTask 會改)
 static volatile NfcMode_t gNfcMode = NFC_MODE_NORMAL;
 
 typedef struct {
@@ -57,6 +59,11 @@ typedef struct {
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
 #define PCF8574_ADDRESS  0b01001110   // = 0x4E
+
+// card_db 背景 GC：沒事做時多久看一次；最後一次看到卡之後多久才准 erase
+// (F407 erase 一個 128KB sector 時 CPU 讀 Flash 會卡住 1~2 秒)
+#define CARD_GC_POLL_MS   200U
+#define CARD_GC_QUIET_MS  5000U
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -71,13 +78,53 @@ typedef struct {
 #define BT_UART   huart2   // HC-05 
 #define DBG_UART  huart3   // TTL / PC Debug
 
-QueueHandle_t xEventQueue;     // BT / NFC / Keypad → StateTask
-QueueHandle_t xLcdQ;       
-QueueHandle_t xBtRxQ;      
+// Task / queue 全部 static allocation (heap 不用了)：buffer 照 Host/ram_map 認得的名字
+// <name>_stack / _tcb / _buf / _qcb 放，RAM map 才能一個物件一行列出來
+#define APP_TASK(name, words) \
+    static StackType_t  name##_stack[words]; \
+    static StaticTask_t name##_tcb
+#define APP_TASK_CREATE(fn, name, label, prio) \
+    xTaskCreateStatic(fn, label, sizeof(name##_stack) / sizeof(StackType_t), NULL, prio, \
+                      name##_stack, &name##_tcb)
+
+#define APP_EVQ(name, len) \
+    static app_event_t   name##_buf[len]; \
+    static StaticQueue_t name##_qcb
+#define APP_EVQ_CREATE(name) \
+    xQueueCreateStatic(sizeof(name##_buf) / sizeof(app_event_t), sizeof(app_event_t), \
+                       (uint8_t *)name##_buf, &name##_qcb)
+
+APP_TASK(bt,     256);
+APP_TASK(keypad, 256);
+APP_TASK(lcd,    256);
+APP_TASK(state,  256);
+APP_TASK(nfc,    256);
+APP_TASK(cardgc, 256);
+APP_TASK(btnote, 256);
+APP_TASK(audit,  192);
+
+// idle / timer task 也要自己給 (vApplicationGetIdleTaskMemory / GetTimerTaskMemory)
+APP_TASK(idle,   configMINIMAL_STACK_SIZE);
+APP_TASK(timer,  configTIMER_TASK_STACK_DEPTH);
+
+// event_bus 的 subscriber queue (item = app_event_t)
+static QueueHandle_t qState;    // → vStateTask
+static QueueHandle_t qLcd;      // → vLcdTask
+static QueueHandle_t qBtNote;   // → vBtNotifyTask
+static QueueHandle_t qAudit;    // → vAuditTask
+APP_EVQ(qState,  8);
+APP_EVQ(qLcd,    6);
+APP_EVQ(qBtNote, 8);
+APP_EVQ(qAudit,  8);
 
 lcd1602_HandleTypeDef hlcd;
-uint8_t gBtRxByte;         
 static volatile uint8_t gIsUnlocked = 0;
+static volatile TickType_t gLastTagTick = 0;   // NFC: last new tap (a card left on the reader does not count)
+static volatile TickType_t gLastKeyTick = 0;   // Keypad: last key press (NFC polls fast after it)
+static TaskHandle_t hNfcTask = NULL;
+
+/* 同一張卡一直放在讀卡機上：上次看到還不到這麼久就當作沒離開，不再處理 */
+#define NFC_REPEAT_MS   1500
 
 /* USER CODE END PV */
 
@@ -90,10 +137,13 @@ void vStateTask(void *argument);
 void vLcdTask(void *argument);
 void vKeypadTask(void *argument); 
 void vNfcTask(void *argument);  
+void vCardGcTask(void *argument);
+void vBtNotifyTask(void *argument);
+void vAuditTask(void *argument);
 
-carddb_status_t Nfc_AddCard(const uint8_t uid[5]);
-carddb_status_t Nfc_DeleteCard(const uint8_t uid[5]);
-bool           Nfc_IsAuthorized(const uint8_t uid[5]);
+carddb_status_t Nfc_AddCard(const card_uid_t *uid);
+carddb_status_t Nfc_DeleteCard(const card_uid_t *uid);
+bool           Nfc_IsAuthorized(const card_uid_t *uid);
 
 
 /* USER CODE END PFP */
@@ -122,78 +172,84 @@ MX_USART2_UART_Init();
 MX_USART3_UART_Init();
 
 /* USER CODE BEGIN 2 */
-const char *bootMsg = "System boot\r\n";
-HAL_UART_Transmit(&huart3, (uint8_t*)bootMsg, strlen(bootMsg), HAL_MAX_DELAY);
+dbg_log_init();
+LOG_INFO("System boot\r\n");
 
 MFRC522_Init();
 
 uint8_t ver = Read_MFRC522(VersionReg);
 uint8_t txc = Read_MFRC522(TxControlReg);
-char buf[64];
-int len = sprintf(buf,
-                  "RC522 Ver=0x%02X, TxControl=0x%02X\r\n",
-                  ver, txc);
-HAL_UART_Transmit(&huart3, (uint8_t*)buf, len, HAL_MAX_DELAY);
+LOG_INFO("RC522 Ver=0x%02X, TxControl=0x%02X\r\n", ver, txc);
 
 carddb_init();
 
 void debug_print_carddb_codes(void)
 {
-    char dbg[64];
-
-    sprintf(dbg, "CARDDB_OK=%d\r\n", (int)CARDDB_OK);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, strlen(dbg), HAL_MAX_DELAY);
-
-    sprintf(dbg, "CARDDB_ERR_FULL=%d\r\n", (int)CARDDB_ERR_FULL);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, strlen(dbg), HAL_MAX_DELAY);
-
-    sprintf(dbg, "CARDDB_ERR_FLASH=%d\r\n", (int)CARDDB_ERR_FLASH);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, strlen(dbg), HAL_MAX_DELAY);
-
-    sprintf(dbg, "CARDDB_ERR_NOT_FOUND=%d\r\n", (int)CARDDB_ERR_NOT_FOUND);
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg, strlen(dbg), HAL_MAX_DELAY);
+    LOG_DEBUG("CARDDB_OK=%d\r\n", (int)CARDDB_OK);
+    LOG_DEBUG("CARDDB_ERR_FULL=%d\r\n", (int)CARDDB_ERR_FULL);
+    LOG_DEBUG("CARDDB_ERR_FLASH=%d\r\n", (int)CARDDB_ERR_FLASH);
+    LOG_DEBUG("CARDDB_ERR_NOT_FOUND=%d\r\n", (int)CARDDB_ERR_NOT_FOUND);
+    LOG_DEBUG("CARDDB_ERR_UID=%d\r\n", (int)CARDDB_ERR_UID);
 }
 debug_print_carddb_codes();
-card_entry_t snapshot[CARD_DB_MAX_CARDS];
-int card_cnt = carddb_get_all(snapshot, CARD_DB_MAX_CARDS);
+int card_cnt = carddb_get_all(NULL, 0);   // count only, the table can be 10k+ cards
 
 if (card_cnt == 0)
 {
-    uint8_t defaultUid[5] = { 0x43, 0x0D, 0xD1, 0x13, 0x8C };
-    carddb_status_t st = Nfc_AddCard(defaultUid);
+    const card_uid_t defaultUid = { 4, { 0x43, 0x0D, 0xD1, 0x13 } };
+    carddb_status_t st = Nfc_AddCard(&defaultUid);
 
-    const char *msg;
     if (st == CARDDB_OK)
-        msg = "CardDB empty, add default card\r\n";
+        LOG_INFO("CardDB empty, add default card\r\n");
     else
-        msg = "CardDB empty, add default card FAILED\r\n";
-
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+        LOG_ERR("CardDB empty, add default card FAILED\r\n");
 }
 else
 {
-    const char *msg = "Whitelist loaded from CardDB\r\n";
-    HAL_UART_Transmit(&DBG_UART, (uint8_t*)msg, strlen(msg), HAL_MAX_DELAY);
+    LOG_INFO("Whitelist loaded from CardDB, cards=%d\r\n", card_cnt);
 }
 
-  xEventQueue = xQueueCreate(8,  sizeof(uint8_t));   
-  xLcdQ   = xQueueCreate(4,  sizeof(LcdMsg_t)); 
-  xBtRxQ  = xQueueCreate(32, sizeof(uint8_t));   
-
-  if (xEventQueue == NULL || xLcdQ == NULL || xBtRxQ == NULL)
+  qState  = APP_EVQ_CREATE(qState);
+  qLcd    = APP_EVQ_CREATE(qLcd);
+  qBtNote = APP_EVQ_CREATE(qBtNote);
+  qAudit  = APP_EVQ_CREATE(qAudit);
+
+  // 順序有意義：vStateTask 優先權最高、最先收到，它 publish 的 EV_STATE 會排在
+  // LCD / BT 收到原本那個事件之前 (例如 "UNLOCK" 之後才是 "NFC UNLOCK / AUTHORIZED")
+  if (!event_bus_subscribe(qState,
+                           EV_BIT(EV_UNLOCK_REQ) | EV_BIT(EV_LOCK_REQ) |
+                           EV_BIT(EV_MODE_REQ) | EV_BIT(EV_CARD_RESULT),
+                           portMAX_DELAY) ||
+      !event_bus_subscribe(qLcd,
+                           EV_BIT(EV_PIN_INPUT) | EV_BIT(EV_PIN_WRONG) | EV_BIT(EV_CARD_SEEN) |
+                           EV_BIT(EV_CARD_RESULT) | EV_BIT(EV_STATE) | EV_BIT(EV_MODE),
+                           0) ||
+      !event_bus_subscribe(qBtNote,
+                           EV_BIT(EV_PIN_WRONG) | EV_BIT(EV_CARD_RESULT) |
+                           EV_BIT(EV_STATE) | EV_BIT(EV_MODE),
+                           0) ||
+      !event_bus_subscribe(qAudit,
+                           EV_MASK_ALL & ~(EV_BIT(EV_PIN_INPUT) | EV_BIT(EV_CARD_SEEN)),
+                           0))
   {
-      const char *err = "Queue create failed!\r\n";
-      HAL_UART_Transmit(&huart3, (uint8_t*)err, strlen(err), HAL_MAX_DELAY);
+      LOG_ERR("Queue create failed!\r\n");
       Error_Handler();
   }
 
-  HAL_UART_Receive_DMA(&huart2, &gBtRxByte, 1);
+  bt_rx_start(&BT_UART);
+  bt_proto_init(&BT_UART, &gIsUnlocked);
+
+  keypad_init();
 
-  xTaskCreate(vBtTask,     "BT",     256, NULL, tskIDLE_PRIORITY + 2, NULL);
-  xTaskCreate(vKeypadTask, "KEYPAD", 256, NULL, tskIDLE_PRIORITY + 2, NULL);
-  xTaskCreate(vLcdTask,    "LCD",    256, NULL, tskIDLE_PRIORITY + 1, NULL);
-  xTaskCreate(vStateTask,  "STATE",  256, NULL, tskIDLE_PRIORITY + 3, NULL);
-  xTaskCreate(vNfcTask,    "NFC",    256, NULL, tskIDLE_PRIORITY + 2, NULL);
+  APP_TASK_CREATE(vBtTask,       bt,     "BT",     tskIDLE_PRIORITY + 2);
+  APP_TASK_CREATE(vKeypadTask,   keypad, "KEYPAD", tskIDLE_PRIORITY + 2);
+  APP_TASK_CREATE(vLcdTask,      lcd,    "LCD",    tskIDLE_PRIORITY + 1);
+  APP_TASK_CREATE(vStateTask,    state,  "STATE",  tskIDLE_PRIORITY + 3);
+  hNfcTask = APP_TASK_CREATE(vNfcTask, nfc, "NFC", tskIDLE_PRIORITY + 2);
+  APP_TASK_CREATE(vCardGcTask,   cardgc, "CARDGC", tskIDLE_PRIORITY);
+  APP_TASK_CREATE(vBtNotifyTask, btnote, "BTNOTE", tskIDLE_PRIORITY + 1);
+  APP_TASK_CREATE(vAuditTask,    audit,  "AUDIT",  tskIDLE_PRIORITY + 1);
+  dbg_log_start_task();
 
   vTaskStartScheduler();
 
@@ -255,17 +311,38 @@ void SystemClock_Config(void)
 const char unlockPin[PIN_LEN + 1] = "1234";
 const char lockPin[PIN_LEN + 1]   = "0000";
 
-carddb_status_t Nfc_AddCard(const uint8_t uid[5])
+static const char kBtPrompt[] = "Enter 4-digit code:\r\n";
+
+// EV_CARD_RESULT → 藍牙通知 / LCD 兩行
+typedef struct {
+    const char *bt;
+    const char *line1;
+    const char *line2;
+} CardResultText_t;
+
+static const CardResultText_t kCardText[CARD_RESULT_COUNT] = {
+    [CARD_AUTH_OK]       = { "NFC AUTH UNLOCK\r\n",        "NFC UNLOCK",   "AUTHORIZED"    },
+    [CARD_AUTH_DENIED]   = { "NFC UNKNOWN CARD\r\n",       "CARD DENIED",  "NOT AUTH"      },
+    [CARD_ADD_OK]        = { "ADD CARD OK\r\n",            "CARD SAVED",   "UID ADDED"     },
+    [CARD_ADD_FULL]      = { "ADD FAIL: FLASH FULL\r\n",   "ADD FAIL",     "FLASH FULL"    },
+    [CARD_ADD_ERR]       = { "ADD FAIL: FLASH ERR\r\n",    "ADD FAIL",     "FLASH ERR"     },
+    [CARD_DEL_OK]        = { "DELETE OK\r\n",              "CARD DELETED", "SUCCESS"       },
+    [CARD_DEL_NOT_FOUND] = { "DELETE FAIL\r\n",            "DELETE FAIL",  "NOT FOUND"     },
+    [CARD_DEL_ERR]       = { "DELETE FAIL: FLASH ERR\r\n", "DELETE FAIL",  "FLASH ERR"     },
+    [CARD_MULTI]         = { "ONE CARD ONLY\r\n",          "CARDS SEEN",   "ONE CARD ONLY" },
+};
+
+carddb_status_t Nfc_AddCard(const card_uid_t *uid)
 {
     return carddb_add(uid);
 }
 
-carddb_status_t Nfc_DeleteCard(const uint8_t uid[5])
+carddb_status_t Nfc_DeleteCard(const card_uid_t *uid)
 {
     return carddb_remove(uid);
 }
 
-bool Nfc_IsAuthorized(const uint8_t uid[5])
+bool Nfc_IsAuthorized(const card_uid_t *uid)
 {
     return (carddb_check(uid) != 0);
 }
@@ -274,8 +351,8 @@ void RC522_TestLoop(void)
 {
     uint8_t status;
     uint8_t atqa[2];
-    uint8_t uid[5];
-    char    msg[100];
+    uint8_t sak;
+    card_uid_t uid;
 
     while (1)
     {
@@ -283,90 +360,58 @@ void RC522_TestLoop(void)
 
         if (status == MI_OK)
         {
-            status = MFRC522_Anticoll(uid);
+            status = MFRC522_ReadUid(uid.uid, &uid.len, &sak);
             if (status == MI_OK)
             {
-                int len = sprintf(msg,
-                    "Card! ATQA=%02X %02X, UID=%02X %02X %02X %02X %02X\r\n",
-                    atqa[0], atqa[1],
-                    uid[0], uid[1], uid[2], uid[3], uid[4]);
-                HAL_UART_Transmit(&huart3, (uint8_t*)msg, len, HAL_MAX_DELAY);
+                LOG_INFO("Card! ATQA=%02X %02X, SAK=%02X, len=%d, UID=%02X %02X %02X %02X..\r\n",
+                         atqa[0], atqa[1], sak, uid.len,
+                         uid.uid[0], uid.uid[1], uid.uid[2], uid.uid[3]);
 
                 HAL_Delay(500);
             }
             else
             {
-                int len = sprintf(msg, "Anticoll failed, status=%d\r\n", status);
-                HAL_UART_Transmit(&huart3, (uint8_t*)msg, len, HAL_MAX_DELAY);
+                LOG_WARN("Anticoll failed, status=%d\r\n", status);
             }
         }
         else
         {
-            int len = sprintf(msg, "No card, status=%d\r\n", status);
-            HAL_UART_Transmit(&huart3, (uint8_t*)msg, len, HAL_MAX_DELAY);
+            LOG_DEBUG("No card, status=%d\r\n", status);
             HAL_Delay(500);
         }
     }
 }
 
-static char read_keypad(void)
-{
-    static const char keys[4][4] = {
-        {'1','2','3','A'},
-        {'4','5','6','B'},
-        {'7','8','9','C'},
-        {'*','0','#','D'}
-    };
-
-    for (int col = 0; col < 4; col++)
-    {
-        HAL_GPIO_WritePin(GPIOE, GPIO_PIN_11, (col == 0) ? GPIO_PIN_RESET : GPIO_PIN_SET);
-        HAL_GPIO_WritePin(GPIOE, GPIO_PIN_12, (col == 1) ? GPIO_PIN_RESET : GPIO_PIN_SET);
-        HAL_GPIO_WritePin(GPIOE, GPIO_PIN_13, (col == 2) ? GPIO_PIN_RESET : GPIO_PIN_SET);
-        HAL_GPIO_WritePin(GPIOE, GPIO_PIN_14, (col == 3) ? GPIO_PIN_RESET : GPIO_PIN_SET);
-
-        vTaskDelay(pdMS_TO_TICKS(3));
-
-        if (HAL_GPIO_ReadPin(GPIOE, GPIO_PIN_7) == GPIO_PIN_RESET)  return keys[0][col];
-        if (HAL_GPIO_ReadPin(GPIOE, GPIO_PIN_8) == GPIO_PIN_RESET)  return keys[1][col];
-        if (HAL_GPIO_ReadPin(GPIOE, GPIO_PIN_9) == GPIO_PIN_RESET)  return keys[2][col];
-        if (HAL_GPIO_ReadPin(GPIOE, GPIO_PIN_10) == GPIO_PIN_RESET) return keys[3][col];
-    }
-
-    return '\0'; 
-}
-
 void vKeypadTask(void *argument)
 {
     char pinBuf[PIN_LEN + 1];
     uint8_t idx = 0;
     char key;
-    char lastKey = '\0';      
-    LcdMsg_t msg;
-
-    snprintf(msg.line1, sizeof(msg.line1), "LOCKED");
-    snprintf(msg.line2, sizeof(msg.line2), "PIN: ----");
-    xQueueSend(xLcdQ, &msg, 0);
+    keypad_event_t ev;
 
     for (;;)
     {
-        char curKey = read_keypad();
-
-        if (curKey == '\0')
+        // 沒按鍵就一直睡，掃描 / 去彈跳都在 keypad driver (EXTI + timer + keypad_fsm)
+        if (keypad_get(&ev, portMAX_DELAY) != pdTRUE)
         {
-            lastKey = '\0';
-            vTaskDelay(pdMS_TO_TICKS(20));
             continue;
         }
 
-        if (curKey == lastKey)
+        LOG_DEBUG("KEY: ev=%d key=%c tick=%u\r\n", ev.type, ev.key, (unsigned)ev.tick);
+
+        // 有人在門口，NFC 馬上回到快速輪詢
+        gLastKeyTick = xTaskGetTickCount();
+        if (hNfcTask != NULL)
         {
-            vTaskDelay(pdMS_TO_TICKS(20));
-            continue;
+            xTaskNotifyGive(hNfcTask);
         }
 
-        lastKey = curKey;
-        key = curKey;
+        // PIN / 模式只看按下；兩個鍵一起按 (或前一個還沒放開) 各自有自己的 PRESS
+        if (ev.type != KEYPAD_EV_PRESS)
+        {
+            continue;
+        }
+        key = ev.key;
 
         if (key >= '0' && key <= '9')
         {
@@ -379,343 +424,213 @@ void vKeypadTask(void *argument)
         {
             idx = 0;
         }
-        else if (key == 'A')
+        else if (key == 'A' || key == 'B')
         {
-            if (!gIsUnlocked)
-            {
-                snprintf(msg.line1, sizeof(msg.line1), "LOCKED");
-                snprintf(msg.line2, sizeof(msg.line2), "UNLOCK FIRST");
-                xQueueSend(xLcdQ, &msg, 0);
-
-                const char *btmsg = "DENY ADD: LOCKED\r\n";
-                HAL_UART_Transmit(&BT_UART, (uint8_t *)btmsg, strlen(btmsg), HAL_MAX_DELAY);
-
-                vTaskDelay(pdMS_TO_TICKS(800));
-                snprintf(msg.line1, sizeof(msg.line1), "LOCKED");
-                snprintf(msg.line2, sizeof(msg.line2), "PIN: ----");
-                xQueueSend(xLcdQ, &msg, 0);
-                continue;
-            }
-
-            gNfcMode = NFC_MODE_ADD_CARD;
-
-            snprintf(msg.line1, sizeof(msg.line1), "ADD CARD MODE");
-            snprintf(msg.line2, sizeof(msg.line2), "TAP CARD...");
-            xQueueSend(xLcdQ, &msg, 0);
-
-            const char *btmsg = "ENTER ADD CARD MODE\r\n";
-            HAL_UART_Transmit(&BT_UART, (uint8_t *)btmsg, strlen(btmsg), HAL_MAX_DELAY);
-
+            // 鎖著能不能進模式由 vStateTask 決定，結果是 EV_MODE
+            event_bus_post(EV_MODE_REQ, EV_SRC_KEYPAD,
+                           (key == 'A') ? NFC_MODE_ADD_CARD : NFC_MODE_DELETE_CARD);
             idx = 0;
             continue;
         }
-
-        else if (key == 'B')
-        {
-            if (!gIsUnlocked)
-            {
-                snprintf(msg.line1, sizeof(msg.line1), "LOCKED");
-                snprintf(msg.line2, sizeof(msg.line2), "UNLOCK FIRST");
-                xQueueSend(xLcdQ, &msg, 0);
-
-                const char *btmsg = "DENY DELETE: LOCKED\r\n";
-                HAL_UART_Transmit(&BT_UART, (uint8_t *)btmsg, strlen(btmsg), HAL_MAX_DELAY);
-
-                vTaskDelay(pdMS_TO_TICKS(800));
-                snprintf(msg.line1, sizeof(msg.line1), "LOCKED");
-                snprintf(msg.line2, sizeof(msg.line2), "PIN: ----");
-                xQueueSend(xLcdQ, &msg, 0);
-                continue;
-            }
-
-            gNfcMode = NFC_MODE_DELETE_CARD;
-
-            snprintf(msg.line1, sizeof(msg.line1), "DEL CARD MODE");
-            snprintf(msg.line2, sizeof(msg.line2), "TAP CARD...");
-            xQueueSend(xLcdQ, &msg, 0);
-
-            const char *btmsg = "ENTER DELETE CARD MODE\r\n";
-            HAL_UART_Transmit(&BT_UART, (uint8_t*)btmsg, strlen(btmsg), HAL_MAX_DELAY);
-
-            idx = 0;
-            continue;
-        }
-
         else if (key == 'C')
         {
-            if (gIsUnlocked)   
-            {
-                gNfcMode = NFC_MODE_NORMAL;
-
-                uint8_t evt = '0';
-                xQueueSend(xEventQueue, &evt, portMAX_DELAY);
-
-                const char *btmsg = "KEYPAD C -> LOCK\r\n";
-                HAL_UART_Transmit(&BT_UART, (uint8_t*)btmsg, strlen(btmsg), HAL_MAX_DELAY);
-
-                idx = 0;
-                vTaskDelay(pdMS_TO_TICKS(200));
-            }
-            else
-            {
-                snprintf(msg.line1, sizeof(msg.line1), "ALREADY LOCK");
-                snprintf(msg.line2, sizeof(msg.line2), "PIN: ----");
-                xQueueSend(xLcdQ, &msg, 0);
-                vTaskDelay(pdMS_TO_TICKS(500));
-            }
-
+            event_bus_post(EV_LOCK_REQ, EV_SRC_KEYPAD, 0);
+            idx = 0;
             continue;
         }
         else if (key == '#')
         {
             pinBuf[idx] = '\0';
 
-            uint8_t evt;
             if (idx == PIN_LEN && strncmp(pinBuf, unlockPin, PIN_LEN) == 0)
             {
-                evt = '1'; // UNLOCK
-                xQueueSend(xEventQueue, &evt, portMAX_DELAY);
-
-                const char *btmsg = "KEYPAD UNLOCK\r\n";
-                HAL_UART_Transmit(&BT_UART, (uint8_t *)btmsg, strlen(btmsg), HAL_MAX_DELAY);
-
-                snprintf(msg.line1, sizeof(msg.line1), "UNLOCK");
-                snprintf(msg.line2, sizeof(msg.line2), "PIN OK");
-                xQueueSend(xLcdQ, &msg, 0);
-
-                idx = 0;
-                vTaskDelay(pdMS_TO_TICKS(200));
+                event_bus_post(EV_UNLOCK_REQ, EV_SRC_KEYPAD, 0);
             }
             else if (idx == PIN_LEN && strncmp(pinBuf, lockPin, PIN_LEN) == 0)
             {
-                evt = '0'; // LOCK
-                xQueueSend(xEventQueue, &evt, portMAX_DELAY);
-
-                const char *btmsg = "KEYPAD LOCK\r\n";
-                HAL_UART_Transmit(&BT_UART, (uint8_t *)btmsg, strlen(btmsg), HAL_MAX_DELAY);
-
-                snprintf(msg.line1, sizeof(msg.line1), "LOCK");
-                snprintf(msg.line2, sizeof(msg.line2), "PIN OK");
-                xQueueSend(xLcdQ, &msg, 0);
-
-                idx = 0;
-                vTaskDelay(pdMS_TO_TICKS(200));
+                event_bus_post(EV_LOCK_REQ, EV_SRC_KEYPAD, 0);
             }
             else
             {
-                const char *btmsg = "KEYPAD WRONG PIN\r\n";
-                HAL_UART_Transmit(&BT_UART, (uint8_t *)btmsg, strlen(btmsg), HAL_MAX_DELAY);
-
-                snprintf(msg.line1, sizeof(msg.line1), "WRONG PIN");
-                snprintf(msg.line2, sizeof(msg.line2), "TRY AGAIN");
-                xQueueSend(xLcdQ, &msg, 0);
-
-                idx = 0;
-                vTaskDelay(pdMS_TO_TICKS(500));
-                snprintf(msg.line1, sizeof(msg.line1), "LOCKED");
-                snprintf(msg.line2, sizeof(msg.line2), "PIN: ----");
-                xQueueSend(xLcdQ, &msg, 0);
+                event_bus_post(EV_PIN_WRONG, EV_SRC_KEYPAD, 0);
             }
 
+            idx = 0;
             continue;
         }
 
-        memset(msg.line1, ' ', sizeof(msg.line1));
-        memset(msg.line2, ' ', sizeof(msg.line2));
-        snprintf(msg.line1, sizeof(msg.line1), "LOCKED");
-        snprintf(msg.line2, sizeof(msg.line2), "PIN: ");
-
-        for (int i = 0; i < idx && i < PIN_LEN; i++)
-        {
-            msg.line2[5 + i] = '*';
-        }
-        msg.line2[5 + PIN_LEN] = '\0';
-
-        xQueueSend(xLcdQ, &msg, 0);
+        event_bus_post(EV_PIN_INPUT, EV_SRC_KEYPAD, idx);
     }
 }
 
+static void Nfc_Publish(uint8_t type, uint8_t code, const card_uid_t *uid, uint8_t ncards)
+{
+    app_event_t ev;
+
+    ev.type   = type;
+    ev.source = EV_SRC_NFC;
+    ev.code   = code;
+    ev.arg    = ncards;
+    ev.uid    = *uid;
+    event_bus_publish(&ev);
+}
+
 void vNfcTask(void *argument)
 {
     uint8_t status;
     uint8_t tagType[2] = {0};
-    uint8_t uid[5]     = {0};
-    LcdMsg_t msg;
-    char dbg[80];
+    uint8_t ncards     = 0;
+    rc522_uid_t cards[MFRC522_MAX_CARDS];
+    card_uid_t uid     = {0};
+    card_uid_t lastUid = {0};
+    TickType_t lastSeen = 0;
+    uint8_t newTap;
+    nfc_poll_t poll;
 
-    HAL_UART_Transmit(&DBG_UART,
-                      (uint8_t *)"NFC TASK START\r\n",
-                      strlen("NFC TASK START\r\n"),
-                      HAL_MAX_DELAY);
+    LOG_INFO("NFC TASK START\r\n");
+    nfc_poll_init(&poll, xTaskGetTickCount() * portTICK_PERIOD_MS);
 
     for (;;)
     {
         // heart beat debug
-        HAL_UART_Transmit(&DBG_UART,
-                          (uint8_t *)"NFC: loop...\r\n",
-                          strlen("NFC: loop...\r\n"),
-                          HAL_MAX_DELAY);
+        LOG_DEBUG("NFC: loop...\r\n");
+        newTap = 0;
 
-        // 1) scan
+        // 1) scan: 天線只在這裡開，沒卡時 REQA 等 2 ms 就放棄
+        MFRC522_SoftPowerUp();
+        MFRC522_SetTimeout(MFRC522_POLL_TIMEOUT_MS);
         status = MFRC522_Request(PICC_REQIDL, tagType);
+        MFRC522_SetTimeout(MFRC522_TIMEOUT_MS);
 
         // print status 
-        int len = sprintf(dbg, "NFC: Request status=%d\r\n", status);
-        HAL_UART_Transmit(&DBG_UART, (uint8_t *)dbg, len, HAL_MAX_DELAY);
+        LOG_DEBUG("NFC: Request status=%d\r\n", status);
 
         if (status == MI_OK)
         {
-            len = sprintf(dbg,
-                          "NFC: Card detected, ATQA=%02X %02X\r\n",
-                          tagType[0], tagType[1]);
-            HAL_UART_Transmit(&DBG_UART, (uint8_t *)dbg, len, HAL_MAX_DELAY);
+            LOG_DEBUG("NFC: Card detected, ATQA=%02X %02X\r\n",
+                      tagType[0], tagType[1]);
 
-            status = MFRC522_Anticoll(uid);
+            // 4 / 7 / 10 byte UID 都走 cascade；好幾張卡疊在一起時這次 poll 全部列出來
+            ncards = MFRC522_ReadAllUids(cards, MFRC522_MAX_CARDS);
+            status = (ncards > 0) ? MI_OK : MI_ERR;
+            MFRC522_SoftPowerDown();    // 後面開門 / 寫 Flash / 畫面停留都不需要天線
 
-            len = sprintf(dbg, "NFC: Anticoll status=%d\r\n", status);
-            HAL_UART_Transmit(&DBG_UART, (uint8_t *)dbg, len, HAL_MAX_DELAY);
+            LOG_DEBUG("NFC: Anticoll status=%d cards=%d\r\n", status, ncards);
 
             if (status == MI_OK)
             {
-                len = sprintf(dbg,
-                              "NFC: UID=%02X %02X %02X %02X %02X\r\n",
-                              uid[0], uid[1], uid[2], uid[3], uid[4]);
-                HAL_UART_Transmit(&DBG_UART, (uint8_t *)dbg, len, HAL_MAX_DELAY);
-
-                snprintf(msg.line1, sizeof(msg.line1), "CARD DETECTED");
-                snprintf(msg.line2, sizeof(msg.line2),
-                         "%02X%02X%02X%02X",
-                         uid[0], uid[1], uid[2], uid[3]);
-                xQueueSend(xLcdQ, &msg, 0);
-
-                if (gNfcMode == NFC_MODE_ADD_CARD)
+                NfcMode_t mode = gNfcMode;
+
+                // 一般模式挑第一張有授權的卡，都沒有就用第一張
+                uint8_t pick = 0;
+                for (uint8_t i = 0; i < ncards; i++)
+                {
+                    uid.len = cards[i].len;
+                    memcpy(uid.uid, cards[i].uid, cards[i].len);
+                    if (mode == NFC_MODE_NORMAL && Nfc_IsAuthorized(&uid))
+                    {
+                        pick = i;
+                        break;
+                    }
+                }
+                uid.len = cards[pick].len;
+                memcpy(uid.uid, cards[pick].uid, cards[pick].len);
+
+                LOG_INFO("NFC: UID len=%d SAK=%02X %02X %02X %02X %02X %02X %02X %02X.. (%d/%d)\r\n",
+                         uid.len, cards[pick].sak,
+                         uid.uid[0], uid.uid[1], uid.uid[2], uid.uid[3],
+                         uid.uid[4], uid.uid[5], uid.uid[6], pick + 1, ncards);
+
+                // poll 之間天線是關的，放著不動的卡 (HALT 也沒用) 每次都會再被讀到
+                TickType_t nowTick = xTaskGetTickCount();
+                bool repeat = (uid.len == lastUid.len) &&
+                              (memcmp(uid.uid, lastUid.uid, uid.len) == 0) &&
+                              (nowTick - lastSeen) < pdMS_TO_TICKS(NFC_REPEAT_MS);
+                lastUid  = uid;
+                lastSeen = nowTick;
+                newTap   = !repeat;
+
+                // 放著不動的卡每次 poll 都會回 REQA，只有新刷的卡才算「有人在用」
+                // (不然背景 GC 的 sector erase 永遠等不到 quiet)
+                if (newTap)
                 {
-                    HAL_UART_Transmit(&DBG_UART,
-                                    (uint8_t *)"NFC: ADD_CARD mode\r\n",
-                                    strlen("NFC: ADD_CARD mode\r\n"),
-                                    HAL_MAX_DELAY);
+                    gLastTagTick = nowTick;
+                }
 
-                    carddb_status_t st = Nfc_AddCard(uid);
-                    
+                if (!repeat)
+                {
+                    Nfc_Publish(EV_CARD_SEEN, 0, &uid, ncards);
+                }
+
+                // 模式只有 vStateTask 在改：結果 publish 出去，它會把模式切回 NORMAL
+                if (repeat)
+                {
+                    LOG_DEBUG("NFC: same card still there\r\n");
+                }
+                else if (ncards > 1 && mode != NFC_MODE_NORMAL)
+                {
+                    // 新增 / 刪除不知道要哪一張，模式保留，請使用者只拿一張再刷
+                    Nfc_Publish(EV_CARD_RESULT, CARD_MULTI, &uid, ncards);
+                    vTaskDelay(pdMS_TO_TICKS(800));
+                }
+                else if (mode == NFC_MODE_ADD_CARD)
+                {
+                    LOG_DEBUG("NFC: ADD_CARD mode\r\n");
+
+                    carddb_status_t st = Nfc_AddCard(&uid);
+                    uint8_t res;
 
                     if (st == CARDDB_OK)
                     {
-                        const char *btmsg = "ADD CARD OK\r\n";
-                        HAL_UART_Transmit(&BT_UART,
-                                        (uint8_t *)btmsg,
-                                        strlen(btmsg),
-                                        HAL_MAX_DELAY);
-
-                        snprintf(msg.line1, sizeof(msg.line1), "CARD SAVED");
-                        snprintf(msg.line2, sizeof(msg.line2), "UID ADDED");
-                        xQueueSend(xLcdQ, &msg, 0);
+                        res = CARD_ADD_OK;
                     }
                     else if (st == CARDDB_ERR_FULL)
                     {
-                        const char *btmsg = "ADD FAIL: FLASH FULL\r\n";
-                        HAL_UART_Transmit(&BT_UART,
-                                        (uint8_t *)btmsg,
-                                        strlen(btmsg),
-                                        HAL_MAX_DELAY);
-
-                        snprintf(msg.line1, sizeof(msg.line1), "ADD FAIL");
-                        snprintf(msg.line2, sizeof(msg.line2), "FLASH FULL");
-                        xQueueSend(xLcdQ, &msg, 0);
+                        res = CARD_ADD_FULL;
                     }
                     else
                     {
-                        char dbg2[64];
-                        int len2 = sprintf(dbg2, "ADD ERR, st=%d\r\n", (int)st);
-                        HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg2, len2, HAL_MAX_DELAY);
-                        const char *btmsg = "ADD FAIL: FLASH ERR\r\n";
-                        HAL_UART_Transmit(&BT_UART,
-                                        (uint8_t *)btmsg,
-                                        strlen(btmsg),
-                                        HAL_MAX_DELAY);
-
-                        snprintf(msg.line1, sizeof(msg.line1), "ADD FAIL");
-                        snprintf(msg.line2, sizeof(msg.line2), "FLASH ERR");
-                        xQueueSend(xLcdQ, &msg, 0);
+                        LOG_ERR("ADD ERR, st=%d\r\n", (int)st);
+                        res = CARD_ADD_ERR;
                     }
 
-                    gNfcMode = NFC_MODE_NORMAL;
+                    Nfc_Publish(EV_CARD_RESULT, res, &uid, ncards);
                     vTaskDelay(pdMS_TO_TICKS(1000));
                 }
 
-                else if (gNfcMode == NFC_MODE_DELETE_CARD)
+                else if (mode == NFC_MODE_DELETE_CARD)
                 {
-                    HAL_UART_Transmit(&DBG_UART,
-                                    (uint8_t *)"NFC: DELETE_CARD mode\r\n",
-                                    strlen("NFC: DELETE_CARD mode\r\n"),
-                                    HAL_MAX_DELAY);
+                    LOG_DEBUG("NFC: DELETE_CARD mode\r\n");
 
-                carddb_status_t st = Nfc_DeleteCard(uid);
+                    carddb_status_t st = Nfc_DeleteCard(&uid);
+                    uint8_t res;
 
-                if (st == CARDDB_OK)
-                {
-                    const char *btmsg = "DELETE OK\r\n";
-                    HAL_UART_Transmit(&BT_UART,
-                                    (uint8_t *)btmsg,
-                                    strlen(btmsg),
-                                    HAL_MAX_DELAY);
-
-                    snprintf(msg.line1, sizeof(msg.line1), "CARD DELETED");
-                    snprintf(msg.line2, sizeof(msg.line2), "SUCCESS");
-                    xQueueSend(xLcdQ, &msg, 0);
-                }
-                else if (st == CARDDB_ERR_NOT_FOUND)
-                {
-                    const char *btmsg = "DELETE FAIL\r\n";
-                    HAL_UART_Transmit(&BT_UART,
-                                    (uint8_t *)btmsg,
-                                    strlen(btmsg),
-                                    HAL_MAX_DELAY);
-
-                    snprintf(msg.line1, sizeof(msg.line1), "DELETE FAIL");
-                    snprintf(msg.line2, sizeof(msg.line2), "NOT FOUND");
-                    xQueueSend(xLcdQ, &msg, 0);
-                }
-                else
-                {
-                    char dbg2[64];
-                    int len2 = sprintf(dbg2, "DEL ERR, st=%d\r\n", (int)st);
-                    HAL_UART_Transmit(&DBG_UART, (uint8_t*)dbg2, len2, HAL_MAX_DELAY);
-                    const char *btmsg = "DELETE FAIL: FLASH ERR\r\n";
-                    HAL_UART_Transmit(&BT_UART,
-                                    (uint8_t *)btmsg,
-                                    strlen(btmsg),
-                                    HAL_MAX_DELAY);
-
-                    snprintf(msg.line1, sizeof(msg.line1), "DELETE FAIL");
-                    snprintf(msg.line2, sizeof(msg.line2), "FLASH ERR");
-                    xQueueSend(xLcdQ, &msg, 0);
-                }
+                    if (st == CARDDB_OK)
+                    {
+                        res = CARD_DEL_OK;
+                    }
+                    else if (st == CARDDB_ERR_NOT_FOUND)
+                    {
+                        res = CARD_DEL_NOT_FOUND;
+                    }
+                    else
+                    {
+                        LOG_ERR("DEL ERR, st=%d\r\n", (int)st);
+                        res = CARD_DEL_ERR;
+                    }
 
-                    gNfcMode = NFC_MODE_NORMAL;
+                    Nfc_Publish(EV_CARD_RESULT, res, &uid, ncards);
                     vTaskDelay(pdMS_TO_TICKS(800));
                 }
 
                 else
                 {
-                    HAL_UART_Transmit(&DBG_UART,
-                                      (uint8_t *)"NFC: NORMAL mode\r\n",
-                                      strlen("NFC: NORMAL mode\r\n"),
-                                      HAL_MAX_DELAY);
+                    LOG_DEBUG("NFC: NORMAL mode\r\n");
 
-                    if (Nfc_IsAuthorized(uid))
+                    if (Nfc_IsAuthorized(&uid))
                     {
-                        uint8_t evt = '1';
-                        xQueueSend(xEventQueue, &evt, 0);
-
-                        const char *btmsg = "NFC AUTH UNLOCK\r\n";
-                        HAL_UART_Transmit(&BT_UART,
-                                          (uint8_t *)btmsg,
-                                          strlen(btmsg),
-                                          HAL_MAX_DELAY);
-
-                        snprintf(msg.line1, sizeof(msg.line1), "NFC UNLOCK");
-                        snprintf(msg.line2, sizeof(msg.line2), "AUTHORIZED");
-                        xQueueSend(xLcdQ, &msg, 0);
+                        // vStateTask 收到 CARD_AUTH_OK 就開鎖
+                        Nfc_Publish(EV_CARD_RESULT, CARD_AUTH_OK, &uid, ncards);
 
                         HAL_GPIO_TogglePin(GPIOD, LD6_Pin);
                         vTaskDelay(pdMS_TO_TICKS(150));
@@ -725,50 +640,87 @@ void vNfcTask(void *argument)
                     }
                     else
                     {
-                        const char *btmsg = "NFC UNKNOWN CARD\r\n";
-                        HAL_UART_Transmit(&BT_UART,
-                                          (uint8_t *)btmsg,
-                                          strlen(btmsg),
-                                          HAL_MAX_DELAY);
-
-                        snprintf(msg.line1, sizeof(msg.line1), "CARD DENIED");
-                        snprintf(msg.line2, sizeof(msg.line2), "NOT AUTH");
-                        xQueueSend(xLcdQ, &msg, 0);
-
+                        Nfc_Publish(EV_CARD_RESULT, CARD_AUTH_DENIED, &uid, ncards);
                         vTaskDelay(pdMS_TO_TICKS(800));
                     }
                 }
             }
             else
             {
-                int len2 = sprintf(dbg,
-                                   "NFC: Anticoll failed, status=%d\r\n",
-                                   status);
-                HAL_UART_Transmit(&DBG_UART, (uint8_t *)dbg, len2, HAL_MAX_DELAY);
+                LOG_WARN("NFC: Anticoll failed, status=%d\r\n", status);
 
-                vTaskDelay(pdMS_TO_TICKS(300));
+                newTap = 1;     // 有卡只是沒讀好，快點再試
+                gLastTagTick = xTaskGetTickCount();
             }
         }
-        else
-        {
-            vTaskDelay(pdMS_TO_TICKS(300));
-        }
+
+        // 2) 天線關掉，睡到下一次 poll (按鍵會 xTaskNotifyGive 提早叫醒)
+        MFRC522_SoftPowerDown();
+        nfc_poll_activity(&poll, gLastKeyTick * portTICK_PERIOD_MS);
+        uint32_t sleepMs = nfc_poll_next(&poll, xTaskGetTickCount() * portTICK_PERIOD_MS, newTap);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepMs));
+    }
+}
+
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+    if (huart == &BT_UART)
+    {
+        bt_rx_event_isr(huart, Size);
     }
 }
 
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
-    if (huart == &huart2)
+    if (huart == &BT_UART)
+    {
+        bt_rx_error_isr(huart);
+    }
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+    if (huart == &DBG_UART)
+    {
+        dbg_log_tx_cplt_isr();
+    }
+}
+
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+    if (GPIO_Pin == MFRC522_IRQ_PIN)
+    {
+        MFRC522_IrqHandler();
+    }
+    else
     {
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        keypad_exti_isr(GPIO_Pin);
+    }
+}
 
-        HAL_GPIO_TogglePin(GPIOD, LD4_Pin);
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+    lcd_port_tx_cplt_isr(hi2c);
+}
 
-        xQueueSendFromISR(xBtRxQ, &gBtRxByte, &xHigherPriorityTaskWoken);
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+    lcd_port_error_isr(hi2c);
+}
 
-        HAL_UART_Receive_DMA(&huart2, &gBtRxByte, 1);
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+    if (hspi == HSPI_INSTANCE)
+    {
+        MFRC522_SpiCpltHandler();
+    }
+}
 
-        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+    if (hspi == HSPI_INSTANCE)
+    {
+        MFRC522_SpiCpltHandler();
     }
 }
 
@@ -798,26 +750,39 @@ void I2C_ScanBus(void)
                       HAL_MAX_DELAY);
 }
 
+// 從 bt_rx 一次拿一整段，再一個一個 byte 交給下面的解析
+static uint8_t Bt_GetChar(void)
+{
+    static uint8_t  chunk[32];
+    static uint32_t len = 0, pos = 0;
+
+    while (pos >= len)
+    {
+        len = bt_rx_read(chunk, sizeof(chunk), HAL_MAX_DELAY);
+        pos = 0;
+    }
+    return chunk[pos++];
+}
+
 void vBtTask(void *argument)
 {
     char    pinBuf[PIN_LEN + 1];
     uint8_t ch;
     int     idx;
 
-    const char *hello  = "HC-05 ready\r\n";
-    const char *prompt = "Enter 4-digit code:\r\n";
-
-    HAL_UART_Transmit(&BT_UART, (uint8_t *)hello,  strlen(hello),  HAL_MAX_DELAY);
-    HAL_UART_Transmit(&BT_UART, (uint8_t *)prompt, strlen(prompt), HAL_MAX_DELAY);
-
     for (;;)
     {
         idx = 0;
 
         while (1)
         {
-            if (xQueueReceive(xBtRxQ, &ch, portMAX_DELAY) != pdPASS)
+            ch = Bt_GetChar();
+
+            // 0xA5 開頭的 binary 指令 frame (批次加卡 / 匯出 / 狀態) 整個交給 bt_proto
+            if (bt_proto_input(ch, HAL_GetTick()))
+            {
                 continue;
+            }
 
             if (ch == '\r' || ch == '\n')
             {
@@ -838,123 +803,397 @@ void vBtTask(void *argument)
 
         pinBuf[idx] = '\0';
 
+        // 回覆的文字 (UNLOCK / LOCK / WRONG + prompt) 由 vBtNotifyTask 送
         if (idx == PIN_LEN && strncmp(pinBuf, unlockPin, PIN_LEN) == 0)
         {
-            uint8_t evt = '1';
-            xQueueSend(xEventQueue, &evt, portMAX_DELAY);
-
+            event_bus_post(EV_UNLOCK_REQ, EV_SRC_BT, 0);
         }
         else if (idx == PIN_LEN && strncmp(pinBuf, lockPin, PIN_LEN) == 0)
         {
-            uint8_t evt = '0';
-            xQueueSend(xEventQueue, &evt, portMAX_DELAY);
-
-            HAL_UART_Transmit(&BT_UART,
-                              (uint8_t *)prompt,
-                              strlen(prompt),
-                              HAL_MAX_DELAY);
+            event_bus_post(EV_LOCK_REQ, EV_SRC_BT, 0);
         }
         else
         {
-            HAL_UART_Transmit(&BT_UART,
-                              (uint8_t *)"WRONG\r\n",
-                              strlen("WRONG\r\n"),
-                              HAL_MAX_DELAY);
+            event_bus_post(EV_PIN_WRONG, EV_SRC_BT, 0);
+        }
+    }
+}
+
+static void Bt_Send(const char *s)
+{
+    bt_proto_write((const uint8_t *)s, (uint16_t)strlen(s));
+}
+
+// 藍牙文字通知：只有這個 task (優先權最低的一群) 會等 UART 慢慢送，
+// keypad / NFC / state 丟完事件就回去做自己的事。bt_proto 的 binary response 還是 vBtTask 自己回，
+// 兩邊都經過 bt_proto_write 的 mutex
+void vBtNotifyTask(void *argument)
+{
+    app_event_t ev;
+
+    Bt_Send("HC-05 ready\r\n");
+    Bt_Send(kBtPrompt);
+
+    for (;;)
+    {
+        if (xQueueReceive(qBtNote, &ev, portMAX_DELAY) != pdPASS)
+        {
+            continue;
+        }
+
+        switch (ev.type)
+        {
+        case EV_PIN_WRONG:
+            if (ev.source == EV_SRC_BT)
+            {
+                Bt_Send("WRONG\r\n");
+                Bt_Send(kBtPrompt);
+            }
+            else
+            {
+                Bt_Send("KEYPAD WRONG PIN\r\n");
+            }
+            break;
+
+        case EV_CARD_RESULT:
+            if (ev.code < CARD_RESULT_COUNT)
+            {
+                Bt_Send(kCardText[ev.code].bt);
+            }
+            break;
+
+        case EV_STATE:
+            // 本來就鎖著又按 C：不用吵藍牙那邊 (藍牙自己送的 PIN 還是要回)
+            if (!ev.arg && ev.source != EV_SRC_BT)
+            {
+                break;
+            }
+            if (ev.source == EV_SRC_KEYPAD)
+            {
+                Bt_Send(ev.code ? "KEYPAD UNLOCK\r\n" : "KEYPAD LOCK\r\n");
+            }
+            Bt_Send(ev.code ? "UNLOCK\r\n" : "LOCK\r\n");
+            if (!ev.code && ev.source == EV_SRC_BT)
+            {
+                Bt_Send(kBtPrompt);
+            }
+            break;
+
+        case EV_MODE:
+            if (ev.code == NFC_MODE_ADD_CARD)
+            {
+                Bt_Send(ev.arg ? "ENTER ADD CARD MODE\r\n" : "DENY ADD: LOCKED\r\n");
+            }
+            else if (ev.code == NFC_MODE_DELETE_CARD)
+            {
+                Bt_Send(ev.arg ? "ENTER DELETE CARD MODE\r\n" : "DENY DELETE: LOCKED\r\n");
+            }
+            break;
 
-            HAL_UART_Transmit(&BT_UART,
-                              (uint8_t *)prompt,
-                              strlen(prompt),
-                              HAL_MAX_DELAY);
+        default:
+            break;
         }
     }
 }
 
+// 沒有暫時訊息的時候顯示的畫面
+static void Lcd_Home(LcdMsg_t *msg, uint8_t unlocked)
+{
+    snprintf(msg->line1, sizeof(msg->line1), unlocked ? "UNLOCK" : "LOCKED");
+    snprintf(msg->line2, sizeof(msg->line2), unlocked ? "" : "PIN: ----");
+}
+
+// 事件 → 畫面；回傳 0 = 這個事件不用改畫面。*holdMs 不是 0 的話時間到就回 Lcd_Home
+static int Lcd_FromEvent(const app_event_t *ev, LcdMsg_t *msg, uint32_t *holdMs)
+{
+    static const char *const bySrc[] = { "", "BY KEYPAD", "BY NFC", "BY BLUETOOTH" };
+
+    *holdMs = 0;
+    memset(msg, 0, sizeof(*msg));
+
+    switch (ev->type)
+    {
+    case EV_PIN_INPUT:
+        snprintf(msg->line1, sizeof(msg->line1), "LOCKED");
+        snprintf(msg->line2, sizeof(msg->line2), "PIN: ----");
+        for (int i = 0; i < ev->code && i < PIN_LEN; i++)
+        {
+            msg->line2[5 + i] = '*';
+        }
+        return 1;
+
+    case EV_PIN_WRONG:
+        if (ev->source != EV_SRC_KEYPAD)
+        {
+            return 0;
+        }
+        snprintf(msg->line1, sizeof(msg->line1), "WRONG PIN");
+        snprintf(msg->line2, sizeof(msg->line2), "TRY AGAIN");
+        *holdMs = 500;
+        return 1;
+
+    case EV_CARD_SEEN:
+        // LCD 一行 16 字，最多秀前 8 byte
+        snprintf(msg->line1, sizeof(msg->line1), "CARD DETECTED");
+        for (int i = 0; i < ev->uid.len && i < 8; i++)
+        {
+            snprintf(&msg->line2[i * 2], sizeof(msg->line2) - i * 2, "%02X", ev->uid.uid[i]);
+        }
+        return 1;
+
+    case EV_CARD_RESULT:
+        if (ev->code >= CARD_RESULT_COUNT)
+        {
+            return 0;
+        }
+        if (ev->code == CARD_MULTI)
+        {
+            snprintf(msg->line1, sizeof(msg->line1), "%d CARDS SEEN", ev->arg);
+        }
+        else
+        {
+            snprintf(msg->line1, sizeof(msg->line1), "%s", kCardText[ev->code].line1);
+        }
+        snprintf(msg->line2, sizeof(msg->line2), "%s", kCardText[ev->code].line2);
+        return 1;
+
+    case EV_STATE:
+        if (!ev->code && !ev->arg)
+        {
+            snprintf(msg->line1, sizeof(msg->line1), "ALREADY LOCK");
+            snprintf(msg->line2, sizeof(msg->line2), "PIN: ----");
+            return 1;
+        }
+        snprintf(msg->line1, sizeof(msg->line1), ev->code ? "UNLOCK" : "LOCK");
+        if (ev->source < sizeof(bySrc) / sizeof(bySrc[0]))
+        {
+            snprintf(msg->line2, sizeof(msg->line2), "%s", bySrc[ev->source]);
+        }
+        return 1;
+
+    case EV_MODE:
+        if (!ev->arg)
+        {
+            snprintf(msg->line1, sizeof(msg->line1), "LOCKED");
+            snprintf(msg->line2, sizeof(msg->line2), "UNLOCK FIRST");
+            *holdMs = 800;
+            return 1;
+        }
+        if (ev->code == NFC_MODE_NORMAL)
+        {
+            return 0;
+        }
+        snprintf(msg->line1, sizeof(msg->line1),
+                 (ev->code == NFC_MODE_ADD_CARD) ? "ADD CARD MODE" : "DEL CARD MODE");
+        snprintf(msg->line2, sizeof(msg->line2), "TAP CARD...");
+        return 1;
+
+    default:
+        return 0;
+    }
+}
 
 void vLcdTask(void *argument)
 {
     lcd1602_Init(&hlcd, &hi2c1, PCF8574_ADDRESS);
     lcd1602_LED(&hlcd, ENABLE);
     lcd1602_Clear(&hlcd);
+    lcd_fb_init(&hlcd);
 
-    LcdMsg_t msg;
+    app_event_t ev;
+    LcdMsg_t    msg;
+    uint8_t     unlocked = 0;
+    uint32_t    holdMs   = 0;
+    TickType_t  wait     = 0;       // 第一次直接畫主畫面
+    uint32_t    dropped  = lcd_port_dropped();
 
     for (;;)
     {
-        if (xQueueReceive(xLcdQ, &msg, portMAX_DELAY) == pdPASS)
+        if (xQueueReceive(qLcd, &ev, wait) == pdPASS)
         {
-            lcd1602_Clear(&hlcd);
-            lcd1602_SetCursor(&hlcd, 0, 0);
-            lcd1602_Print(&hlcd, (uint8_t*)msg.line1);
-            lcd1602_SetCursor(&hlcd, 0, 1);
-            lcd1602_Print(&hlcd, (uint8_t*)msg.line2);
+            if (ev.type == EV_STATE)
+            {
+                unlocked = ev.code;
+            }
+            if (!Lcd_FromEvent(&ev, &msg, &holdMs))
+            {
+                continue;
+            }
         }
+        else
+        {
+            // 暫時的訊息 (PIN 錯 / 要先開鎖) 時間到了
+            Lcd_Home(&msg, unlocked);
+            holdMs = 0;
+        }
+        wait = holdMs ? pdMS_TO_TICKS(holdMs) : portMAX_DELAY;
+
+        // I2C 掉過資料，面板跟 shadow 對不上了：整面重送
+        if (lcd_port_dropped() != dropped)
+        {
+            dropped = lcd_port_dropped();
+            lcd_fb_invalidate();
+        }
+
+        // 只送跟目前畫面不一樣的字，不再整面 Clear；
+        // 送進 lcd_port 的 ring 就返回，I2C1 DMA 在背景慢慢送
+        lcd_fb_show(msg.line1, msg.line2);
     }
 }
 
-void vStateTask(void *argument)
+static void State_SetMode(NfcMode_t mode, uint8_t source)
 {
-    uint8_t cmd;
+    if (gNfcMode == mode)
+    {
+        return;
+    }
+    gNfcMode = mode;
 
-    HAL_UART_Transmit(&DBG_UART,
-                      (uint8_t *)"STATE TASK STARTED\r\n",
-                      strlen("STATE TASK STARTED\r\n"),
-                      HAL_MAX_DELAY);
+    app_event_t ev = { .type = EV_MODE, .source = source, .code = mode, .arg = 1 };
+    event_bus_publish(&ev);
+}
+
+static void State_Apply(uint8_t unlocked, uint8_t source)
+{
+    uint8_t changed = (gIsUnlocked != unlocked);
+
+    gIsUnlocked = unlocked;
+
+    HAL_GPIO_WritePin(GPIOD, LD4_Pin | LD5_Pin, GPIO_PIN_RESET);
+    HAL_GPIO_WritePin(GPIOD, unlocked ? LD4_Pin : LD5_Pin, GPIO_PIN_SET);
 
-    LcdMsg_t bootMsg;
-    snprintf(bootMsg.line1, sizeof(bootMsg.line1), "LOCKED");
-    snprintf(bootMsg.line2, sizeof(bootMsg.line2), "WAITING PIN");
-    xQueueSend(xLcdQ, &bootMsg, 0);
+    LOG_INFO("STATE: unlocked=%d src=%d\r\n", unlocked, source);
+
+    if (!unlocked)
+    {
+        State_SetMode(NFC_MODE_NORMAL, source);
+    }
+
+    app_event_t ev = { .type = EV_STATE, .source = source, .code = unlocked, .arg = changed };
+    event_bus_publish(&ev);
+}
+
+// 開鎖狀態 (gIsUnlocked) 跟 NFC 模式 (gNfcMode) 只在這裡改
+void vStateTask(void *argument)
+{
+    app_event_t ev;
+
+    LOG_INFO("STATE TASK STARTED\r\n");
 
     gIsUnlocked = false; 
 
     for (;;)
     {
-        if (xQueueReceive(xEventQueue, &cmd, portMAX_DELAY) == pdPASS)
+        if (xQueueReceive(qState, &ev, portMAX_DELAY) != pdPASS)
         {
-            LcdMsg_t msg;
-
-            if (cmd == '1')  
-            {
-                gIsUnlocked = true;   
+            continue;
+        }
 
-                HAL_GPIO_WritePin(GPIOD, LD4_Pin | LD5_Pin, GPIO_PIN_RESET);
-                HAL_GPIO_WritePin(GPIOD, LD4_Pin, GPIO_PIN_SET);
+        switch (ev.type)
+        {
+        case EV_UNLOCK_REQ:
+            State_Apply(1, ev.source);
+            break;
 
-                HAL_UART_Transmit(&DBG_UART,
-                                  (uint8_t *)"STATE: UNLOCK\r\n",
-                                  strlen("STATE: UNLOCK\r\n"),
-                                  HAL_MAX_DELAY);
+        case EV_LOCK_REQ:
+            State_Apply(0, ev.source);
+            break;
 
-                HAL_UART_Transmit(&BT_UART,
-                                  (uint8_t *)"UNLOCK\r\n",
-                                  strlen("UNLOCK\r\n"),
-                                  HAL_MAX_DELAY);
+        case EV_MODE_REQ:
+            if (gIsUnlocked)
+            {
+                State_SetMode((NfcMode_t)ev.code, ev.source);
+            }
+            else
+            {
+                app_event_t deny = { .type = EV_MODE, .source = ev.source, .code = ev.code, .arg = 0 };
+                event_bus_publish(&deny);
+            }
+            break;
 
-                snprintf(msg.line1, sizeof(msg.line1), "UNLOCK");
-                snprintf(msg.line2, sizeof(msg.line2), "        ");
-                xQueueSend(xLcdQ, &msg, 0);
+        case EV_CARD_RESULT:
+            if (ev.code == CARD_AUTH_OK)
+            {
+                State_Apply(1, ev.source);
             }
-            else if (cmd == '0')  // LOCK
+            else if (ev.code != CARD_AUTH_DENIED && ev.code != CARD_MULTI)
             {
-                gIsUnlocked = false;  
+                // 加 / 刪完一張就回一般模式
+                State_SetMode(NFC_MODE_NORMAL, ev.source);
+            }
+            break;
 
-                HAL_GPIO_WritePin(GPIOD, LD4_Pin | LD5_Pin, GPIO_PIN_RESET);
-                HAL_GPIO_WritePin(GPIOD, LD5_Pin, GPIO_PIN_SET);
+        default:
+            break;
+        }
+    }
+}
 
-                HAL_UART_Transmit(&DBG_UART,
-                                  (uint8_t *)"STATE: LOCK\r\n",
-                                  strlen("STATE: LOCK\r\n"),
-                                  HAL_MAX_DELAY);
+// 安全相關的事件全部記一筆 (dbg_log，不會 block)；UID 只記前 4 byte + 長度
+void vAuditTask(void *argument)
+{
+    app_event_t ev;
 
-                HAL_UART_Transmit(&BT_UART,
-                                  (uint8_t *)"LOCK\r\n",
-                                  strlen("LOCK\r\n"),
-                                  HAL_MAX_DELAY);
+    for (;;)
+    {
+        if (xQueueReceive(qAudit, &ev, portMAX_DELAY) == pdPASS)
+        {
+            LOG_INFO("AUDIT: t=%u ev=%d src=%d code=%d arg=%d uid(%d)=%02X%02X%02X%02X drop=%u\r\n",
+                     (unsigned)ev.tick, ev.type, ev.source, ev.code, ev.arg, ev.uid.len,
+                     ev.uid.uid[0], ev.uid.uid[1], ev.uid.uid[2], ev.uid.uid[3],
+                     (unsigned)event_bus_dropped());
+        }
+    }
+}
 
-                snprintf(msg.line1, sizeof(msg.line1), "LOCK");
-                snprintf(msg.line2, sizeof(msg.line2), "       ");
-                xQueueSend(xLcdQ, &msg, 0);
-            }
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer,
+                                   StackType_t **ppxIdleTaskStackBuffer,
+                                   uint32_t *pulIdleTaskStackSize)
+{
+    *ppxIdleTaskTCBBuffer   = &idle_tcb;
+    *ppxIdleTaskStackBuffer = idle_stack;
+    *pulIdleTaskStackSize   = sizeof(idle_stack) / sizeof(StackType_t);
+}
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer,
+                                    StackType_t **ppxTimerTaskStackBuffer,
+                                    uint32_t *pulTimerTaskStackSize)
+{
+    *ppxTimerTaskTCBBuffer   = &timer_tcb;
+    *ppxTimerTaskStackBuffer = timer_stack;
+    *pulTimerTaskStackSize   = sizeof(timer_stack) / sizeof(StackType_t);
+}
+
+// 所有 RTOS 物件都是 static 的，heap 只剩 1 KB：有人又用了 xTaskCreate / xQueueCreate
+// 之類的 dynamic API 而且 heap 不夠，停在這裡 (跟 configASSERT 一樣)，不要默默拿到 NULL
+void vApplicationMallocFailedHook(void)
+{
+    taskDISABLE_INTERRUPTS();
+    for (;;)
+    {
+    }
+}
+
+// card_db GC in small steps, at idle priority: it only runs when every other
+// task is blocked, and each step holds the card_db lock for about a millisecond,
+// so a tap is still checked against the RAM whitelist right away.
+// Sector erases stall the whole CPU on F407, so they wait until no new card
+// has been tapped and no key pressed for CARD_GC_QUIET_MS.
+void vCardGcTask(void *argument)
+{
+    for (;;)
+    {
+        TickType_t now   = xTaskGetTickCount();
+        int        quiet = (now - gLastTagTick) >= pdMS_TO_TICKS(CARD_GC_QUIET_MS) &&
+                           (now - gLastKeyTick) >= pdMS_TO_TICKS(CARD_GC_QUIET_MS);
+
+        if (carddb_gc_step(quiet))
+        {
+            taskYIELD();
+        }
+        else
+        {
+            vTaskDelay(pdMS_TO_TICKS(CARD_GC_POLL_MS));
         }
     }
 }
@@ -0,0 +1,38 @@
+#include "nfc_poll.h"
+
+void nfc_poll_init(nfc_poll_t *p, uint32_t now)
+{
+    p->last_activity = now;
+    p->interval      = NFC_POLL_FAST_MS;
+}
+
+void nfc_poll_activity(nfc_poll_t *p, uint32_t t)
+{
+    if ((int32_t)(t - p->last_activity) > 0) {
+        p->last_activity = t;
+        p->interval      = NFC_POLL_FAST_MS;
+    }
+}
+
+uint32_t nfc_poll_next(nfc_poll_t *p, uint32_t now, int card_seen)
+{
+    if (card_seen) {
+        nfc_poll_activity(p, now);
+    }
+
+    if (now - p->last_activity < NFC_POLL_ACTIVE_MS) {
+        p->interval = NFC_POLL_FAST_MS;
+        return p->interval;
+    }
+
+    // Idle: exponential back-off, restarted by the next activity.
+    if (p->interval < NFC_POLL_IDLE_MIN_MS) {
+        p->interval = NFC_POLL_IDLE_MIN_MS;
+    } else {
+        p->interval *= 2U;
+        if (p->interval > NFC_POLL_IDLE_MAX_MS) {
+            p->interval = NFC_POLL_IDLE_MAX_MS;
+        }
+    }
+    return p->interval;
+}
@@ -1,17 +1,67 @@
 #include "rc522.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+#include <string.h>
+
+/* 正在等 RC522 IRQ 的 task (沒有人在等就是 NULL) */
+static TaskHandle_t volatile g_irq_waiter = NULL;
+
+/* SPI1 DMA 傳完 (MFRC522_Init 建立) */
+static SemaphoreHandle_t g_spi_done = NULL;
+static StaticSemaphore_t g_spi_done_sem;
+
+/* burst 用的 DMA buffer：task stack 不一定在 DMA 看得到的 RAM，固定放在 .bss
+ * (只有 NFC task 會碰 RC522，不用再加鎖) */
+static uchar g_spi_tx[MFRC522_BURST_MAX + 1];
+static uchar g_spi_rx[MFRC522_BURST_MAX + 1];
 
 /*
- * Function Name: RC522_SPI_Transfer
- * Description: A common function used by Write_MFRC522 and Read_MFRC522
- * Input Parameters: data - the value to be written
- * Returns: a byte of data read from the module
+ * Function Name: RC522_SPI_Xfer
+ * Description: One CS-low SPI transaction of len bytes.
+ *              Long transfers (FIFO bursts) go through SPI1 DMA while the task sleeps;
+ *              short ones and anything before the scheduler runs use a single polled call.
+ * Input Parameters: tx - bytes to send; rx - bytes received (same length); len - byte count
+ * Return value: None
  */
-uint8_t RC522_SPI_Transfer(uchar data)
+static void RC522_SPI_Xfer(const uchar *tx, uchar *rx, uint16_t len)
 {
-	uchar rx_data;
-	HAL_SPI_TransmitReceive(HSPI_INSTANCE,&data,&rx_data,1,100);
+	HAL_GPIO_WritePin(MFRC522_CS_PORT,MFRC522_CS_PIN,GPIO_PIN_RESET);
+
+	if (len >= MFRC522_SPI_DMA_MIN && g_spi_done != NULL &&
+	    xTaskGetSchedulerState() == taskSCHEDULER_RUNNING &&
+	    HAL_SPI_TransmitReceive_DMA(HSPI_INSTANCE, (uint8_t *)tx, rx, len) == HAL_OK)
+	{
+		if (xSemaphoreTake(g_spi_done, pdMS_TO_TICKS(MFRC522_SPI_TIMEOUT_MS)) != pdTRUE)
+		{
+			HAL_SPI_Abort(HSPI_INSTANCE);
+			// 逾時之後、Abort 之前 DMA 剛好做完的話 callback 還是會 give：
+			// 先清掉，不然下一次 burst 會馬上 take 到，CS 提早拉高、g_spi_rx 還沒填
+			xSemaphoreTake(g_spi_done, 0);
+		}
+	}
+	else
+	{
+		HAL_SPI_TransmitReceive(HSPI_INSTANCE, (uint8_t *)tx, rx, len, MFRC522_SPI_TIMEOUT_MS);
+	}
 
-	return rx_data;
+	HAL_GPIO_WritePin(MFRC522_CS_PORT,MFRC522_CS_PIN,GPIO_PIN_SET);
+}
+
+/*
+ * Function Name: MFRC522_SpiCpltHandler
+ * Description: SPI1 DMA finished (HAL_SPI_TxRxCpltCallback / HAL_SPI_ErrorCallback)
+ * Input: None
+ * Return value: None
+ */
+void MFRC522_SpiCpltHandler(void)
+{
+	if (g_spi_done != NULL)
+	{
+		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+		xSemaphoreGiveFromISR(g_spi_done, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	}
 }
 
 /*
@@ -22,20 +72,14 @@ uint8_t RC522_SPI_Transfer(uchar data)
  */
 void Write_MFRC522(uchar addr, uchar val)
 {
-	/* CS LOW */
-	HAL_GPIO_WritePin(MFRC522_CS_PORT,MFRC522_CS_PIN,GPIO_PIN_RESET);
-
-	  // even though we are calling transfer frame once, we are really sending
-	  // two 8-bit frames smooshed together-- sending two 8 bit frames back to back
-	  // results in a spike in the select line which will jack with transactions
-	  // - top 8 bits are the address. Per the spec, we shift the address left
+	  // - first byte is the address. Per the spec, we shift the address left
 	  //   1 bit, clear the LSb, and clear the MSb to indicate a write
-	  // - bottom 8 bits are the data bits being sent for that address, we send them
-	RC522_SPI_Transfer((addr<<1)&0x7E);	
-	RC522_SPI_Transfer(val);
-	
-	/* CS HIGH */
-	HAL_GPIO_WritePin(MFRC522_CS_PORT,MFRC522_CS_PIN,GPIO_PIN_SET);
+	  // - second byte is the data for that address
+	  // Both go out in one HAL call so CS stays low for the whole frame.
+	uchar tx[2] = { (uchar)((addr<<1)&0x7E), val };
+	uchar rx[2];
+
+	RC522_SPI_Xfer(tx, rx, 2);
 }
 
 /*
@@ -46,24 +90,89 @@ void Write_MFRC522(uchar addr, uchar val)
  */
 uchar Read_MFRC522(uchar addr)
 {
-	uchar val;
+	  // - first byte: address shifted left 1 bit, LSb clear, MSb set to indicate a read
+	  // - second byte is all 0s on a read per 8.1.2.1 Table 6
+	uchar tx[2] = { (uchar)(((addr<<1)&0x7E) | 0x80), 0x00 };
+	uchar rx[2];
 
-	/* CS LOW */
-	HAL_GPIO_WritePin(MFRC522_CS_PORT,MFRC522_CS_PIN,GPIO_PIN_RESET);
+	RC522_SPI_Xfer(tx, rx, 2);
+    return rx[1];
+}
 
-	  // even though we are calling transfer frame once, we are really sending
-	  // two 8-bit frames smooshed together-- sending two 8 bit frames back to back
-	  // results in a spike in the select line which will jack with transactions
-	  // - top 8 bits are the address. Per the spec, we shift the address left
-	  //   1 bit, clear the LSb, and set the MSb to indicate a read
-	  // - bottom 8 bits are all 0s on a read per 8.1.2.1 Table 6
-	RC522_SPI_Transfer(((addr<<1)&0x7E) | 0x80);	
-	val = RC522_SPI_Transfer(0x00);
-	
-	/* CS HIGH */
-	HAL_GPIO_WritePin(MFRC522_CS_PORT,MFRC522_CS_PIN,GPIO_PIN_SET);
+/*
+ * Function Name: Write_MFRC522_Burst
+ * Description: Write len bytes to the same register in one CS frame
+ *              (address byte once, then data; used for FIFODataReg)
+ * Input Parameters: addr - register address; data - bytes to write; len - byte count (<= MFRC522_BURST_MAX)
+ * Return value: None
+ */
+void Write_MFRC522_Burst(uchar addr, const uchar *data, uchar len)
+{
+	if (len == 0)
+	{
+		return;
+	}
+	if (len > MFRC522_BURST_MAX)
+	{
+		len = MFRC522_BURST_MAX;
+	}
+
+	g_spi_tx[0] = (addr<<1)&0x7E;
+	memcpy(&g_spi_tx[1], data, len);
+	RC522_SPI_Xfer(g_spi_tx, g_spi_rx, (uint16_t)len + 1);
+}
+
+/*
+ * Function Name: Read_MFRC522_Burst
+ * Description: Read len bytes from the same register in one CS frame.
+ *              The read address is repeated len times and closed with 0x00 (datasheet 8.1.2.1),
+ *              every address byte clocks out the previous value.
+ * Input Parameters: addr - register address; data - received bytes; len - byte count (<= MFRC522_BURST_MAX)
+ * Return value: None
+ */
+void Read_MFRC522_Burst(uchar addr, uchar *data, uchar len)
+{
+	if (len == 0)
+	{
+		return;
+	}
+	if (len > MFRC522_BURST_MAX)
+	{
+		len = MFRC522_BURST_MAX;
+	}
 
-    return val;
+	memset(g_spi_tx, ((addr<<1)&0x7E) | 0x80, len);
+	g_spi_tx[len] = 0x00;
+	RC522_SPI_Xfer(g_spi_tx, g_spi_rx, (uint16_t)len + 1);
+	memcpy(data, &g_spi_rx[1], len);
+}
+
+/*
+ * Function Name: Read_MFRC522_Multi
+ * Description: Read several different registers in one CS frame
+ * Input Parameters: addrs - register addresses; vals - values read; n - register count (<= MFRC522_BURST_MAX)
+ * Return value: None
+ */
+void Read_MFRC522_Multi(const uchar *addrs, uchar *vals, uchar n)
+{
+	uchar i;
+
+	if (n == 0)
+	{
+		return;
+	}
+	if (n > MFRC522_BURST_MAX)
+	{
+		n = MFRC522_BURST_MAX;
+	}
+
+	for (i=0; i<n; i++)
+	{
+		g_spi_tx[i] = ((addrs[i]<<1)&0x7E) | 0x80;
+	}
+	g_spi_tx[n] = 0x00;
+	RC522_SPI_Xfer(g_spi_tx, g_spi_rx, (uint16_t)n + 1);
+	memcpy(vals, &g_spi_rx[1], n);
 }
 
 /*
@@ -118,6 +227,85 @@ void AntennaOff(void)
 	ClearBitMask(TxControlReg, 0x03);
 }
 
+/*
+ * Function Name: MFRC522_IrqHandler
+ * Description: EXTI on the IRQ pin, wakes the task waiting in RC522_WaitIrq
+ * Input: None
+ * Return value: None
+ */
+void MFRC522_IrqHandler(void)
+{
+	TaskHandle_t waiter = g_irq_waiter;
+
+	if (waiter != NULL)
+	{
+		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+		vTaskNotifyGiveFromISR(waiter, &xHigherPriorityTaskWoken);
+		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+	}
+}
+
+/*
+ * Function Name: RC522_WaitArm
+ * Description: Register the calling task as the IRQ waiter and drop a stale notification.
+ *              Call after the irq flags are cleared and before the command is started.
+ * Input: None
+ * Return value: None
+ */
+static void RC522_WaitArm(void)
+{
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+	{
+		g_irq_waiter = xTaskGetCurrentTaskHandle();
+		ulTaskNotifyTake(pdTRUE, 0);
+	}
+}
+
+/*
+ * Function Name: RC522_WaitIrq
+ * Description: Wait until one of the mask bits is set in irqReg.
+ *              With the scheduler running the task sleeps until the IRQ pin fires;
+ *              before that (boot) it polls.  Either way the bound is
+ *              MFRC522_IRQ_TIMEOUT_MS, the RC522 timer normally ends the wait first.
+ * Input parameters: irqReg - CommIrqReg or DivIrqReg; mask - bits to wait for;
+ *                   irqOut - last value read from irqReg
+ * Return value: 1 = a mask bit was set, 0 = timeout
+ */
+static uchar RC522_WaitIrq(uchar irqReg, uchar mask, uchar *irqOut)
+{
+	uint32_t start = HAL_GetTick();
+	uchar    done  = 0;
+	uchar    n;
+
+	for (;;)
+	{
+		n = Read_MFRC522(irqReg);
+		if (n & mask)
+		{
+			done = 1;
+			break;
+		}
+
+		if (g_irq_waiter != NULL)
+		{
+			if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MFRC522_IRQ_TIMEOUT_MS)) == 0)
+			{
+				n = Read_MFRC522(irqReg);	// 最後再看一次，可能剛好漏掉 edge
+				done = (n & mask) ? 1 : 0;
+				break;
+			}
+		}
+		else if (HAL_GetTick() - start >= MFRC522_IRQ_TIMEOUT_MS)
+		{
+			break;
+		}
+	}
+
+	g_irq_waiter = NULL;
+	*irqOut = n;
+	return done;
+}
+
 /*
  * Function Name: MFRC522_Reset
  * Description: Reset RC522
@@ -137,6 +325,11 @@ void MFRC522_Reset(void)
 */
 void MFRC522_Init(void)
 {
+	if (g_spi_done == NULL)
+	{
+		g_spi_done = xSemaphoreCreateBinaryStatic(&g_spi_done_sem);
+	}
+
 	HAL_GPIO_WritePin(MFRC522_CS_PORT,MFRC522_CS_PIN,GPIO_PIN_SET);
 	HAL_GPIO_WritePin(MFRC522_RST_PORT,MFRC522_RST_PIN,GPIO_PIN_SET);
 	MFRC522_Reset();
@@ -144,8 +337,7 @@ void MFRC522_Init(void)
 	//Timer: TPrescaler*TreloadVal/6.78MHz = 24ms
 	Write_MFRC522(TModeReg, 0x8D);		//Tauto=1; f(Timer) = 6.78MHz/TPreScaler
 	Write_MFRC522(TPrescalerReg, 0x3E);	//TModeReg[3..0] + TPrescalerReg
-	Write_MFRC522(TReloadRegL, 30);           
-	Write_MFRC522(TReloadRegH, 0);
+	MFRC522_SetTimeout(MFRC522_TIMEOUT_MS);
 	
 	Write_MFRC522(TxAutoReg, 0x40);		// force 100% ASK modulation
 	Write_MFRC522(ModeReg, 0x3D);		// CRC Initial value 0x6363
@@ -154,27 +346,31 @@ void MFRC522_Init(void)
     // ★ 新增：清除碰撞位元
     Write_MFRC522(CollReg, 0x80);
 
+	// IRQ 腳: push-pull、低電位有效，平常不開任何中斷來源 (腳維持 high)
+	Write_MFRC522(DivlEnReg, 0x80);			// IRQPushPull=1
+	Write_MFRC522(CommIEnReg, 0x80);		// IRqInv=1
+
 	AntennaOn();
 }
 
 /*
- * Function Name: MFRC522_ToCard
- * Description: RC522 and ISO14443 card communication
- * Input Parameters: command - MF522 command word,
- *			 sendData--RC522 sent to the card by the data
- *			 sendLen--Length of data sent
- *			 backData--Received the card returns data,
- *			 backLen--Return data bit length
- * Return value: the successful return MI_OK
+ * Function Name: RC522_ToCardColl
+ * Description: MFRC522_ToCard that can also report a bit collision
+ * Input Parameters: same as MFRC522_ToCard,
+ *			 collPos--NULL: a collision is MI_ERR (old behaviour);
+ *			          else returns the CollReg position (1..32, 0 = not valid),
+ *			          the bits received before it are in backData
+ * Return value: MI_OK, MI_COLL, MI_NOTAGERR or MI_ERR
  */
-uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen)
+static uchar RC522_ToCardColl(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen, uchar *collPos)
 {
     uchar status = MI_ERR;
     uchar irqEn = 0x00;
     uchar waitIRq = 0x00;
     uchar lastBits;
     uchar n;
-    uint i;
+    uchar done;
+    uchar coll = 0;
 
     switch (command)
     {
@@ -194,17 +390,17 @@ uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backD
 			break;
     }
    
-    Write_MFRC522(CommIEnReg, irqEn|0x80);	// Interrupt request
-    ClearBitMask(CommIrqReg, 0x80);			// Clear all interrupt request bit
-    SetBitMask(FIFOLevelReg, 0x80);			// FlushBuffer=1, FIFO Initialization
+    // IRQ 腳只接「做完」的來源 (waitIRq) 和 RC522 timer 的 timeout (TimerIRq)，
+    // TxIRq / LoAlert 之類的中途事件不要把 task 叫醒
+    Write_MFRC522(CommIEnReg, waitIRq|0x01|0x80);	// Interrupt request, IRqInv=1
+    Write_MFRC522(CommIrqReg, 0x7F);			// Set1=0: clear all interrupt request bits
+    Write_MFRC522(FIFOLevelReg, 0x80);		// FlushBuffer=1, FIFO Initialization (bit6..0 read-only)
     
 	Write_MFRC522(CommandReg, PCD_IDLE);	// NO action; Cancel the current command
+	RC522_WaitArm();
 
-	// Writing data to the FIFO
-    for (i=0; i<sendLen; i++)
-    {   
-		Write_MFRC522(FIFODataReg, sendData[i]);    
-	}
+	// Writing data to the FIFO (one burst)
+	Write_MFRC522_Burst(FIFODataReg, sendData, sendLen);
 
     // Execute the command
 	Write_MFRC522(CommandReg, command);
@@ -213,33 +409,46 @@ uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backD
 		SetBitMask(BitFramingReg, 0x80);		// StartSend=1,transmission of data starts
 	}   
     
-    // Waiting to receive data to complete
-	i = 2000;	// i according to the clock frequency adjustment, the operator M1 card maximum waiting time 25ms
-    do 
-    {
-		//CommIrqReg[7..0]
-		//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
-        n = Read_MFRC522(CommIrqReg);
-        i--;
-    }
-    while ((i!=0) && !(n&0x01) && !(n&waitIRq));
+    // Waiting to receive data to complete (sleeps until the IRQ pin fires)
+	//CommIrqReg[7..0]
+	//Set1 TxIRq RxIRq IdleIRq HiAlerIRq LoAlertIRq ErrIRq TimerIRq
+	done = RC522_WaitIrq(CommIrqReg, waitIRq|0x01, &n);
 
     ClearBitMask(BitFramingReg, 0x80);			//StartSend=0
+	Write_MFRC522(CommIEnReg, 0x80);			// IRQ 腳回到 high
 	
-    if (i != 0)
+    if (done)
     {    
-        if(!(Read_MFRC522(ErrorReg) & 0x1B))	//BufferOvfl Collerr CRCErr ProtecolErr
+		// ErrorReg / FIFOLevelReg / ControlReg in one frame
+		static const uchar statRegs[3] = { ErrorReg, FIFOLevelReg, ControlReg };
+		uchar stat[3];
+		Read_MFRC522_Multi(statRegs, stat, 3);
+
+        // 只有 CollErr (沒有 BufferOvfl / CRCErr / ProtocolErr) 而且 caller 要知道位置
+        if (collPos != NULL && (stat[0] & 0x1B) == 0x08)
+        {
+            coll = 1;
+        }
+
+        if(!(stat[0] & 0x1B) || coll)	//BufferOvfl Collerr CRCErr ProtecolErr
         {
             status = MI_OK;
-            if (n & irqEn & 0x01)
+            if (coll)
+            {
+                uchar c = Read_MFRC522(CollReg);
+                // CollPosNotValid=1: 碰撞在收到的範圍外；CollPos 0 代表第 32 bit
+                *collPos = (c & 0x20) ? 0 : ((c & 0x1F) ? (c & 0x1F) : 32);
+                status = MI_COLL;
+            }
+            else if (n & irqEn & 0x01)
             {   
 				status = MI_NOTAGERR;
 			}
 
             if (command == PCD_TRANSCEIVE)
             {
-               	n = Read_MFRC522(FIFOLevelReg);
-              	lastBits = Read_MFRC522(ControlReg) & 0x07;
+               	n = stat[1] & 0x7F;
+              	lastBits = stat[2] & 0x07;
                 if (lastBits)
                 {   
 					*backLen = (n-1)*8 + lastBits;   
@@ -258,11 +467,8 @@ uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backD
 					n = MAX_LEN;   
 				}
 				
-                // Reading the received data in FIFO
-                for (i=0; i<n; i++)
-                {   
-					backData[i] = Read_MFRC522(FIFODataReg);    
-				}
+                // Reading the received data in FIFO (one burst)
+                Read_MFRC522_Burst(FIFODataReg, backData, n);
             }
         }
         else
@@ -278,6 +484,21 @@ uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backD
     return status;
 }
 
+/*
+ * Function Name: MFRC522_ToCard
+ * Description: RC522 and ISO14443 card communication
+ * Input Parameters: command - MF522 command word,
+ *			 sendData--RC522 sent to the card by the data
+ *			 sendLen--Length of data sent
+ *			 backData--Received the card returns data,
+ *			 backLen--Return data bit length
+ * Return value: the successful return MI_OK
+ */
+uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backData, uint *backLen)
+{
+	return RC522_ToCardColl(command, sendData, sendLen, backData, backLen, NULL);
+}
+
 /*
  * Function Name: MFRC522_Request
  * Description: Find cards, read the card type number
@@ -293,12 +514,19 @@ uchar MFRC522_ToCard(uchar command, uchar *sendData, uchar sendLen, uchar *backD
 uchar MFRC522_Request(uchar reqMode, uchar *TagType)
 {
 	uchar status;  
+	uchar collPos;
 	uint backBits;			 // The received data bits
 
 	Write_MFRC522(BitFramingReg, 0x07);		//TxLastBists = BitFramingReg[2..0]
 	
 	TagType[0] = reqMode;
-	status = MFRC522_ToCard(PCD_TRANSCEIVE, TagType, 1, TagType, &backBits);
+	status = RC522_ToCardColl(PCD_TRANSCEIVE, TagType, 1, TagType, &backBits, &collPos);
+
+	// 好幾張卡的 ATQA 不一樣時會碰撞，但場裡確實有卡，交給 anticollision 去分
+	if (status == MI_COLL)
+	{
+		status = MI_OK;
+	}
 
 	if ((status != MI_OK) || (backBits != 0x10))
 	{    
@@ -316,19 +544,82 @@ uchar MFRC522_Request(uchar reqMode, uchar *TagType)
  */
 uchar MFRC522_Anticoll(uchar *serNum)
 {
-    uchar status;
+    return MFRC522_AnticollLevel(PICC_ANTICOLL, serNum);
+}
+
+/*
+ * Function Name: MFRC522_AnticollLevel
+ * Description: Bit-oriented anti-collision on one cascade level (CL1 0x93 / CL2 0x95 / CL3 0x97)
+ *              場裡有好幾張卡時，CollReg 給第一個碰撞的 bit：把已知的 bit + 這個 bit = 1
+ *              再送一次 (NVB 帶 bit 數)，只有那個分支的卡會回，最多 32 輪一定剩一張
+ * Input parameters: cascade - SEL code of the level
+ *                   serNum  - returns 4 bytes of this level (byte 0 may be the cascade tag 0x88) + BCC
+ * Return value: the successful return MI_OK
+ */
+uchar MFRC522_AnticollLevel(uchar cascade, uchar *serNum)
+{
+    uchar status = MI_ERR;
     uchar i;
 	uchar serNumCheck=0;
     uint unLen;
-    
-	Write_MFRC522(BitFramingReg, 0x00);		//TxLastBists = BitFramingReg[2..0]
- 
-    serNum[0] = PICC_ANTICOLL;
-    serNum[1] = 0x20;
-    status = MFRC522_ToCard(PCD_TRANSCEIVE, serNum, 2, serNum, &unLen);
+    uchar buffer[7 + MAX_LEN];		// SEL, NVB, UID0..3, BCC + FIFO 讀回的餘量
+    uchar known = 0;				// 這一層已經確定的 UID bit 數 (0..32)
+    uchar collPos;
+    uchar round;
+
+    for (i=2; i<7; i++)
+    {
+        buffer[i] = 0;
+    }
+
+    Write_MFRC522(CollReg, 0x00);		// ValuesAfterColl=0: 碰撞之後收到的 bit 清成 0
+
+    for (round=0; round<=32; round++)
+    {
+        uchar full = known / 8;
+        uchar last = known % 8;
+        uchar pos  = 2 + full;			// 第一個沒收完整的 byte
+        uchar keep = buffer[pos];
+
+        buffer[0] = cascade;
+        buffer[1] = (uchar)(((2 + full) << 4) | last);		// NVB: byte 數 | bit 數
+        Write_MFRC522(BitFramingReg, (uchar)((last << 4) | last));	// RxAlign | TxLastBits
+
+        status = RC522_ToCardColl(PCD_TRANSCEIVE, buffer, pos + (last ? 1 : 0),
+                                  &buffer[pos], &unLen, &collPos);
+
+        // 卡回的第一個 byte 從 bit 'last' 開始，低位是我們自己送出去的
+        if (last && (status == MI_OK || status == MI_COLL))
+        {
+            uchar mask = (uchar)((1U << last) - 1U);
+            buffer[pos] = (uchar)((keep & mask) | (buffer[pos] & (uchar)~mask));
+        }
+
+        if (status != MI_COLL)
+        {
+            break;
+        }
+        if (collPos <= known || collPos > 32)
+        {
+            status = MI_ERR;
+            break;
+        }
+
+        // 碰撞的那個 bit 選 1，往那個分支走
+        known = collPos;
+        buffer[2 + (known - 1) / 8] |= (uchar)(1U << ((known - 1) % 8));
+    }
+
+    Write_MFRC522(CollReg, 0x80);
+    Write_MFRC522(BitFramingReg, 0x00);
 
     if (status == MI_OK)
 	{
+		for (i=0; i<5; i++)
+		{
+			serNum[i] = buffer[i+2];
+		}
+
     	 //Check card serial number
 		for (i=0; i<4; i++)
 		{   
@@ -339,6 +630,10 @@ uchar MFRC522_Anticoll(uchar *serNum)
 			status = MI_ERR;    
 		}
     }
+    else
+    {
+        status = MI_ERR;
+    }
 
     return status;
 } 
@@ -351,30 +646,24 @@ uchar MFRC522_Anticoll(uchar *serNum)
  */
 void CalulateCRC(uchar *pIndata, uchar len, uchar *pOutData)
 {
-    uchar i, n;
+    static const uchar crcRegs[2] = { CRCResultRegL, CRCResultRegH };
+    uchar n;
 
-    ClearBitMask(DivIrqReg, 0x04);			//CRCIrq = 0
-    SetBitMask(FIFOLevelReg, 0x80);			//Clear the FIFO pointer
+    Write_MFRC522(DivlEnReg, 0x80|0x04);	//IRQPushPull=1, CRCIEn=1
+    Write_MFRC522(DivIrqReg, 0x04);			//Set2=0: CRCIrq = 0
+    Write_MFRC522(FIFOLevelReg, 0x80);		//Clear the FIFO pointer
+    RC522_WaitArm();
 
-    //Writing data to the FIFO
-    for (i=0; i<len; i++)
-    {   
-		Write_MFRC522(FIFODataReg, *(pIndata+i));   
-	}
+    //Writing data to the FIFO (one burst)
+    Write_MFRC522_Burst(FIFODataReg, pIndata, len);
     Write_MFRC522(CommandReg, PCD_CALCCRC);
 
     //Wait CRC calculation is complete
-    i = 0xFF;
-    do 
-    {
-        n = Read_MFRC522(DivIrqReg);
-        i--;
-    }
-    while ((i!=0) && !(n&0x04));			//CRCIrq = 1
+    RC522_WaitIrq(DivIrqReg, 0x04, &n);		//CRCIrq = 1
+    Write_MFRC522(DivlEnReg, 0x80);
 
-    //Read CRC calculation result
-    pOutData[0] = Read_MFRC522(CRCResultRegL);
-    pOutData[1] = Read_MFRC522(CRCResultRegH);
+    //Read CRC calculation result (L, H in one frame)
+    Read_MFRC522_Multi(crcRegs, pOutData, 2);
 }
 
 /*
@@ -414,6 +703,137 @@ uchar MFRC522_SelectTag(uchar *serNum)
     return size;
 }
 
+/*
+ * Function Name: MFRC522_SelectLevel
+ * Description: SELECT on one cascade level, returns the SAK of that level
+ * Input parameters: cascade - SEL code of the level
+ *                   serNum  - 4 bytes + BCC from MFRC522_AnticollLevel
+ *                   sak     - returns the SAK byte (bit2 = UID not complete)
+ * Return value: the successful return MI_OK
+ */
+uchar MFRC522_SelectLevel(uchar cascade, uchar *serNum, uchar *sak)
+{
+	uchar i;
+	uchar status;
+	uint recvBits;
+	uchar buffer[9];
+
+    buffer[0] = cascade;
+    buffer[1] = 0x70;
+    for (i=0; i<5; i++)
+    {
+    	buffer[i+2] = serNum[i];
+    }
+	CalulateCRC(buffer, 7, &buffer[7]);
+    status = MFRC522_ToCard(PCD_TRANSCEIVE, buffer, 9, buffer, &recvBits);
+
+    // SAK + CRC_A = 24 bits
+    if ((status == MI_OK) && (recvBits == 0x18))
+    {
+		*sak = buffer[0];
+	}
+    else
+    {
+		status = MI_ERR;
+	}
+
+    return status;
+}
+
+/*
+ * Function Name: MFRC522_ReadUid
+ * Description: Read the complete UID (single / double / triple size) after REQA
+ *              每一層 anticoll + select；SAK bit2 = 1 表示還有下一層，
+ *              這一層的 byte 0 是 cascade tag 0x88，只有後 3 byte 是 UID
+ * Input parameters: uid    - returns the UID, at least 10 bytes
+ *                   uidLen - returns 4 / 7 / 10
+ *                   sak    - returns the final SAK
+ * Return value: the successful return MI_OK, the card is left selected
+ */
+uchar MFRC522_ReadUid(uchar *uid, uchar *uidLen, uchar *sak)
+{
+    static const uchar levels[3] = { PICC_ANTICOLL, PICC_ANTICOLL_CL2, PICC_ANTICOLL_CL3 };
+    uchar serNum[MAX_LEN];
+    uchar status;
+    uchar lv;
+    uchar n = 0;
+
+    for (lv = 0; lv < 3; lv++)
+    {
+        status = MFRC522_AnticollLevel(levels[lv], serNum);
+        if (status != MI_OK)
+        {
+            return status;
+        }
+        status = MFRC522_SelectLevel(levels[lv], serNum, sak);
+        if (status != MI_OK)
+        {
+            return status;
+        }
+
+        if (*sak & 0x04)
+        {
+            // 還沒完，這層一定是 CT + 3 byte
+            if (serNum[0] != PICC_CASCADE_TAG || lv == 2)
+            {
+                return MI_ERR;
+            }
+            uid[n++] = serNum[1];
+            uid[n++] = serNum[2];
+            uid[n++] = serNum[3];
+        }
+        else
+        {
+            uid[n++] = serNum[0];
+            uid[n++] = serNum[1];
+            uid[n++] = serNum[2];
+            uid[n++] = serNum[3];
+            *uidLen = n;
+            return MI_OK;
+        }
+    }
+
+    return MI_ERR;
+}
+
+/*
+ * Function Name: MFRC522_ReadAllUids
+ * Description: List every card in the field in one poll (call after MFRC522_Request returned MI_OK).
+ *              每次 anticollision 只會 select 一張 (碰撞 bit 選 1 的那支)，讀完就 HALT 它，
+ *              HALT 的卡不回 REQA，再 REQA 一次剩下的卡就會回，直到沒有卡或滿 max 張。
+ *              卡要離開場再回來 (或天線關掉再開、WUPA) 才會再被讀到。
+ *              HALT 正常不會有回應、一張卡時最後的 REQA 也是空的：這兩個用
+ *              MFRC522_POLL_TIMEOUT_MS 等，只有讀 UID 用 MFRC522_TIMEOUT_MS (回來時是這個)
+ * Input parameters: cards - returns the UIDs, max - size of cards[]
+ * Return value: number of cards read (0 = anticollision failed)
+ */
+uchar MFRC522_ReadAllUids(rc522_uid_t *cards, uchar max)
+{
+    uchar atqa[2];
+    uchar n = 0;
+
+    while (n < max)
+    {
+        MFRC522_SetTimeout(MFRC522_TIMEOUT_MS);
+        if (MFRC522_ReadUid(cards[n].uid, &cards[n].len, &cards[n].sak) != MI_OK)
+        {
+            break;
+        }
+
+        MFRC522_SetTimeout(MFRC522_POLL_TIMEOUT_MS);
+        MFRC522_Halt();
+        n++;
+
+        if (n < max && MFRC522_Request(PICC_REQIDL, atqa) != MI_OK)
+        {
+            break;
+        }
+    }
+
+    MFRC522_SetTimeout(MFRC522_TIMEOUT_MS);
+    return n;
+}
+
 /*
  * Function Name: MFRC522_Auth
  * Description: Verify card password
@@ -536,23 +956,84 @@ void MFRC522_Halt(void)
 	MFRC522_ToCard(PCD_TRANSCEIVE, buff, 4, buff,&unLen);
 }
 
+/*
+ * Function Name: MFRC522_SetTimeout
+ * Description: RC522 timer reload (1 tick = 1 ms with the MFRC522_Init prescaler)
+ * Input: ms - how long a transceive waits for the card
+ * Return value: None
+ */
+void MFRC522_SetTimeout(uint ms)
+{
+	Write_MFRC522(TReloadRegL, (uchar)(ms & 0xFF));
+	Write_MFRC522(TReloadRegH, (uchar)(ms >> 8));
+}
+
+/*
+ * Function Name: MFRC522_SoftPowerDown
+ * Description: Soft power-down (CommandReg.PowerDown=1): oscillator, analog part and
+ *              antenna drivers off, registers and FIFO are kept.  The RF field goes away,
+ *              so a HALTed card is back in IDLE after the next power-up
+ * Input: None
+ * Return value: None
+ */
+void MFRC522_SoftPowerDown(void)
+{
+	SetBitMask(CommandReg, 0x10);
+}
+
+/*
+ * Function Name: MFRC522_SoftPowerUp
+ * Description: Leave soft power-down: wait for PowerDown to read back 0 (oscillator running),
+ *              then give a card in the field MFRC522_FIELD_SETTLE_MS to power up
+ * Input: None
+ * Return value: the successful return MI_OK, MI_ERR if the chip did not wake up
+ */
+uchar MFRC522_SoftPowerUp(void)
+{
+	uint32_t start;
+
+	if (!(Read_MFRC522(CommandReg) & 0x10))
+	{
+		return MI_OK;						// 本來就醒著 (開機第一次)
+	}
+
+	ClearBitMask(CommandReg, 0x10);
+	start = HAL_GetTick();
+	while (Read_MFRC522(CommandReg) & 0x10)
+	{
+		if (HAL_GetTick() - start >= MFRC522_WAKE_TIMEOUT_MS)
+		{
+			return MI_ERR;
+		}
+	}
+
+	if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+	{
+		vTaskDelay(pdMS_TO_TICKS(MFRC522_FIELD_SETTLE_MS));
+	}
+	else
+	{
+		HAL_Delay(MFRC522_FIELD_SETTLE_MS);
+	}
+	return MI_OK;
+}
+
 uchar MFRC522_Request_Simple(uchar reqMode, uchar *TagType)
 {
     uchar status = MI_ERR;
-    uchar irqEn  = 0x00;
     uchar waitIRq;
     uchar n;
-    uint  i;
+    uchar done;
 
     // REQA / WUPA 都是 7 bits，這邊只做 REQA 用 PICC_REQIDL
-    irqEn   = 0x77;          // 允許 RxIRq, TxIRq, IdleIRq 等
     waitIRq = 0x30;          // 等待 RxIRq 或 IdleIRq
 
-    Write_MFRC522(CommIEnReg, irqEn | 0x80);   // 開啟中斷
-    ClearBitMask(CommIrqReg, 0x80);            // 清中斷旗標
-    SetBitMask(FIFOLevelReg, 0x80);            // 清 FIFO
+    Write_MFRC522(CommIEnReg, waitIRq | 0x01 | 0x80);   // IRQ 腳: 做完或 timer 到
+    Write_MFRC522(CommIrqReg, 0x7F);           // 清中斷旗標
+    Write_MFRC522(FIFOLevelReg, 0x80);         // 清 FIFO
 
     Write_MFRC522(CommandReg, PCD_IDLE);       // 先 idle 一下
+    RC522_WaitArm();
 
     // 設定為 7 bits frame（REQA 是 7 bits）
     Write_MFRC522(BitFramingReg, 0x07);
@@ -564,24 +1045,20 @@ uchar MFRC522_Request_Simple(uchar reqMode, uchar *TagType)
     Write_MFRC522(CommandReg, PCD_TRANSCEIVE);
     SetBitMask(BitFramingReg, 0x80);           // StartSend=1
 
-    // 等待回應或 timeout
-    i = 2000;
-    do {
-        n = Read_MFRC522(CommIrqReg);
-        i--;
-    } while ( (i != 0) && !(n & 0x01) && !(n & waitIRq) );
+    // 等待回應或 timeout (RC522 timer 到會拉 TimerIRq)
+    done = RC522_WaitIrq(CommIrqReg, waitIRq | 0x01, &n);
 
     ClearBitMask(BitFramingReg, 0x80);         // StartSend=0
+    Write_MFRC522(CommIEnReg, 0x80);
 
-    if (i != 0) {
+    if (done) {
         uchar err = Read_MFRC522(ErrorReg);
         if (!(err & 0x1B)) {                   // 沒有 CRC / Coll / Protecol 錯誤
             status = MI_OK;
 
             uchar fifoLevel = Read_MFRC522(FIFOLevelReg);
             if (fifoLevel >= 2) {
-                TagType[0] = Read_MFRC522(FIFODataReg);
-                TagType[1] = Read_MFRC522(FIFODataReg);
+                Read_MFRC522_Burst(FIFODataReg, TagType, 2);
             } else {
                 status = MI_ERR;
             }
@@ -0,0 +1,68 @@
+#include "trace.h"
+#include "dbg_log.h"           // dbg_log_write
+#include "main.h"              // HAL_GetTick
+
+// ========================= Frame encoding =================================
+// payload = varint(fmt_id << 3 | level) varint(ms) varint(arg0) ...
+// frame   = COBS(payload) 0x00
+// COBS guarantees no 0x00 inside a frame, so the decoder can resync on any 0x00.
+
+static uint32_t put_varint(uint8_t *p, uint32_t v)
+{
+    uint32_t n = 0;
+    while (v >= 0x80U) {
+        p[n++] = (uint8_t)(v | 0x80U);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// COBS-encode src into dst and append the 0x00 delimiter; returns the frame length.
+static uint32_t cobs_encode(const uint8_t *src, uint32_t len, uint8_t *dst)
+{
+    uint32_t code_pos = 0;
+    uint32_t out      = 1;
+    uint8_t  code     = 1;
+
+    for (uint32_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_pos] = code;
+            code_pos = out++;
+            code     = 1;
+        } else {
+            dst[out++] = src[i];
+            if (++code == 0xFF) {
+                dst[code_pos] = code;
+                code_pos = out++;
+                code     = 1;
+            }
+        }
+    }
+    dst[code_pos] = code;
+    dst[out++]    = 0x00;
+    return out;
+}
+
+void trace_write(uint8_t level, uint32_t fmt_id, const uint32_t *args, uint32_t nargs)
+{
+    if (level > dbg_log_get_level()) {
+        return;
+    }
+
+    uint8_t  payload[TRACE_FRAME_MAX];
+    uint8_t  frame[TRACE_FRAME_MAX + TRACE_FRAME_MAX / 254 + 2];
+    uint32_t n = 0;
+
+    if (nargs > TRACE_MAX_ARGS) {
+        nargs = TRACE_MAX_ARGS;
+    }
+
+    n += put_varint(&payload[n], (fmt_id << 3) | (level & 0x07U));
+    n += put_varint(&payload[n], HAL_GetTick());
+    for (uint32_t i = 0; i < nargs; i++) {
+        n += put_varint(&payload[n], args[i]);
+    }
+
+    dbg_log_write(level, (const char *)frame, (int)cobs_encode(payload, n, frame));
+}
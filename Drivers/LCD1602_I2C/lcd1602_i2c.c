@@ -1,16 +1,21 @@
 #include "lcd1602_i2c.h"
 
+/* One PCF8574 write carries a whole sequence of port states: every byte is
+ * latched on the expander outputs after its ACK (~90 us apart at 100 kHz),
+ * which is longer than the HD44780 E pulse / setup / 37 us execution times.
+ * A nibble costs 2 bytes (E high, E low) plus 1 when RS changes. */
+#define LCD_BATCH_MAX	(4 * 16 + 2)	/* 16 characters + RS setup in one transfer */
+
 /* Private function prototypes */
-void RS_Pin(lcd1602_HandleTypeDef *lcd1602_Handle, FlagStatus status);
-void RW_Pin(lcd1602_HandleTypeDef *lcd1602_Handle, FlagStatus status);
-void E_Pin(lcd1602_HandleTypeDef *lcd1602_Handle, FlagStatus status);
 uint8_t CtrlPinsRetrieve(lcd1602_HandleTypeDef *lcd1602_Handle);
+static uint16_t Nibble_Pack(lcd1602_HandleTypeDef *lcd1602_Handle, uint8_t *buf, uint16_t len, uint8_t nibble, FlagStatus rs);
+static void Bus_Write(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *buf, uint16_t len);
 void Instruction_Write(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *instruction);
-void Data_Write(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *data);
+static void Instruction_WriteByte(lcd1602_HandleTypeDef *lcd1602_Handle, uint8_t instruction);
 
 void lcd1602_Init(lcd1602_HandleTypeDef *lcd1602_Handle, I2C_HandleTypeDef *hi2c, uint8_t address)
 {
-	HAL_Delay(100);
+	lcd1602_Delay(100);
 	/* Device specific info retrieve */
 	lcd1602_Handle->hi2c = hi2c;
 	lcd1602_Handle->address = address;
@@ -24,78 +29,74 @@ void lcd1602_Init(lcd1602_HandleTypeDef *lcd1602_Handle, I2C_HandleTypeDef *hi2c
 	lcd1602_Handle->dispBits.cursorState = DISABLE;
 	lcd1602_Handle->dispBits.blinkState = DISABLE;
 	/* At power on, all the ports are HIGH [PCF8574 datasheet] */
-	RS_Pin(lcd1602_Handle, RESET);
-	RW_Pin(lcd1602_Handle, RESET);
-	E_Pin(lcd1602_Handle, RESET);
+	lcd1602_Handle->ctrlPins.RS_Pin = RESET;
+	lcd1602_Handle->ctrlPins.RW_Pin = RESET;
+	lcd1602_Handle->ctrlPins.E_Pin = RESET;
 	lcd1602_LED(lcd1602_Handle, DISABLE);
 	/* Set 4-Bit Interface */
-	HAL_Delay(50);
+	lcd1602_Delay(50);
 	lcd1602_Handle->instruction = 0b00110000;
 	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	HAL_Delay(5);
+	lcd1602_Delay(5);
 	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	HAL_Delay(1);
+	lcd1602_Delay(1);
 	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
 	lcd1602_Handle->instruction = 0b00100000;
 	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
 	/* Specify the number of display lines and character font */
-	lcd1602_Handle->instruction = 0b00100000;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = 0b10000000;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
+	Instruction_WriteByte(lcd1602_Handle, 0b00101000);
 	/* Display off */
 	lcd1602_Display(lcd1602_Handle, DISABLE);
 	/* Display clear */
 	lcd1602_Clear(lcd1602_Handle);
 	/* Entry mode set */
-	lcd1602_Handle->instruction = 0b00000000;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = 0b01100000;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
+	Instruction_WriteByte(lcd1602_Handle, 0b00000110);
 	/* Display on */
 	lcd1602_Display(lcd1602_Handle, ENABLE);
 	/* LED backlight on */
-	HAL_Delay(500);
+	lcd1602_Delay(500);
 	lcd1602_LED(lcd1602_Handle, ENABLE);
-	HAL_Delay(500);
+	lcd1602_Delay(500);
 }
 
 void lcd1602_Print(lcd1602_HandleTypeDef *lcd1602_Handle, uint8_t *pString)
 {
-	do
+	uint8_t buf[LCD_BATCH_MAX];
+	uint16_t len = 0;
+
+	while (*pString != '\0')
 	{
+		if (len + 5 > LCD_BATCH_MAX)
+		{
+			Bus_Write(lcd1602_Handle, buf, len);
+			len = 0;
+		}
 		lcd1602_Handle->data = *pString++;
-		Data_Write(lcd1602_Handle, &lcd1602_Handle->data);
-		lcd1602_Handle->data = lcd1602_Handle->data << 4;
-		Data_Write(lcd1602_Handle, &lcd1602_Handle->data);
-	} while (*pString != '\0');
+		len = Nibble_Pack(lcd1602_Handle, buf, len, lcd1602_Handle->data & 0xF0, SET);
+		len = Nibble_Pack(lcd1602_Handle, buf, len, (uint8_t)(lcd1602_Handle->data << 4), SET);
+	}
+	Bus_Write(lcd1602_Handle, buf, len);
 }
 
 void lcd1602_SetCursor(lcd1602_HandleTypeDef *lcd1602_Handle, uint8_t col, uint8_t row)
 {
 	uint8_t DDRAM_address = col + (0x40 * row);
 	lcd1602_Handle->instruction = 0b10000000 | DDRAM_address;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = lcd1602_Handle->instruction << 4;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
+	Instruction_WriteByte(lcd1602_Handle, lcd1602_Handle->instruction);
 }
 
 void lcd1602_Clear(lcd1602_HandleTypeDef *lcd1602_Handle)
 {
 	lcd1602_Handle->instruction = 0b00000001;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = lcd1602_Handle->instruction << 4;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	HAL_Delay(2);
+	Instruction_WriteByte(lcd1602_Handle, lcd1602_Handle->instruction);
+	lcd1602_Delay(2);
 }
 
 void lcd1602_Home(lcd1602_HandleTypeDef *lcd1602_Handle)
 {
 	lcd1602_Handle->instruction = 0b00000010;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = lcd1602_Handle->instruction << 4;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	HAL_Delay(2);
+	Instruction_WriteByte(lcd1602_Handle, lcd1602_Handle->instruction);
+	lcd1602_Delay(2);
 }
 
 void lcd1602_Display(lcd1602_HandleTypeDef *lcd1602_Handle, FunctionalState state)
@@ -108,9 +109,7 @@ void lcd1602_Display(lcd1602_HandleTypeDef *lcd1602_Handle, FunctionalState stat
 		SET_BIT(lcd1602_Handle->instruction, 1 << 1);
 	if (lcd1602_Handle->dispBits.blinkState == ENABLE)
 		SET_BIT(lcd1602_Handle->instruction, 1 << 0);
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = lcd1602_Handle->instruction << 4;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
+	Instruction_WriteByte(lcd1602_Handle, lcd1602_Handle->instruction);
 }
 
 void lcd1602_Cursor(lcd1602_HandleTypeDef *lcd1602_Handle, FunctionalState state)
@@ -123,9 +122,7 @@ void lcd1602_Cursor(lcd1602_HandleTypeDef *lcd1602_Handle, FunctionalState state
 		SET_BIT(lcd1602_Handle->instruction, 1 << 1);
 	if (lcd1602_Handle->dispBits.blinkState == ENABLE)
 		SET_BIT(lcd1602_Handle->instruction, 1 << 0);
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = lcd1602_Handle->instruction << 4;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
+	Instruction_WriteByte(lcd1602_Handle, lcd1602_Handle->instruction);
 }
 
 void lcd1602_Blink(lcd1602_HandleTypeDef *lcd1602_Handle, FunctionalState state)
@@ -138,16 +135,14 @@ void lcd1602_Blink(lcd1602_HandleTypeDef *lcd1602_Handle, FunctionalState state)
 		SET_BIT(lcd1602_Handle->instruction, 1 << 1);
 	if (lcd1602_Handle->dispBits.blinkState == ENABLE)
 		SET_BIT(lcd1602_Handle->instruction, 1 << 0);
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = lcd1602_Handle->instruction << 4;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
+	Instruction_WriteByte(lcd1602_Handle, lcd1602_Handle->instruction);
 }
 
 void lcd1602_LED(lcd1602_HandleTypeDef *lcd1602_Handle, FunctionalState state)
 {
 	lcd1602_Handle->ctrlPins.LED = state;
 	uint8_t ctrlPins = CtrlPinsRetrieve(lcd1602_Handle);
-	HAL_I2C_Master_Transmit(lcd1602_Handle->hi2c, lcd1602_Handle->address, &ctrlPins, sizeof(ctrlPins), I2C_TIMEOUT);
+	Bus_Write(lcd1602_Handle, &ctrlPins, sizeof(ctrlPins));
 }
 
 void lcd1602_DisplayShift(lcd1602_HandleTypeDef *lcd1602_Handle, ShiftDirection direction)
@@ -155,9 +150,7 @@ void lcd1602_DisplayShift(lcd1602_HandleTypeDef *lcd1602_Handle, ShiftDirection
 	lcd1602_Handle->instruction = 0b00011000;
 	if (direction == ShiftRight)
 		SET_BIT(lcd1602_Handle->instruction, 1 << 2);
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = lcd1602_Handle->instruction << 4;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
+	Instruction_WriteByte(lcd1602_Handle, lcd1602_Handle->instruction);
 }
 
 void lcd1602_CursorShift(lcd1602_HandleTypeDef *lcd1602_Handle, ShiftDirection direction)
@@ -165,69 +158,69 @@ void lcd1602_CursorShift(lcd1602_HandleTypeDef *lcd1602_Handle, ShiftDirection d
 	lcd1602_Handle->instruction = 0b00010000;
 	if (direction == ShiftRight)
 		SET_BIT(lcd1602_Handle->instruction, 1 << 2);
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
-	lcd1602_Handle->instruction = lcd1602_Handle->instruction << 4;
-	Instruction_Write(lcd1602_Handle, &lcd1602_Handle->instruction);
+	Instruction_WriteByte(lcd1602_Handle, lcd1602_Handle->instruction);
 }
 
 /**
  *@section Private functions
  */
-void RS_Pin(lcd1602_HandleTypeDef *lcd1602_Handle, FlagStatus status)
+uint8_t CtrlPinsRetrieve(lcd1602_HandleTypeDef *lcd1602_Handle)
 {
-	if (lcd1602_Handle->ctrlPins.RS_Pin != status)
-	{
-		lcd1602_Handle->ctrlPins.RS_Pin = status;
-		uint8_t ctrlPins = CtrlPinsRetrieve(lcd1602_Handle);
-		HAL_I2C_Master_Transmit(lcd1602_Handle->hi2c, lcd1602_Handle->address, &ctrlPins, sizeof(ctrlPins), I2C_TIMEOUT);
-	}
+	return (uint8_t)(lcd1602_Handle->ctrlPins.RS_Pin << 0 | lcd1602_Handle->ctrlPins.RW_Pin << 1 | lcd1602_Handle->ctrlPins.E_Pin << 2 | lcd1602_Handle->ctrlPins.LED << 3);
 }
 
-void RW_Pin(lcd1602_HandleTypeDef *lcd1602_Handle, FlagStatus status)
+/* Append the port states for one nibble (bits 7..4 of nibble) to buf:
+ * [RS/RW setup, E low] if RS changes, then [E high] and [E low]; data stays on
+ * D7..D4 while E falls. Returns the new length. */
+static uint16_t Nibble_Pack(lcd1602_HandleTypeDef *lcd1602_Handle, uint8_t *buf, uint16_t len, uint8_t nibble, FlagStatus rs)
 {
-	if (lcd1602_Handle->ctrlPins.RW_Pin != status)
+	nibble &= 0xF0;
+	if (lcd1602_Handle->ctrlPins.RS_Pin != rs || lcd1602_Handle->ctrlPins.RW_Pin != RESET || lcd1602_Handle->ctrlPins.E_Pin != RESET)
 	{
-		lcd1602_Handle->ctrlPins.RW_Pin = status;
-		uint8_t ctrlPins = CtrlPinsRetrieve(lcd1602_Handle);
-		HAL_I2C_Master_Transmit(lcd1602_Handle->hi2c, lcd1602_Handle->address, &ctrlPins, sizeof(ctrlPins), I2C_TIMEOUT);
+		lcd1602_Handle->ctrlPins.RS_Pin = rs;
+		lcd1602_Handle->ctrlPins.RW_Pin = RESET;
+		lcd1602_Handle->ctrlPins.E_Pin = RESET;
+		buf[len++] = CtrlPinsRetrieve(lcd1602_Handle) | nibble;
 	}
+	lcd1602_Handle->ctrlPins.E_Pin = SET;
+	buf[len++] = CtrlPinsRetrieve(lcd1602_Handle) | nibble;
+	lcd1602_Handle->ctrlPins.E_Pin = RESET;
+	buf[len++] = CtrlPinsRetrieve(lcd1602_Handle) | nibble;
+	return len;
 }
 
-void E_Pin(lcd1602_HandleTypeDef *lcd1602_Handle, FlagStatus status)
+static void Bus_Write(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *buf, uint16_t len)
 {
-	if (lcd1602_Handle->ctrlPins.E_Pin != status)
-	{
-		lcd1602_Handle->ctrlPins.E_Pin = status;
-		uint8_t ctrlPins = CtrlPinsRetrieve(lcd1602_Handle);
-		HAL_I2C_Master_Transmit(lcd1602_Handle->hi2c, lcd1602_Handle->address, &ctrlPins, sizeof(ctrlPins), I2C_TIMEOUT);
-	}
+	if (len > 0)
+		lcd1602_BusWrite(lcd1602_Handle, buf, len);
 }
 
-uint8_t CtrlPinsRetrieve(lcd1602_HandleTypeDef *lcd1602_Handle)
+/**
+ *@section Bus / delay hooks (blocking defaults, the application may override them)
+ */
+__weak HAL_StatusTypeDef lcd1602_BusWrite(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *buf, uint16_t len)
 {
-	return (uint8_t)(lcd1602_Handle->ctrlPins.RS_Pin << 0 | lcd1602_Handle->ctrlPins.RW_Pin << 1 | lcd1602_Handle->ctrlPins.E_Pin << 2 | lcd1602_Handle->ctrlPins.LED << 3);
+	return HAL_I2C_Master_Transmit(lcd1602_Handle->hi2c, lcd1602_Handle->address, (uint8_t *)buf, len, I2C_TIMEOUT);
+}
+
+__weak void lcd1602_Delay(uint32_t ms)
+{
+	HAL_Delay(ms);
 }
 
+/* Single nibble (only used by the 8-bit mode wake-up sequence in lcd1602_Init) */
 void Instruction_Write(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *instruction)
 {
-	uint8_t ctrlPinsAndInstruction;
-	RS_Pin(lcd1602_Handle, RESET);
-	RW_Pin(lcd1602_Handle, RESET);
-	E_Pin(lcd1602_Handle, SET);
-	MODIFY_REG(ctrlPinsAndInstruction, 0xF, CtrlPinsRetrieve(lcd1602_Handle));
-	MODIFY_REG(ctrlPinsAndInstruction, 0xF0, (*instruction) & 0xF0);
-	HAL_I2C_Master_Transmit(lcd1602_Handle->hi2c, lcd1602_Handle->address, &ctrlPinsAndInstruction, sizeof(ctrlPinsAndInstruction), I2C_TIMEOUT);
-	E_Pin(lcd1602_Handle, RESET);
-}
-
-void Data_Write(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *data)
-{
-	uint8_t ctrlPinsAndData;
-	RS_Pin(lcd1602_Handle, SET);
-	RW_Pin(lcd1602_Handle, RESET);
-	E_Pin(lcd1602_Handle, SET);
-	MODIFY_REG(ctrlPinsAndData, 0xF, CtrlPinsRetrieve(lcd1602_Handle));
-	MODIFY_REG(ctrlPinsAndData, 0xF0, (*data) & 0xF0);
-	HAL_I2C_Master_Transmit(lcd1602_Handle->hi2c, lcd1602_Handle->address, &ctrlPinsAndData, sizeof(ctrlPinsAndData), I2C_TIMEOUT);
-	E_Pin(lcd1602_Handle, RESET);
-}
\ No newline at end of file
+	uint8_t buf[3];
+	uint16_t len = Nibble_Pack(lcd1602_Handle, buf, 0, *instruction, RESET);
+	Bus_Write(lcd1602_Handle, buf, len);
+}
+
+/* Both nibbles of an instruction in one I2C transfer */
+static void Instruction_WriteByte(lcd1602_HandleTypeDef *lcd1602_Handle, uint8_t instruction)
+{
+	uint8_t buf[6];
+	uint16_t len = Nibble_Pack(lcd1602_Handle, buf, 0, instruction & 0xF0, RESET);
+	len = Nibble_Pack(lcd1602_Handle, buf, len, (uint8_t)(instruction << 4), RESET);
+	Bus_Write(lcd1602_Handle, buf, len);
+}
@@ -133,4 +133,24 @@ void lcd1602_DisplayShift(lcd1602_HandleTypeDef *lcd1602_Handle, ShiftDirection
  * @retval	none
  */
 void lcd1602_CursorShift(lcd1602_HandleTypeDef *lcd1602_Handle, ShiftDirection direction);
+
+/**
+ * @brief	Sends a packed PCF8574 port sequence (weak, default: blocking HAL_I2C_Master_Transmit).
+ *			An override may queue the bytes and return before they are on the bus;
+ *			buf is only valid during the call.
+ * @param	lcd1602_Handle: pointer to the user-declared lcd1602 descriptor
+ * @param	buf: port states, one byte per PCF8574 output update
+ * @param	len: number of bytes
+ * @retval	HAL status
+ */
+HAL_StatusTypeDef lcd1602_BusWrite(lcd1602_HandleTypeDef *lcd1602_Handle, const uint8_t *buf, uint16_t len);
+
+/**
+ * @brief	Waits for HD44780 execution time (weak, default: HAL_Delay).
+ *			An override must not return before everything queued by lcd1602_BusWrite
+ *			has been sent and then ms have passed.
+ * @param	ms: delay in milliseconds
+ * @retval	none
+ */
+void lcd1602_Delay(uint32_t ms);
 #endif
\ No newline at end of file
@@ -0,0 +1,671 @@
+// carddb_bench.c  — card_db 在 host 上的 benchmark
+//
+// 用 flash_sim 取代真的 Flash，量測：
+//   - carddb_add / carddb_remove 吞吐量 (CPU 時間 + 模擬 Flash 時間)
+//   - carddb_init 開機 replay 時間
+//   - carddb_check 查詢延遲 (命中 / 未命中)
+//   - 大量 add/remove 之後的開機時間 (checkpoint 讓它不隨 log 長度增加)
+//   - carddb_add_batch (藍牙批次匯入) 跟一張一張 add 比，carddb_export 能不能完整匯出
+//   - 斷電 (torn write / 只寫一半的 word) 之後 carddb_init 能不能還原正確的白名單
+//   - 斷電在 transaction (批次匯入) 中間：每一批要嘛全部在、要嘛全部不在
+//   - --replay：寫滿一整個 sector 的 ADD/DEL 之後 carddb_init 的時間 (比較 CRC 算法，
+//     make crcbench 會用不同的 CARD_DB_FORMAT_VERSION / CARD_DB_CRC16_SLICES 各編一次)
+//   - 7 / 10 byte UID：跟 4 byte 卡混在一起 add / remove / transaction / GC / 斷電
+//
+// 用法: ./carddb_bench [-v] [--replay] [N ...]     (預設 N = 32 1024 10000)
+
+#include "card_db.h"
+#include "flash_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_LOOKUPS   200000
+#define BENCH_CHURN     4000    // add/remove pairs on one extra card
+#define BENCH_BATCH     50      // UIDs per carddb_add_batch call (one BT frame)
+
+#define CUT_BASE_CARDS  100     // cards written before power is cut
+#define CUT_MAX_CARDS   400     // stop adding here if the cut never happens
+#define CUT_MAX_WORDS   4000    // cut points tried: 0 .. CUT_MAX_WORDS
+#define CUT_STEP        3
+#define TXN_CUT_BATCHES 12      // batches of BENCH_BATCH cards tried per cut point
+#define TXN_CUT_MAX     1000    // cut points tried: 0 .. TXN_CUT_MAX words
+#define REPLAY_CARDS    1000    // whitelist size for --replay
+#define REPLAY_RUNS     20
+#define LONG_SHORT      100     // 4-byte cards mixed with the long ones
+#define LONG_CUT_MAX    600     // cut points tried while adding long UIDs
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+// Deterministic 4-byte UID, spread so neighbouring ids differ in every byte.
+static void make_uid(uint32_t id, card_uid_t *uid)
+{
+    uint32_t x = id * 2654435761U + 0x9E3779B9U;
+    uid->len    = 4;
+    uid->uid[0] = (uint8_t)(x >> 24);
+    uid->uid[1] = (uint8_t)(x >> 16);
+    uid->uid[2] = (uint8_t)(x >> 8);
+    uid->uid[3] = (uint8_t)(x);
+}
+
+// The same card as the CARD_UID_SIZE key of the batch / export API (UID + BCC).
+static void make_key(uint32_t id, uint8_t key[CARD_UID_SIZE])
+{
+    card_uid_t uid;
+    make_uid(id, &uid);
+    memcpy(key, uid.uid, 4);
+    key[4] = key[0] ^ key[1] ^ key[2] ^ key[3];
+}
+
+// Deterministic 7-byte (odd id) or 10-byte (even id) UID whose first four
+// bytes are the same as the 4-byte card make_uid(id), so prefixes collide.
+static void make_long_uid(uint32_t id, card_uid_t *uid)
+{
+    uint32_t y = id * 0x85EBCA6BU + 0xC2B2AE35U;
+    make_uid(id, uid);
+    uid->len = (id & 1U) ? 7 : 10;
+    for (int i = 4; i < uid->len; i++) {
+        uid->uid[i] = (uint8_t)(y >> ((i & 3) * 8)) ^ (uint8_t)i;
+    }
+}
+
+static double sim_ms(void)
+{
+    return (double)flash_sim_get_stats()->busy_us / 1000.0;
+}
+
+static int bench_size(int n)
+{
+    card_uid_t uid;
+    double  t0, t1;
+    int     failures = 0;
+
+    if (n > CARD_DB_MAX_CARDS) {
+        printf("N=%d skipped: CARD_DB_MAX_CARDS=%d\n", n, CARD_DB_MAX_CARDS);
+        return 0;
+    }
+
+    flash_sim_reset();
+    carddb_init();
+
+    // ---- add ----
+    flash_sim_clear_stats();
+    t0 = now_us();
+    for (int i = 0; i < n; i++) {
+        make_uid((uint32_t)i, &uid);
+        if (carddb_add(&uid) != CARDDB_OK) {
+            failures++;
+        }
+    }
+    t1 = now_us();
+    printf("N=%-6d add     : %9.2f us/op cpu, %9.2f ms flash, erases=%lu\n",
+           n, (t1 - t0) / n, sim_ms(),
+           (unsigned long)flash_sim_get_stats()->sectors_erased);
+
+    // ---- replay ----
+    t0 = now_us();
+    carddb_init();
+    t1 = now_us();
+    int cnt = carddb_get_all(NULL, 0);
+    printf("N=%-6d init    : %9.2f ms cpu, cards=%d\n",
+           n, (t1 - t0) / 1000.0, cnt);
+    if (cnt != n) {
+        failures++;
+    }
+
+    // ---- lookup (hit / miss) ----
+    int hits = 0;
+    t0 = now_us();
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        make_uid((uint32_t)(i % n), &uid);
+        hits += carddb_check(&uid);
+    }
+    t1 = now_us();
+    printf("N=%-6d check hit : %7.1f ns/op\n",
+           n, (t1 - t0) * 1000.0 / BENCH_LOOKUPS);
+    if (hits != BENCH_LOOKUPS) {
+        failures++;
+    }
+
+    hits = 0;
+    t0 = now_us();
+    for (int i = 0; i < BENCH_LOOKUPS; i++) {
+        make_uid((uint32_t)(n + i), &uid);
+        hits += carddb_check(&uid);
+    }
+    t1 = now_us();
+    printf("N=%-6d check miss: %7.1f ns/op\n",
+           n, (t1 - t0) * 1000.0 / BENCH_LOOKUPS);
+    if (hits != 0) {
+        failures++;
+    }
+
+    // ---- remove half ----
+    int removes = (n + 1) / 2;
+    flash_sim_clear_stats();
+    t0 = now_us();
+    for (int i = 0; i < removes; i++) {
+        make_uid((uint32_t)(i * 2 % n), &uid);
+        if (carddb_remove(&uid) != CARDDB_OK) {
+            failures++;
+        }
+    }
+    t1 = now_us();
+    printf("N=%-6d remove  : %9.2f us/op cpu, %9.2f ms flash, erases=%lu\n",
+           n, (t1 - t0) / removes, sim_ms(),
+           (unsigned long)flash_sim_get_stats()->sectors_erased);
+
+    t0 = now_us();
+    carddb_init();
+    t1 = now_us();
+    cnt = carddb_get_all(NULL, 0);
+    printf("N=%-6d re-init : %9.2f ms cpu, cards=%d\n",
+           n, (t1 - t0) / 1000.0, cnt);
+    if (cnt != n - removes) {
+        failures++;
+    }
+
+    // ---- churn: long log, same whitelist ----
+    make_uid((uint32_t)n, &uid);
+    for (int i = 0; i < BENCH_CHURN; i++) {
+        if (carddb_add(&uid) != CARDDB_OK || carddb_remove(&uid) != CARDDB_OK) {
+            failures++;
+        }
+    }
+    t0 = now_us();
+    carddb_init();
+    t1 = now_us();
+    cnt = carddb_get_all(NULL, 0);
+    printf("N=%-6d churn-init: %7.2f ms cpu, cards=%d (after %d add/remove)\n",
+           n, (t1 - t0) / 1000.0, cnt, BENCH_CHURN);
+    if (cnt != n - removes) {
+        failures++;
+    }
+
+    if (failures) {
+        printf("N=%-6d FAILURES=%d\n", n, failures);
+    }
+    return failures;
+}
+
+// Import n cards the way the BT provisioning protocol does, then export them back.
+static int bench_batch(int n)
+{
+    uint8_t  uids[BENCH_BATCH * CARD_UID_SIZE];
+    uint32_t applied, total = 0;
+    double   t0, t1;
+    int      failures = 0;
+
+    if (n > CARD_DB_MAX_CARDS) {
+        return 0;
+    }
+
+    flash_sim_reset();
+    carddb_init();
+
+    flash_sim_clear_stats();
+    t0 = now_us();
+    for (int i = 0; i < n; i += BENCH_BATCH) {
+        int k = (n - i < BENCH_BATCH) ? n - i : BENCH_BATCH;
+        for (int j = 0; j < k; j++) {
+            make_key((uint32_t)(i + j), &uids[j * CARD_UID_SIZE]);
+        }
+        if (carddb_add_batch(uids, (uint32_t)k, &applied) != CARDDB_OK) {
+            failures++;
+        }
+        total += applied;
+    }
+    t1 = now_us();
+    printf("N=%-6d batch add: %9.2f us/op cpu, %9.2f ms flash, erases=%lu\n",
+           n, (t1 - t0) / n, sim_ms(),
+           (unsigned long)flash_sim_get_stats()->sectors_erased);
+    if ((int)total != n) {
+        failures++;
+    }
+
+    // Same UIDs again: all duplicates, nothing written.
+    make_key(0, uids);
+    if (carddb_add_batch(uids, 1, &applied) != CARDDB_OK || applied != 0) {
+        failures++;
+    }
+
+    // A new card with a wrong BCC in the middle: the whole batch is refused.
+    make_key((uint32_t)n, &uids[0]);
+    make_key((uint32_t)n + 1U, &uids[CARD_UID_SIZE]);
+    uids[CARD_UID_SIZE + 4] ^= 0x01;
+    if (carddb_add_batch(uids, 2, &applied) != CARDDB_ERR_UID || applied != 0) {
+        failures++;
+    }
+
+    carddb_init();
+    if (carddb_get_all(NULL, 0) != n) {
+        failures++;
+    }
+
+    // Export in BT-frame-sized pieces; every card exactly once.
+    uint32_t cursor = 0, got, seen = 0;
+    while ((got = carddb_export(&cursor, uids, BENCH_BATCH)) > 0) {
+        for (uint32_t j = 0; j < got; j++) {
+            card_uid_t uid = { .len = 4 };
+            memcpy(uid.uid, &uids[j * CARD_UID_SIZE], 4);
+            seen += (uint32_t)carddb_check(&uid);
+        }
+    }
+    if ((int)seen != n) {
+        failures++;
+    }
+
+    if (failures) {
+        printf("N=%-6d batch FAILURES=%d\n", n, failures);
+    }
+    return failures;
+}
+
+// Cut power after `cut` more Flash words while cards are being added, then
+// check that replay keeps every completed add and the log still accepts new records.
+static int power_cut_once(uint32_t cut)
+{
+    card_uid_t uid;
+    int     failures = 0;
+    int     done;
+
+    flash_sim_reset();
+    carddb_init();
+    for (done = 0; done < CUT_BASE_CARDS; done++) {
+        make_uid((uint32_t)done, &uid);
+        carddb_add(&uid);
+    }
+
+    flash_sim_power_cut_after(cut);
+    while (!flash_sim_power_is_cut() && done < CUT_MAX_CARDS) {
+        make_uid((uint32_t)done, &uid);
+        carddb_add(&uid);
+        done++;
+    }
+    int in_flight = flash_sim_power_is_cut();   // card done-1 may or may not be there
+    flash_sim_power_restore();
+
+    carddb_init();
+    int complete = in_flight ? done - 1 : done;
+    int cnt      = carddb_get_all(NULL, 0);
+    for (int i = 0; i < complete; i++) {
+        make_uid((uint32_t)i, &uid);
+        if (!carddb_check(&uid)) {
+            failures++;
+        }
+    }
+    if (cnt < complete || cnt > done) {
+        failures++;
+    }
+
+    // Append after the torn write and make sure it survives the next boot.
+    make_uid(0xC0FFEEU, &uid);
+    if (carddb_add(&uid) != CARDDB_OK) {
+        failures++;
+    }
+    carddb_init();
+    if (!carddb_check(&uid) || carddb_get_all(NULL, 0) != cnt + 1) {
+        failures++;
+    }
+
+    if (failures) {
+        printf("power-cut after %lu words: cards=%d expected %d..%d FAIL\n",
+               (unsigned long)cut, cnt, complete, done);
+    }
+    return failures;
+}
+
+static int bench_power_cut(void)
+{
+    int    failures = 0;
+    int    images   = 0;
+    double t0       = now_us();
+
+    for (uint32_t cut = 0; cut <= CUT_MAX_WORDS; cut += CUT_STEP) {
+        failures += power_cut_once(cut);
+        images++;
+    }
+
+    printf("power-cut: %d torn images, %.2f ms, failures=%d\n",
+           images, (now_us() - t0) / 1000.0, failures);
+    return failures;
+}
+
+// Fill uids[] with batch b (BENCH_BATCH consecutive ids).
+static void make_batch(int b, uint8_t *uids)
+{
+    for (int j = 0; j < BENCH_BATCH; j++) {
+        make_key((uint32_t)(b * BENCH_BATCH + j), &uids[j * CARD_UID_SIZE]);
+    }
+}
+
+// Cards of batch b that are in the whitelist.
+static int batch_present(int b)
+{
+    card_uid_t uid;
+    int     n = 0;
+
+    for (int j = 0; j < BENCH_BATCH; j++) {
+        make_uid((uint32_t)(b * BENCH_BATCH + j), &uid);
+        n += carddb_check(&uid);
+    }
+    return n;
+}
+
+// Cut power while batches are being committed: after reboot every batch
+// before the cut must be complete, the one in flight all-or-nothing.
+static int txn_power_cut_once(uint32_t cut)
+{
+    uint8_t uids[BENCH_BATCH * CARD_UID_SIZE];
+    int     failures = 0;
+    int     b;
+
+    flash_sim_reset();
+    carddb_init();
+    make_batch(0, uids);
+    carddb_add_batch(uids, BENCH_BATCH, NULL);
+
+    flash_sim_power_cut_after(cut);
+    for (b = 1; b < TXN_CUT_BATCHES && !flash_sim_power_is_cut(); b++) {
+        make_batch(b, uids);
+        carddb_add_batch(uids, BENCH_BATCH, NULL);
+    }
+    int in_flight = flash_sim_power_is_cut() ? b - 1 : -1;
+    flash_sim_power_restore();
+
+    carddb_init();
+    for (int i = 0; i < b; i++) {
+        int n = batch_present(i);
+        if (n != BENCH_BATCH && !(i == in_flight && n == 0)) {
+            printf("txn power-cut after %lu words: batch %d has %d/%d cards FAIL\n",
+                   (unsigned long)cut, i, n, BENCH_BATCH);
+            failures++;
+        }
+    }
+
+    // The log must take the next batch after the torn one.
+    make_batch(TXN_CUT_BATCHES, uids);
+    if (carddb_add_batch(uids, BENCH_BATCH, NULL) != CARDDB_OK) {
+        failures++;
+    }
+    carddb_init();
+    if (batch_present(TXN_CUT_BATCHES) != BENCH_BATCH) {
+        failures++;
+    }
+    return failures;
+}
+
+static int bench_txn_power_cut(void)
+{
+    int    failures = 0;
+    int    images   = 0;
+    double t0       = now_us();
+
+    for (uint32_t cut = 0; cut <= TXN_CUT_MAX; cut += CUT_STEP) {
+        failures += txn_power_cut_once(cut);
+        images++;
+    }
+
+    printf("txn power-cut: %d torn images, %.2f ms, failures=%d\n",
+           images, (now_us() - t0) / 1000.0, failures);
+    return failures;
+}
+
+// Fill the active sector with ADD/DEL records and time carddb_init over it.
+// Built with checkpoints off (make crcbench) every record in the sector is
+// CRC-checked, so this is mostly the checksum cost.
+static int bench_replay_full(void)
+{
+    card_uid_t        uid;
+    carddb_stats_t st;
+    uint32_t       c = REPLAY_CARDS;
+
+    flash_sim_reset();
+    carddb_init();
+    for (uint32_t i = 0; i < REPLAY_CARDS; i++) {
+        make_uid(i, &uid);
+        carddb_add(&uid);
+    }
+    for (;;) {
+        carddb_get_stats(&st);
+        if (st.log_used + 2U * 12U > st.log_size) {
+            break;
+        }
+        make_uid(c, &uid);
+        carddb_add(&uid);
+        make_uid(c, &uid);
+        carddb_remove(&uid);
+        c++;
+    }
+
+    double t0 = now_us();
+    for (int r = 0; r < REPLAY_RUNS; r++) {
+        carddb_init();
+    }
+    double t1 = now_us();
+
+    int ok = carddb_get_all(NULL, 0) == REPLAY_CARDS;
+    printf("replay full sector: fmt=%s crc16=%s ckpt_min_ops=%d log=%lu bytes: %.3f ms cpu%s\n",
+           CARD_DB_FORMAT_VERSION == CARD_FMT_CRC32 ? "crc32" : "crc16",
+           CARD_DB_CRC16_SLICES ? "slice-by-4" : "bitwise", CARD_DB_CKPT_MIN_OPS,
+           (unsigned long)st.log_used, (t1 - t0) / 1000.0 / REPLAY_RUNS, ok ? "" : " FAIL");
+    return ok ? 0 : 1;
+}
+
+static int long_present(uint32_t from, uint32_t n)
+{
+    card_uid_t uid;
+    int        hits = 0;
+    for (uint32_t i = from; i < from + n; i++) {
+        make_long_uid(i, &uid);
+        hits += carddb_check(&uid);
+    }
+    return hits;
+}
+
+// BT backup / restore the way EXPORT_UIDS + ADD_UIDS do it: export the current
+// whitelist in frame-sized [len][UID] pieces, wipe Flash, import them back.
+static int bench_uid_backup(void)
+{
+    static uint8_t  dump[(CARD_DB_MAX_CARDS + CARD_DB_MAX_LONG_CARDS) * (1 + CARD_UID_MAX_LEN)];
+    static uint32_t part[CARD_DB_MAX_CARDS + CARD_DB_MAX_LONG_CARDS];
+    uint32_t        cursor = 0, size = 0, nparts = 0, applied, total = 0, n;
+    int             failures = 0;
+    int             cards    = carddb_get_all(NULL, 0);
+    uint8_t         bad[1 + CARD_UID_MAX_LEN] = { 5 };
+
+    while ((n = carddb_export_uids(&cursor, dump + size, BENCH_BATCH * CARD_UID_SIZE)) > 0) {
+        uint32_t start = size;
+        for (uint32_t i = 0; i < n; i++) {
+            size += 1U + dump[size];
+        }
+        part[nparts++] = size - start;
+    }
+
+    flash_sim_reset();
+    carddb_init();
+    size = 0;
+    for (uint32_t i = 0; i < nparts; i++) {
+        if (carddb_add_uids(dump + size, part[i], &applied) != CARDDB_OK) {
+            failures++;
+        }
+        total += applied;
+        size  += part[i];
+    }
+    carddb_init();
+    if ((int)total != cards || carddb_get_all(NULL, 0) != cards ||
+        long_present(0, 1) != 1 || long_present(1, 1) != 0) {
+        failures++;
+    }
+
+    // A 5-byte UID entry is refused as a whole.
+    if (carddb_add_uids(bad, 6, &applied) != CARDDB_ERR_UID || applied != 0) {
+        failures++;
+    }
+
+    printf("uid backup: %d cards in %lu frames, failures=%d\n", cards,
+           (unsigned long)nparts, failures);
+    return failures;
+}
+
+// 7 / 10-byte UIDs next to 4-byte cards with the same first four bytes:
+// add / remove / reboot / GC / transaction, then torn writes of long records.
+static int bench_long_uid(void)
+{
+    card_uid_t     uid;
+    carddb_stats_t st;
+    int            failures = 0;
+    int            images   = 0;
+
+    flash_sim_reset();
+    carddb_init();
+    for (uint32_t i = 0; i < LONG_SHORT; i++) {
+        make_uid(i, &uid);
+        carddb_add(&uid);
+    }
+    for (uint32_t i = 0; i < CARD_DB_MAX_LONG_CARDS; i++) {
+        make_long_uid(i, &uid);
+        if (carddb_add(&uid) != CARDDB_OK) {
+            failures++;
+        }
+    }
+    make_long_uid(CARD_DB_MAX_LONG_CARDS, &uid);
+    if (carddb_add(&uid) != CARDDB_ERR_FULL) {
+        failures++;
+    }
+    uid.len = 5;
+    if (carddb_add(&uid) != CARDDB_ERR_UID) {
+        failures++;
+    }
+
+    // Removing the 4-byte card must not touch the long one with its prefix.
+    make_uid(0, &uid);
+    carddb_remove(&uid);
+    make_long_uid(1, &uid);
+    carddb_remove(&uid);
+    carddb_init();
+    make_uid(0, &uid);
+    if (carddb_check(&uid) || long_present(0, 1) != 1 || long_present(1, 1) != 0 ||
+        long_present(2, CARD_DB_MAX_LONG_CARDS - 2) != CARD_DB_MAX_LONG_CARDS - 2) {
+        failures++;
+    }
+
+    // Churn a 4-byte card until the log has been checkpointed / collected.
+    make_uid(LONG_SHORT, &uid);
+    for (int i = 0; i < BENCH_CHURN; i++) {
+        carddb_add(&uid);
+        carddb_remove(&uid);
+    }
+    carddb_init();
+    carddb_get_stats(&st);
+    if (st.long_cards != CARD_DB_MAX_LONG_CARDS - 1 ||
+        carddb_get_all(NULL, 0) != LONG_SHORT - 1 + CARD_DB_MAX_LONG_CARDS - 1) {
+        failures++;
+    }
+
+    // One transaction mixing long removes and 4-byte adds.
+    carddb_txn_begin();
+    for (uint32_t i = 2; i < 32; i++) {
+        make_long_uid(i, &uid);
+        carddb_txn_remove(&uid);
+        make_uid(LONG_SHORT + 1 + i, &uid);
+        carddb_txn_add(&uid);
+    }
+    if (carddb_txn_commit(NULL) != CARDDB_OK) {
+        failures++;
+    }
+    carddb_init();
+    if (long_present(2, 30) != 0 || long_present(32, 10) != 10) {
+        failures++;
+    }
+    carddb_txn_begin();
+    for (uint32_t i = 2; i < 32; i++) {
+        make_long_uid(i, &uid);
+        carddb_txn_add(&uid);
+    }
+    carddb_txn_commit(NULL);
+    carddb_init();
+    if (long_present(2, 30) != 30) {
+        failures++;
+    }
+    carddb_get_stats(&st);
+    printf("long uid: %lu long + %d short cards, log=%lu bytes, failures=%d\n",
+           (unsigned long)st.long_cards, carddb_get_all(NULL, 0) - (int)st.long_cards,
+           (unsigned long)st.log_used, failures);
+
+    failures += bench_uid_backup();
+
+    // Torn writes while long UIDs are added: every completed add survives.
+    for (uint32_t cut = 0; cut <= LONG_CUT_MAX; cut += CUT_STEP) {
+        uint32_t done;
+        flash_sim_reset();
+        carddb_init();
+        for (uint32_t i = 0; i < 20; i++) {
+            make_long_uid(i, &uid);
+            carddb_add(&uid);
+        }
+        flash_sim_power_cut_after(cut);
+        for (done = 20; done < 200 && !flash_sim_power_is_cut(); done++) {
+            make_long_uid(done, &uid);
+            carddb_add(&uid);
+        }
+        int torn = flash_sim_power_is_cut();
+        flash_sim_power_restore();
+        carddb_init();
+        int got = long_present(0, done);
+        if (got != (int)done && !(torn && got == (int)done - 1)) {
+            printf("long uid power-cut after %lu words: %d/%lu cards FAIL\n",
+                   (unsigned long)cut, got, (unsigned long)done);
+            failures++;
+        }
+        make_long_uid(done + 1, &uid);
+        if (carddb_add(&uid) != CARDDB_OK || long_present(done + 1, 1) != 1) {
+            failures++;
+        }
+        images++;
+    }
+    printf("long uid power-cut: %d torn images, failures=%d\n", images, failures);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    static const int default_sizes[] = { 32, 1024, 10000 };
+    int sizes[16];
+    int nsizes = 0;
+    int failures = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            flash_sim_set_verbose(1);
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            return bench_replay_full();
+        } else if (nsizes < (int)(sizeof(sizes) / sizeof(sizes[0]))) {
+            sizes[nsizes++] = atoi(argv[i]);
+        }
+    }
+    if (nsizes == 0) {
+        for (size_t i = 0; i < sizeof(default_sizes) / sizeof(default_sizes[0]); i++) {
+            sizes[nsizes++] = default_sizes[i];
+        }
+    }
+
+    printf("card_db host bench: CARD_DB_MAX_CARDS=%d index=%s mount=%s\n",
+           CARD_DB_MAX_CARDS, CARD_DB_HASH_INDEX ? "hash" : "scan",
+           CARD_DB_FAST_MOUNT ? "bsearch" : "linear");
+    for (int i = 0; i < nsizes; i++) {
+        failures += bench_size(sizes[i]);
+        failures += bench_batch(sizes[i]);
+    }
+    failures += bench_power_cut();
+    failures += bench_txn_power_cut();
+    failures += bench_long_uid();
+
+    return failures ? 1 : 0;
+}
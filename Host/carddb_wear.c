@@ -0,0 +1,342 @@
+// carddb_wear.c  — card_db 多 sector wear leveling 的 host 模擬
+//
+// 先放一批基本白名單，再做很多次「加一張新卡 / 刪掉最舊的一張」，統計：
+//   - 每個 sector 被 erase 幾次 (min / max / 平均 / 標準差)
+//   - write amplification：Flash 實際寫入的 byte / (使用者操作數 x 一筆 record 12 byte)
+//     其中 GC 搬資料佔多少 (有 erase 的那次操作多寫的部分)
+//   - 重開機後從 sector header 讀回來的 erase 次數跟模擬器記錄的一樣
+//   - 斷電在 GC 中間 (checkpoint / OPEN / erase 舊 sector 任何一步)，白名單都還在
+//   - 背景 GC (每個操作之間叫一次 carddb_gc_step，模擬低優先權 task)：
+//     前景單一 add / remove 最久佔用 Flash 多久，跟全部在 carddb_add 裡做 GC 比
+//   - 斷電在背景 GC 搬移途中 (同時還在加卡 / 刪卡)，做完的操作都還在
+//
+// 用法: ./carddb_wear [cycles] [base_cards]     (預設 1000000 次、1000 張)
+
+#include "card_db.h"
+#include "flash_sim.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WEAR_REC_BYTES   12U     // sizeof(card_log_t): one ADD / DEL record
+#define WEAR_REBOOT_EVERY 100000 // carddb_init in the middle of the churn
+#define GC_CUT_BASE      200     // cards in the whitelist for the GC power-cut sweep
+#define GC_CUT_STEP      7
+#define BG_CUT_OPS       100     // interleaved add/remove + gc_step rounds per cut point
+
+static const uint8_t g_sectors[] = CARD_DB_SECTORS;
+#define WEAR_SECTORS     ((int)sizeof(g_sectors))
+
+// Same UID generator as carddb_bench.c.
+static void make_uid(uint32_t id, card_uid_t *uid)
+{
+    uint32_t x = id * 2654435761U + 0x9E3779B9U;
+    uid->len    = 4;
+    uid->uid[0] = (uint8_t)(x >> 24);
+    uid->uid[1] = (uint8_t)(x >> 16);
+    uid->uid[2] = (uint8_t)(x >> 8);
+    uid->uid[3] = (uint8_t)(x);
+}
+
+static uint64_t g_worst_op_us;  // Longest simulated Flash time of one add / remove
+
+// One user operation; words programmed beyond its own record by an op that
+// ran GC (or by the background steps) go to *gc_words.
+static int wear_op(int add, uint32_t id, uint64_t *gc_words)
+{
+    const flash_sim_stats_t *s = flash_sim_get_stats();
+    uint32_t words0  = s->words_programmed;
+    uint32_t erased0 = s->sectors_erased;
+    uint64_t busy0   = s->busy_us;
+    card_uid_t  uid;
+    carddb_stats_t before, after;
+
+    carddb_get_stats(&before);
+    make_uid(id, &uid);
+    carddb_status_t st = add ? carddb_add(&uid) : carddb_remove(&uid);
+    carddb_get_stats(&after);
+
+    if (s->busy_us - busy0 > g_worst_op_us) {
+        g_worst_op_us = s->busy_us - busy0;
+    }
+    if (s->sectors_erased != erased0 || after.active_block != before.active_block) {
+        uint32_t words = s->words_programmed - words0;
+        uint32_t own   = WEAR_REC_BYTES / 4U;
+        *gc_words += (words > own) ? words - own : 0;
+    }
+    return st == CARDDB_OK;
+}
+
+// bg = 1: one carddb_gc_step between user ops, like the low-priority GC task.
+static void wear_bg_step(int bg, uint64_t *gc_words)
+{
+    const flash_sim_stats_t *s = flash_sim_get_stats();
+    uint32_t words0 = s->words_programmed;
+
+    if (bg) {
+        carddb_gc_step(1);
+        *gc_words += s->words_programmed - words0;
+    }
+}
+
+static int bench_wear(uint32_t cycles, uint32_t base, int bg)
+{
+    const flash_sim_stats_t *s = flash_sim_get_stats();
+    uint64_t gc_words = 0;
+    uint64_t words    = 0;
+    uint64_t ops      = 0;
+    int      failures = 0;
+
+    printf("-- %s GC\n", bg ? "background" : "foreground");
+
+    flash_sim_reset();
+    carddb_init();
+    for (uint32_t i = 0; i < base; i++) {
+        failures += !wear_op(1, i, &gc_words);
+    }
+    flash_sim_clear_stats();
+    gc_words      = 0;
+    g_worst_op_us = 0;
+
+    // Cycle c adds card base+c and deletes card c: the whitelist stays at `base`.
+    for (uint32_t c = 0; c < cycles; c++) {
+        failures += !wear_op(1, base + c, &gc_words);
+        wear_bg_step(bg, &gc_words);
+        failures += !wear_op(0, c, &gc_words);
+        wear_bg_step(bg, &gc_words);
+        ops += 2;
+
+        if ((c + 1) % WEAR_REBOOT_EVERY == 0) {
+            carddb_init();
+        }
+    }
+    words = s->words_programmed;
+
+    // Erase counts read back from the sector headers must match the simulator.
+    carddb_stats_t st;
+    carddb_init();
+    carddb_get_stats(&st);
+
+    uint32_t emin = UINT32_MAX, emax = 0;
+    double   sum  = 0, sum2 = 0;
+    printf("sectors:");
+    for (int i = 0; i < WEAR_SECTORS; i++) {
+        uint32_t e = s->erase_count[g_sectors[i]];
+        printf(" %u=%lu", (unsigned)g_sectors[i], (unsigned long)e);
+        emin  = (e < emin) ? e : emin;
+        emax  = (e > emax) ? e : emax;
+        sum  += e;
+        sum2 += (double)e * e;
+    }
+    double mean = sum / WEAR_SECTORS;
+    printf("\nerase: min=%lu max=%lu mean=%.1f stddev=%.2f (headers: min=%lu max=%lu)\n",
+           (unsigned long)emin, (unsigned long)emax, mean,
+           sqrt(sum2 / WEAR_SECTORS - mean * mean),
+           (unsigned long)st.erase_min, (unsigned long)st.erase_max);
+    if (st.erase_min != emin || st.erase_max != emax) {
+        failures++;
+    }
+
+    if ((uint32_t)carddb_get_all(NULL, 0) != base) {
+        failures++;
+    }
+
+    double user_bytes = (double)ops * WEAR_REC_BYTES;
+    printf("write amp: %.3f (gc %.3f, checkpoints %.3f), %llu ops, %.1f MB programmed\n",
+           (double)words * 4.0 / user_bytes,
+           (double)gc_words * 4.0 / user_bytes,
+           ((double)words - (double)gc_words) * 4.0 / user_bytes - 1.0,
+           (unsigned long long)ops, (double)words * 4.0 / 1e6);
+    printf("worst add/remove: %.2f ms of Flash time\n", (double)g_worst_op_us / 1000.0);
+    return failures;
+}
+
+// Fill the active block until the next add runs GC, then cut power after `cut`
+// words of it.  Every card must survive, in whichever block won.
+static int gc_cut_once(uint32_t cut)
+{
+    card_uid_t  uid;
+    uint32_t c        = GC_CUT_BASE;
+    int      failures = 0;
+
+    flash_sim_reset();
+    carddb_init();
+    for (uint32_t i = 0; i < GC_CUT_BASE; i++) {
+        make_uid(i, &uid);
+        carddb_add(&uid);
+    }
+
+    // Churn until the log is nearly full, then arm the cut.
+    carddb_stats_t st;
+    for (;;) {
+        carddb_get_stats(&st);
+        if (st.log_used + 2U * WEAR_REC_BYTES > st.log_size) {
+            break;
+        }
+        make_uid(c, &uid);
+        carddb_add(&uid);
+        make_uid(c, &uid);
+        carddb_remove(&uid);
+        c++;
+    }
+
+    flash_sim_power_cut_after(cut);
+    for (int k = 0; k < 4 && !flash_sim_power_is_cut(); k++) {
+        make_uid(c, &uid);
+        carddb_add(&uid);
+        make_uid(c, &uid);
+        carddb_remove(&uid);
+        c++;
+    }
+    flash_sim_power_restore();
+
+    carddb_init();
+    for (uint32_t i = 0; i < GC_CUT_BASE; i++) {
+        make_uid(i, &uid);
+        failures += !carddb_check(&uid);
+    }
+    // The in-flight churn card may or may not be there.
+    int cnt = carddb_get_all(NULL, 0);
+    if (cnt < GC_CUT_BASE || cnt > GC_CUT_BASE + 1) {
+        failures++;
+    }
+
+    // The log still works across the next GC.
+    make_uid(0xC0FFEEU, &uid);
+    failures += (carddb_add(&uid) != CARDDB_OK);
+    carddb_init();
+    failures += !carddb_check(&uid);
+
+    if (failures) {
+        printf("gc power-cut after %lu words: cards=%d FAIL\n", (unsigned long)cut, cnt);
+    }
+    return failures;
+}
+
+static int bench_gc_power_cut(void)
+{
+    int failures = 0;
+    int images   = 0;
+    // Checkpoint of GC_CUT_BASE cards + OPEN + HDR of the old block, with margin.
+    uint32_t max_words = (GC_CUT_BASE * CARD_UID_SIZE + 8U * WEAR_REC_BYTES) / 4U + 64U;
+
+    for (uint32_t cut = 0; cut <= max_words; cut += GC_CUT_STEP) {
+        failures += gc_cut_once(cut);
+        images++;
+    }
+    printf("gc power-cut: %d torn images, failures=%d\n", images, failures);
+    return failures;
+}
+
+// Background GC with cards coming and going while it copies; cut power after
+// `cut` words.  Every add / remove that returned must be there after reboot.
+static int gc_bg_cut_once(uint32_t cut)
+{
+    card_uid_t uid;
+    int     failures = 0;
+    int     k;
+
+    flash_sim_reset();
+    carddb_init();
+    for (uint32_t i = 0; i < GC_CUT_BASE; i++) {
+        make_uid(i, &uid);
+        carddb_add(&uid);
+    }
+
+    // Churn one spare card until the background GC is about to start.
+    carddb_stats_t st;
+    for (uint32_t c = 0;; c++) {
+        carddb_get_stats(&st);
+        if ((uint64_t)st.log_used * 100U + 2U * WEAR_REC_BYTES * 100U >=
+            (uint64_t)st.log_size * CARD_DB_GC_START_PCT) {
+            break;
+        }
+        make_uid(0x80000000U + c, &uid);
+        carddb_add(&uid);
+        carddb_remove(&uid);
+    }
+
+    // Round k: a gc step, add card 1000+k, remove base card GC_CUT_BASE-1-k
+    // (from the end, so its slot is freed before the copy gets there).
+    flash_sim_power_cut_after(cut);
+    int in_flight = -1;             // Round whose user op was cut
+    for (k = 0; k < BG_CUT_OPS && !flash_sim_power_is_cut(); k++) {
+        carddb_gc_step(0);
+        if (flash_sim_power_is_cut()) {
+            break;
+        }
+        make_uid(1000U + (uint32_t)k, &uid);
+        carddb_add(&uid);
+        if (!flash_sim_power_is_cut()) {
+            make_uid((uint32_t)(GC_CUT_BASE - 1 - k), &uid);
+            carddb_remove(&uid);
+        }
+        if (flash_sim_power_is_cut()) {
+            in_flight = k;
+        }
+    }
+    flash_sim_power_restore();
+
+    carddb_init();
+    for (int i = 0; i < k; i++) {
+        if (i == in_flight) {
+            continue;
+        }
+        make_uid(1000U + (uint32_t)i, &uid);
+        failures += !carddb_check(&uid);
+        make_uid((uint32_t)(GC_CUT_BASE - 1 - i), &uid);
+        failures += carddb_check(&uid);
+    }
+    for (int i = 0; i < GC_CUT_BASE - 1 - k; i++) {
+        make_uid((uint32_t)i, &uid);
+        failures += !carddb_check(&uid);
+    }
+
+    // Keep going: the log must still finish a GC after the cut.
+    for (int i = 0; i < 4 * GC_CUT_BASE; i++) {
+        carddb_gc_step(1);
+    }
+    make_uid(0xC0FFEEU, &uid);
+    failures += (carddb_add(&uid) != CARDDB_OK);
+    carddb_init();
+    failures += !carddb_check(&uid);
+
+    if (failures) {
+        printf("bg gc power-cut after %lu words: round=%d FAIL (%d)\n",
+               (unsigned long)cut, k, failures);
+    }
+    return failures;
+}
+
+static int bench_gc_bg_power_cut(void)
+{
+    int failures = 0;
+    int images   = 0;
+    // The copy (GC_CUT_BASE UIDs) plus the records written meanwhile, with margin.
+    uint32_t max_words = (GC_CUT_BASE * CARD_UID_SIZE) / 4U + 2U * BG_CUT_OPS * 3U;
+
+    for (uint32_t cut = 0; cut <= max_words; cut += GC_CUT_STEP) {
+        failures += gc_bg_cut_once(cut);
+        images++;
+    }
+    printf("bg gc power-cut: %d torn images, failures=%d\n", images, failures);
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t cycles = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 1000000U;
+    uint32_t base   = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 1000U;
+    int      failures = 0;
+
+    printf("card_db wear sim: %d sectors, %lu cycles, %lu base cards\n",
+           WEAR_SECTORS, (unsigned long)cycles, (unsigned long)base);
+
+    failures += bench_wear(cycles, base, 0);
+    failures += bench_wear(cycles, base, 1);
+    failures += bench_gc_power_cut();
+    failures += bench_gc_bg_power_cut();
+
+    return failures ? 1 : 0;
+}
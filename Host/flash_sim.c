@@ -0,0 +1,286 @@
+#include "flash_sim.h"
+#include "card_db_port.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// --------- Simulated Flash array and state --------------------------------
+
+static uint8_t           g_flash[FLASH_SIM_SIZE];
+static int               g_unlocked = 0;
+static int               g_verbose  = 0;
+static uint32_t          g_last_err = FLASH_SIM_ERR_NONE;
+static flash_sim_stats_t g_stats;
+
+// Power-cut simulation: words left before the cut, and whether it already happened.
+static int               g_cut_armed = 0;
+static uint32_t          g_cut_words = 0;
+static int               g_cut_done  = 0;
+
+static flash_sim_timing_t g_timing = {
+    .program_word_us = 16,
+    .erase_16k_ms    = 250,
+    .erase_64k_ms    = 1100,
+    .erase_128k_ms   = 2000,
+};
+
+// F407 sector map: 4 x 16KB, 1 x 64KB, 7 x 128KB.
+static uint32_t sector_offset(uint32_t sector)
+{
+    if (sector < 4) {
+        return sector * 0x4000U;
+    }
+    if (sector == 4) {
+        return 0x10000U;
+    }
+    return 0x20000U + (sector - 5) * 0x20000U;
+}
+
+static uint32_t sector_size(uint32_t sector)
+{
+    if (sector < 4) {
+        return 0x4000U;
+    }
+    if (sector == 4) {
+        return 0x10000U;
+    }
+    return 0x20000U;
+}
+
+uint32_t carddb_port_sector_addr(uint32_t sector)
+{
+    return FLASH_SIM_BASE + sector_offset(sector);
+}
+
+uint32_t carddb_port_sector_size(uint32_t sector)
+{
+    return sector_size(sector);
+}
+
+static uint32_t sector_erase_us(uint32_t sector)
+{
+    if (sector < 4) {
+        return g_timing.erase_16k_ms * 1000U;
+    }
+    if (sector == 4) {
+        return g_timing.erase_64k_ms * 1000U;
+    }
+    return g_timing.erase_128k_ms * 1000U;
+}
+
+static carddb_status_t sim_fail(uint32_t err)
+{
+    g_last_err = err;
+    g_stats.errors++;
+    return CARDDB_ERR_FLASH;
+}
+
+// --------- Simulator control API ------------------------------------------
+
+void flash_sim_reset(void)
+{
+    memset(g_flash, 0xFF, sizeof(g_flash));
+    g_unlocked = 0;
+    g_last_err = FLASH_SIM_ERR_NONE;
+    flash_sim_power_restore();
+    flash_sim_clear_stats();
+}
+
+void flash_sim_set_timing(const flash_sim_timing_t *timing)
+{
+    g_timing = *timing;
+}
+
+void flash_sim_clear_stats(void)
+{
+    memset(&g_stats, 0, sizeof(g_stats));
+}
+
+const flash_sim_stats_t *flash_sim_get_stats(void)
+{
+    return &g_stats;
+}
+
+void flash_sim_power_cut_after(uint32_t words)
+{
+    g_cut_armed = 1;
+    g_cut_words = words;
+    g_cut_done  = 0;
+}
+
+void flash_sim_power_restore(void)
+{
+    g_cut_armed = 0;
+    g_cut_done  = 0;
+}
+
+int flash_sim_power_is_cut(void)
+{
+    return g_cut_done;
+}
+
+void flash_sim_set_verbose(int verbose)
+{
+    g_verbose = verbose;
+}
+
+// --------- card_db port implementation ------------------------------------
+
+void carddb_port_flash_unlock(void)
+{
+    g_unlocked = 1;
+}
+
+void carddb_port_flash_lock(void)
+{
+    g_unlocked = 0;
+}
+
+static carddb_status_t sim_program_word(uint32_t addr, uint32_t word)
+{
+    if (!g_unlocked) {
+        return sim_fail(FLASH_SIM_ERR_LOCKED);
+    }
+    if ((addr % 4) != 0 ||
+        addr < FLASH_SIM_BASE ||
+        addr + 4 > FLASH_SIM_BASE + FLASH_SIM_SIZE) {
+        return sim_fail(FLASH_SIM_ERR_ALIGN);
+    }
+
+    uint8_t *cell = &g_flash[addr - FLASH_SIM_BASE];
+    uint32_t old;
+    memcpy(&old, cell, 4);
+
+    if (g_cut_done) {
+        return CARDDB_OK;   // CPU is "dead", nothing reaches the Flash
+    }
+    if (g_cut_armed && g_cut_words-- == 0) {
+        // Power dropped in the middle of this word: only some bits got cleared.
+        uint32_t merged = old & (word | 0xFFFF0000U);
+        memcpy(cell, &merged, 4);
+        g_cut_done = 1;
+        return CARDDB_OK;
+    }
+
+    g_stats.busy_us += g_timing.program_word_us;
+    g_stats.words_programmed++;
+
+    // NOR Flash can only clear bits; a 0 -> 1 transition needs an erase.
+    if ((old & word) != word) {
+        uint32_t merged = old & word;
+        memcpy(cell, &merged, 4);
+        return sim_fail(FLASH_SIM_ERR_PROG);
+    }
+
+    memcpy(cell, &word, 4);
+    return CARDDB_OK;
+}
+
+// The simulated part runs at 2.7-3.6 V without VPP: x32 word programming.
+carddb_status_t carddb_port_flash_program(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i += 4) {
+        uint32_t word;
+        memcpy(&word, data + i, 4);
+        carddb_status_t st = sim_program_word(addr + i, word);
+        if (st != CARDDB_OK) {
+            return st;
+        }
+    }
+    return CARDDB_OK;
+}
+
+carddb_status_t carddb_port_flash_erase_sector(uint32_t sector)
+{
+    if (!g_unlocked) {
+        return sim_fail(FLASH_SIM_ERR_LOCKED);
+    }
+    if (sector >= FLASH_SIM_SECTOR_COUNT) {
+        return sim_fail(FLASH_SIM_ERR_SECTOR);
+    }
+
+    if (g_cut_done) {
+        return CARDDB_OK;
+    }
+    memset(&g_flash[sector_offset(sector)], 0xFF, sector_size(sector));
+
+    g_stats.busy_us += sector_erase_us(sector);
+    g_stats.sectors_erased++;
+    g_stats.erase_count[sector]++;
+    return CARDDB_OK;
+}
+
+// Software model of the F407 CRC unit: words in, MSB first.
+static uint32_t g_crc32_tab[256];
+
+static uint32_t crc32_word(uint32_t crc, uint32_t word)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        crc = (crc << 8) ^ g_crc32_tab[(crc >> 24) ^ ((word >> shift) & 0xFFU)];
+    }
+    return crc;
+}
+
+uint32_t carddb_port_crc32(const uint8_t *data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFFU;
+    uint32_t word;
+
+    if (g_crc32_tab[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i << 24;
+            for (int j = 0; j < 8; j++) {
+                c = (c & 0x80000000U) ? (c << 1) ^ 0x04C11DB7U : (c << 1);
+            }
+            g_crc32_tab[i] = c;
+        }
+    }
+
+    for (; len >= 4; data += 4, len -= 4) {
+        word = (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+               ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        crc = crc32_word(crc, word);
+    }
+    if (len > 0) {
+        word = 0xFFFFFFFFU;
+        for (uint32_t i = 0; i < len; i++) {
+            word &= ~(0xFFU << (8 * i));
+            word |= (uint32_t)data[i] << (8 * i);
+        }
+        crc = crc32_word(crc, word);
+    }
+    return crc;
+}
+
+uint32_t carddb_port_flash_error(void)
+{
+    return g_last_err;
+}
+
+const uint8_t *carddb_port_flash_ptr(uint32_t addr)
+{
+    return &g_flash[addr - FLASH_SIM_BASE];
+}
+
+// Single-threaded bench, nothing to serialise.
+void carddb_port_init(void)
+{
+}
+
+void carddb_port_lock(void)
+{
+}
+
+void carddb_port_unlock(void)
+{
+}
+
+void carddb_port_debug_printf(const char *fmt, ...)
+{
+    if (g_verbose) {
+        va_list ap;
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        va_end(ap);
+    }
+}
@@ -0,0 +1,64 @@
+// flash_sim.h  — STM32F407 內部 Flash 的記憶體模擬 (host build 用)
+//
+// 模擬重點：
+//   - 只能把 bit 從 1 寫成 0，要變回 1 只能整個 sector erase
+//   - 沒 unlock 就 program/erase 會失敗
+//   - 每個 word program / sector erase 都會累加「模擬耗時」，方便估算板子上的時間
+//   - 可以模擬斷電：第 N 個 word 只寫一半 bit，之後的 program/erase 都不生效
+
+#ifndef FLASH_SIM_H
+#define FLASH_SIM_H
+
+#include <stdint.h>
+
+#define FLASH_SIM_BASE          0x08000000U
+#define FLASH_SIM_SIZE          (1024U * 1024U)   // STM32F407VG: 1 MB
+#define FLASH_SIM_SECTOR_COUNT  12
+
+// Error codes reported through carddb_port_flash_error()
+#define FLASH_SIM_ERR_NONE      0x00U
+#define FLASH_SIM_ERR_LOCKED    0x01U   // program/erase while locked
+#define FLASH_SIM_ERR_ALIGN     0x02U   // address not 4-byte aligned / out of range
+#define FLASH_SIM_ERR_PROG      0x04U   // tried to flip a 0 bit back to 1
+#define FLASH_SIM_ERR_SECTOR    0x08U   // bad sector number
+
+// Typical timings from the F407 datasheet (x32 parallelism, 2.7-3.6 V).
+typedef struct {
+    uint32_t program_word_us;   // per 32-bit word
+    uint32_t erase_16k_ms;      // sectors 0..3
+    uint32_t erase_64k_ms;      // sector 4
+    uint32_t erase_128k_ms;     // sectors 5..11
+} flash_sim_timing_t;
+
+typedef struct {
+    uint64_t busy_us;           // accumulated simulated program/erase time
+    uint32_t words_programmed;
+    uint32_t sectors_erased;
+    uint32_t erase_count[FLASH_SIM_SECTOR_COUNT];
+    uint32_t errors;
+} flash_sim_stats_t;
+
+// Erase the whole simulated Flash (all 0xFF) and clear statistics.
+void flash_sim_reset(void);
+
+// Override the default timing model.
+void flash_sim_set_timing(const flash_sim_timing_t *timing);
+
+// Clear statistics only (Flash contents are kept).
+void flash_sim_clear_stats(void);
+
+const flash_sim_stats_t *flash_sim_get_stats(void);
+
+// Simulate power loss: the next `words` word programs succeed, the one after
+// that only gets its low 16 bits programmed (partial program), and every later
+// program / erase is silently dropped until flash_sim_power_restore().
+void flash_sim_power_cut_after(uint32_t words);
+void flash_sim_power_restore(void);
+
+// 1 = power was cut (some program/erase got dropped since the last restore).
+int flash_sim_power_is_cut(void);
+
+// 1 = forward card_db debug output to stdout, 0 = drop it (default).
+void flash_sim_set_verbose(int verbose);
+
+#endif // FLASH_SIM_H
@@ -0,0 +1,156 @@
+// keypad_replay.c  — keypad_fsm 在 host 上重播錄下來的 bitmap
+//
+// 用 Core/Src/keypad_fsm.c (跟韌體同一份)，把一段一段 16-bit 矩陣 bitmap (bit = row * 4 + col)
+// 照 KEYPAD_SAMPLE_MS 的間隔餵進 keypad_fsm_sample()，比對吐出來的
+// PRESS / RELEASE / LONG 事件、鍵、tick 要跟預期的一模一樣，最後狀態機要回到 idle：
+//   - bounce   : 按下 / 放開時接點彈跳，只能有一個 PRESS、一個 RELEASE
+//   - rollover : 前一個鍵還沒放開就按下一個 (兩個 row)，兩個 PRESS 都要有
+//   - ghost    : 按著 1、2 再按 4，矩形第四角 5 也讀成按著：這段取樣整個不算
+//   - long     : 按住超過 KEYPAD_LONG_MS，PRESS 之後剛好一個 LONG
+// 有不一樣就印出來，exit code 1。
+//
+// 用法: ./keypad_replay [-v]
+
+#include "keypad_fsm.h"
+#include <stdio.h>
+#include <string.h>
+
+// The expected ticks below assume the default timing.
+typedef char keypad_replay_timing_check[(KEYPAD_SAMPLE_MS == 5 && KEYPAD_INTEG_MAX == 4 &&
+                                         KEYPAD_LONG_MS == 800) ? 1 : -1];
+
+typedef struct {
+    uint16_t raw;       // matrix bitmap
+    uint16_t n;         // for this many samples
+} seg_t;
+
+typedef struct {
+    uint8_t  type;
+    char     key;
+    uint32_t tick;
+} expect_t;
+
+typedef struct {
+    const char     *name;
+    const seg_t    *segs;
+    int             nsegs;
+    const expect_t *ev;
+    int             nev;
+} trace_t;
+
+#define KEY_1   0x0001U     // row 0 col 0
+#define KEY_2   0x0002U     // row 0 col 1
+#define KEY_4   0x0010U     // row 1 col 0
+#define KEY_5   0x0020U     // row 1 col 1
+#define KEY_6   0x0040U     // row 1 col 2
+#define KEY_HASH 0x4000U    // row 3 col 2
+
+#define P KEYPAD_EV_PRESS
+#define R KEYPAD_EV_RELEASE
+#define L KEYPAD_EV_LONG
+
+#define COUNT(a) (int)(sizeof(a) / sizeof((a)[0]))
+
+// '5' bounces twice going down and once coming up.
+static const seg_t bounce_segs[] = {
+    { KEY_5, 1 }, { 0, 1 }, { KEY_5, 1 }, { 0, 1 }, { KEY_5, 6 },
+    { 0, 1 }, { KEY_5, 1 }, { 0, 6 },
+};
+static const expect_t bounce_ev[] = {
+    { P, '5', 35 }, { R, '5', 75 },
+};
+
+// '1' held, '6' pressed, '1' released, then '6' released.
+static const seg_t rollover_segs[] = {
+    { KEY_1, 6 }, { KEY_1 | KEY_6, 6 }, { KEY_6, 6 }, { 0, 6 },
+};
+static const expect_t rollover_ev[] = {
+    { P, '1', 15 }, { P, '6', 45 }, { R, '1', 75 }, { R, '6', 105 },
+};
+
+// '1' + '2' held; adding '4' also reads '5' (rows 0 and 1 share columns 0 and 1).
+static const seg_t ghost_segs[] = {
+    { KEY_1 | KEY_2, 6 }, { KEY_1 | KEY_2 | KEY_4 | KEY_5, 6 }, { KEY_1 | KEY_2, 6 }, { 0, 6 },
+};
+static const expect_t ghost_ev[] = {
+    { P, '1', 15 }, { P, '2', 15 }, { R, '1', 105 }, { R, '2', 105 },
+};
+
+// '#' held for one second.
+static const seg_t long_segs[] = {
+    { KEY_HASH, 200 }, { 0, 6 },
+};
+static const expect_t long_ev[] = {
+    { P, '#', 15 }, { L, '#', 815 }, { R, '#', 1015 },
+};
+
+static const trace_t g_traces[] = {
+    { "bounce",   bounce_segs,   COUNT(bounce_segs),   bounce_ev,   COUNT(bounce_ev)   },
+    { "rollover", rollover_segs, COUNT(rollover_segs), rollover_ev, COUNT(rollover_ev) },
+    { "ghost",    ghost_segs,    COUNT(ghost_segs),    ghost_ev,    COUNT(ghost_ev)    },
+    { "long",     long_segs,     COUNT(long_segs),     long_ev,     COUNT(long_ev)     },
+};
+
+static const char *const g_type_name[] = { "PRESS", "RELEASE", "LONG" };
+
+static int g_verbose;
+
+static int replay(const trace_t *t)
+{
+    keypad_fsm_t   fsm;
+    keypad_event_t ev[2 * KEYPAD_KEYS];
+    uint32_t       tick = 0;
+    int            got = 0, fail = 0;
+
+    keypad_fsm_init(&fsm);
+
+    for (int s = 0; s < t->nsegs; s++) {
+        for (int i = 0; i < t->segs[s].n; i++, tick += KEYPAD_SAMPLE_MS) {
+            int n = keypad_fsm_sample(&fsm, t->segs[s].raw, tick, ev, 2 * KEYPAD_KEYS);
+
+            for (int k = 0; k < n; k++, got++) {
+                if (g_verbose) {
+                    printf("  %-8s %-7s %c tick=%u\n", t->name, g_type_name[ev[k].type],
+                           ev[k].key, (unsigned)ev[k].tick);
+                }
+                if (got >= t->nev) {
+                    printf("%s: unexpected %s %c at %u\n", t->name, g_type_name[ev[k].type],
+                           ev[k].key, (unsigned)ev[k].tick);
+                    fail = 1;
+                    continue;
+                }
+                const expect_t *e = &t->ev[got];
+                if (ev[k].type != e->type || ev[k].key != e->key || ev[k].tick != e->tick) {
+                    printf("%s: event %d is %s %c at %u, expected %s %c at %u\n", t->name, got,
+                           g_type_name[ev[k].type], ev[k].key, (unsigned)ev[k].tick,
+                           g_type_name[e->type], e->key, (unsigned)e->tick);
+                    fail = 1;
+                }
+            }
+        }
+    }
+
+    if (got < t->nev) {
+        printf("%s: %d events, expected %d\n", t->name, got, t->nev);
+        fail = 1;
+    }
+    if (!keypad_fsm_idle(&fsm)) {
+        printf("%s: not idle at the end (state=%04X)\n", t->name, fsm.state);
+        fail = 1;
+    }
+    printf("%-8s: %3u samples, %d events, %s\n", t->name, (unsigned)(tick / KEYPAD_SAMPLE_MS), got,
+           fail ? "FAIL" : "ok");
+    return fail;
+}
+
+int main(int argc, char **argv)
+{
+    int fail = 0;
+
+    g_verbose = (argc > 1 && strcmp(argv[1], "-v") == 0);
+
+    for (int i = 0; i < COUNT(g_traces); i++) {
+        fail |= replay(&g_traces[i]);
+    }
+    return fail ? 1 : 0;
+}
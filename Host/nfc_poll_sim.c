@@ -0,0 +1,211 @@
+// nfc_poll_sim.c  — NFC 輪詢排程在 host 上的模擬
+//
+// 用 Core/Src/nfc_poll.c (跟韌體同一份) 跑一個月的刷卡 / 按鍵時間軸，比較：
+//   - old       : 以前的 vNfcTask，天線一直開，REQA 等滿 30 ms timeout + vTaskDelay(300)
+//   - fixed+pd  : 一樣 300 ms 一次，但 poll 之間 soft power-down、REQA 只等 2 ms
+//   - adaptive  : nfc_poll 排程 (按鍵 / 刷卡後快速掃，沒事就指數 back-off) + soft power-down
+// 報告刷卡到 REQA 看到卡的延遲 (p50 / p90 / p99 / max，分「之前有按鍵」/「連續刷卡」/「冷的」)
+// 跟天線開著的時間比例 (duty)、換算成 RC522 平均電流。
+//
+// 時間都是模型值 (RC522 datasheet 等級的數字)，拿來比較策略，不是量測：
+//   振盪器醒來 0.5 ms、卡在天線場裡要 5 ms 才會回、讀 UID + HALT 40 ms、開門後畫面停 800 ms
+//
+// 用法: ./nfc_poll_sim [seed]
+//       make pollsim 會用不同的 NFC_POLL_IDLE_MAX_MS 各編一次
+
+#include "nfc_poll.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define SIM_DAYS        30
+#define TAPS_PER_DAY    150
+#define KEYS_PER_DAY    60      // key presses that are not followed by a tap (PIN entry)
+#define P_KEY_BEFORE    30      // % of taps with a key press 1..4 s before
+#define P_BURST         20      // % of taps followed by another one 2..8 s later
+
+#define T_WAKE_US       500     // soft power-down exit (oscillator)
+#define T_SETTLE_US     5000    // MFRC522_FIELD_SETTLE_MS
+#define T_CARD_READY_US 5000    // a card must be in the field this long before REQA
+#define T_REQA_SHORT_US 2500    // MFRC522_POLL_TIMEOUT_MS + SPI
+#define T_REQA_OLD_US   30500   // old 30 ms timer + SPI
+#define T_READ_US       40000   // ReadAllUids: anticollision, SELECT, HALT, last REQA
+#define T_ACTION_US     800000  // vTaskDelay after unlock / deny
+#define OLD_DELAY_MS    300
+#define I_FIELD_MA      75.0    // RC522 with the antenna driven (TVDD + DVDD + AVDD)
+
+#define DAY_US          (24ULL * 3600ULL * 1000000ULL)
+
+enum { TAP_COLD, TAP_KEY, TAP_BURST, TAP_KINDS };
+static const char *const kind_name[TAP_KINDS] = { "cold", "after key", "burst" };
+
+typedef struct {
+    uint64_t at;        // card enters the field
+    int      kind;
+} tap_t;
+
+typedef struct {
+    const char *name;
+    int         adaptive;
+    int         power_down;
+} policy_t;
+
+static tap_t    *g_taps;
+static uint64_t *g_keys;
+static int       g_ntaps, g_nkeys;
+static uint64_t  g_lat[TAP_KINDS + 1][SIM_DAYS * TAPS_PER_DAY * 2];
+static int       g_nlat[TAP_KINDS + 1];
+
+static uint64_t g_rng = 88172645463325252ULL;
+
+static uint64_t rnd(uint64_t n)
+{
+    g_rng ^= g_rng << 13;
+    g_rng ^= g_rng >> 7;
+    g_rng ^= g_rng << 17;
+    return g_rng % n;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_tap(const void *a, const void *b)
+{
+    return cmp_u64(&((const tap_t *)a)->at, &((const tap_t *)b)->at);
+}
+
+static void make_timeline(void)
+{
+    g_taps = malloc(sizeof(*g_taps) * SIM_DAYS * TAPS_PER_DAY * 2);
+    g_keys = malloc(sizeof(*g_keys) * SIM_DAYS * (TAPS_PER_DAY + KEYS_PER_DAY));
+
+    for (uint64_t d = 0; d < SIM_DAYS; d++) {
+        uint64_t day = d * DAY_US + 10000000ULL;
+        for (int i = 0; i < TAPS_PER_DAY; i++) {
+            uint64_t at   = day + rnd(DAY_US - 20000000ULL);
+            int      kind = TAP_COLD;
+            if ((int)rnd(100) < P_KEY_BEFORE) {
+                g_keys[g_nkeys++] = at - 1000000ULL - rnd(3000000ULL);
+                kind = TAP_KEY;
+            }
+            g_taps[g_ntaps++] = (tap_t){ at, kind };
+            if ((int)rnd(100) < P_BURST) {
+                g_taps[g_ntaps++] = (tap_t){ at + 2000000ULL + rnd(6000000ULL), TAP_BURST };
+            }
+        }
+        for (int i = 0; i < KEYS_PER_DAY; i++) {
+            g_keys[g_nkeys++] = day + rnd(DAY_US - 20000000ULL);
+        }
+    }
+    qsort(g_taps, (size_t)g_ntaps, sizeof(*g_taps), cmp_tap);
+    qsort(g_keys, (size_t)g_nkeys, sizeof(*g_keys), cmp_u64);
+}
+
+static double pct(int k, int p)
+{
+    int n = g_nlat[k];
+    if (n == 0) {
+        return 0.0;
+    }
+    int i = (int)((int64_t)(n - 1) * p / 100);
+    return (double)g_lat[k][i] / 1000.0;
+}
+
+static void run(const policy_t *pol)
+{
+    nfc_poll_t p;
+    uint64_t   t = 0, on = 0, last_key = 0;
+    long       polls = 0;
+    int        ti = 0, ki = 0;
+
+    for (int k = 0; k <= TAP_KINDS; k++) {
+        g_nlat[k] = 0;
+    }
+    nfc_poll_init(&p, 0);
+
+    while (ti < g_ntaps) {
+        // One poll: wake, let the field settle, REQA (read the card if one answers).
+        uint64_t busy = pol->power_down ? T_WAKE_US + T_SETTLE_US : 0;
+        uint64_t reqa = t + busy;
+        int      seen = 0;
+
+        if (g_taps[ti].at + T_CARD_READY_US <= reqa) {
+            uint64_t lat = reqa - g_taps[ti].at;
+            g_lat[g_taps[ti].kind][g_nlat[g_taps[ti].kind]++] = lat;
+            g_lat[TAP_KINDS][g_nlat[TAP_KINDS]++] = lat;
+            ti++;
+            seen = 1;
+            busy += T_READ_US;
+        } else {
+            busy += pol->power_down ? T_REQA_SHORT_US : T_REQA_OLD_US;
+        }
+        polls++;
+        t  += busy;
+        on += busy;
+        if (seen) {
+            t += T_ACTION_US;
+            if (!pol->power_down) {
+                on += T_ACTION_US;
+            }
+        }
+
+        // Sleep until the next poll (a key press wakes the adaptive task early).
+        uint64_t wake;
+        if (pol->adaptive) {
+            while (ki < g_nkeys && g_keys[ki] <= t) {
+                last_key = g_keys[ki++];
+            }
+            nfc_poll_activity(&p, (uint32_t)(last_key / 1000));
+            wake = t + 1000ULL * nfc_poll_next(&p, (uint32_t)(t / 1000), seen);
+            if (ki < g_nkeys && g_keys[ki] < wake) {
+                wake = g_keys[ki];
+            }
+        } else {
+            wake = t + (seen ? 0 : 1000ULL * OLD_DELAY_MS);
+        }
+        if (!pol->power_down) {
+            on += wake - t;
+        }
+        t = wake;
+    }
+
+    for (int k = 0; k <= TAP_KINDS; k++) {
+        qsort(g_lat[k], (size_t)g_nlat[k], sizeof(g_lat[k][0]), cmp_u64);
+    }
+    double duty = (double)on / (double)t;
+    printf("%-9s all      : p50 %6.1f  p90 %6.1f  p99 %6.1f  max %6.1f ms | duty %6.2f%%  %5.0f polls/h  ~%5.2f mA\n",
+           pol->name, pct(TAP_KINDS, 50), pct(TAP_KINDS, 90), pct(TAP_KINDS, 99), pct(TAP_KINDS, 100),
+           100.0 * duty, (double)polls / ((double)t / 3.6e9), duty * I_FIELD_MA);
+    for (int k = 0; k < TAP_KINDS; k++) {
+        printf("%-9s %-9s: p50 %6.1f  p90 %6.1f  p99 %6.1f  max %6.1f ms (%d taps)\n",
+               "", kind_name[k], pct(k, 50), pct(k, 90), pct(k, 99), pct(k, 100), g_nlat[k]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const policy_t policies[] = {
+        { "old",      0, 0 },
+        { "fixed+pd", 0, 1 },
+        { "adaptive", 1, 1 },
+    };
+
+    if (argc > 1) {
+        g_rng ^= strtoull(argv[1], NULL, 0) * 0x9E3779B97F4A7C15ULL;
+    }
+    make_timeline();
+
+    printf("nfc poll sim: %d days, %d taps, %d key presses; fast=%d ms for %d ms, idle %d..%d ms\n",
+           SIM_DAYS, g_ntaps, g_nkeys, NFC_POLL_FAST_MS, NFC_POLL_ACTIVE_MS,
+           NFC_POLL_IDLE_MIN_MS, NFC_POLL_IDLE_MAX_MS);
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+        run(&policies[i]);
+    }
+
+    free(g_taps);
+    free(g_keys);
+    return 0;
+}
@@ -0,0 +1,293 @@
+// ram_map.c  — 韌體 ELF 的 RAM 使用表 (一個物件一行)
+//
+// 讀 ELF 的 symbol table，把放在 SRAM / CCMRAM 的變數依大小列出來：
+//   - FreeRTOS 物件都是 static allocation，buffer 照命名放：
+//       <name>_stack / _tcb (task)、_buf / _qcb (queue)、_scb (stream buffer)、_tmr (timer)、_sem
+//     同一個檔案裡同一個 <name> 的幾塊合成一行 (例：keypad.c 的 keyq = buf 256 + qcb 80)
+//   - 其他變數 (g_index、log ring、ucHeap ...) 各自一行，比 min_bytes 小的合成一行
+//   - 最後是每個 region 到 _ebss / _eccmbss 為止用掉多少、加上 linker script 保留的
+//     _Min_Stack_Size / _Min_Heap_Size 之後還剩多少
+// static 變數 (LOCAL symbol) 會標出是哪個 .c 的。
+//
+// 用法: ./ram_map Project0.elf [min_bytes]      (預設 min_bytes = 64)
+//   例: ./ram_map ../Debug/Project0.elf
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SHT_SYMTAB  2
+#define STT_OBJECT  1
+#define STT_FILE    4
+#define STB_LOCAL   0
+
+typedef struct {
+    const char *name;
+    uint64_t    base;
+    uint64_t    size;
+    const char *end_sym;    // linker symbol where static data ends
+} region_t;
+
+// STM32F407VGTX_FLASH.ld
+static const region_t g_regions[] = {
+    { "RAM",    0x20000000ULL, 128 * 1024, "_ebss"    },
+    { "CCMRAM", 0x10000000ULL,  64 * 1024, "_eccmbss" },
+};
+#define NREGIONS    (int)(sizeof(g_regions) / sizeof(g_regions[0]))
+
+static const char *const g_suffix[] = { "_stack", "_tcb", "_buf", "_qcb", "_scb", "_tmr", "_sem" };
+#define NSUFFIX     (int)(sizeof(g_suffix) / sizeof(g_suffix[0]))
+
+typedef struct {
+    char        key[64];        // object name (suffix and g_ prefix stripped)
+    const char *file;           // NULL for globals
+    int         region;
+    uint64_t    addr;           // lowest address of its parts
+    uint64_t    size;
+    char        parts[96];
+} object_t;
+
+static object_t *g_obj;
+static int       g_nobj, g_cap;
+
+static uint64_t g_end[NREGIONS];
+static uint64_t g_min_stack, g_min_heap;
+
+static uint64_t rd_le(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static int region_of(uint64_t addr)
+{
+    for (int r = 0; r < NREGIONS; r++) {
+        if (addr >= g_regions[r].base && addr < g_regions[r].base + g_regions[r].size) {
+            return r;
+        }
+    }
+    return -1;
+}
+
+static const char *base_name(const char *path)
+{
+    const char *s = strrchr(path, '/');
+    return s ? s + 1 : path;
+}
+
+static void add_object(const char *name, const char *file, int region, uint64_t addr, uint64_t size)
+{
+    char        key[64];
+    const char *part = NULL;
+    size_t      n    = strlen(name);
+
+    if (strncmp(name, "g_", 2) == 0) {
+        name += 2;
+        n    -= 2;
+    }
+    for (int i = 0; i < NSUFFIX; i++) {
+        size_t m = strlen(g_suffix[i]);
+        if (n > m && strcmp(name + n - m, g_suffix[i]) == 0) {
+            part = g_suffix[i] + 1;
+            n   -= m;
+            break;
+        }
+    }
+    if (n >= sizeof(key)) {
+        n = sizeof(key) - 1;
+    }
+    memcpy(key, name, n);
+    key[n] = '\0';
+
+    object_t *o = NULL;
+    if (part != NULL) {
+        for (int i = 0; i < g_nobj; i++) {
+            if (g_obj[i].parts[0] != '\0' && g_obj[i].region == region &&
+                strcmp(g_obj[i].key, key) == 0 &&
+                (g_obj[i].file == file || (g_obj[i].file && file && strcmp(g_obj[i].file, file) == 0))) {
+                o = &g_obj[i];
+                break;
+            }
+        }
+    }
+    if (o == NULL) {
+        if (g_nobj == g_cap) {
+            g_cap = g_cap ? g_cap * 2 : 256;
+            g_obj = realloc(g_obj, sizeof(*g_obj) * (size_t)g_cap);
+        }
+        o = &g_obj[g_nobj++];
+        memset(o, 0, sizeof(*o));
+        strcpy(o->key, key);
+        o->file   = file;
+        o->region = region;
+        o->addr   = addr;
+    }
+    if (part != NULL) {
+        size_t len = strlen(o->parts);
+        snprintf(o->parts + len, sizeof(o->parts) - len, "%s%s %llu",
+                 len ? " + " : "", part, (unsigned long long)size);
+    }
+    if (addr < o->addr) {
+        o->addr = addr;
+    }
+    o->size += size;
+}
+
+static int load_elf(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *img = malloc((size_t)size);
+    if (img == NULL || fread(img, 1, (size_t)size, f) != (size_t)size) {
+        fclose(f);
+        free(img);
+        return -1;
+    }
+    fclose(f);
+
+    if (size < 52 || memcmp(img, "\x7f" "ELF", 4) != 0 || img[5] != 1) {
+        fprintf(stderr, "%s: not a little-endian ELF file\n", path);
+        free(img);
+        return -1;
+    }
+
+    int      is64    = (img[4] == 2);
+    uint64_t shoff   = is64 ? rd_le(img + 0x28, 8) : rd_le(img + 0x20, 4);
+    uint32_t shentsz = (uint32_t)rd_le(img + (is64 ? 0x3A : 0x2E), 2);
+    uint32_t shnum   = (uint32_t)rd_le(img + (is64 ? 0x3C : 0x30), 2);
+
+    if (shoff + (uint64_t)shnum * shentsz > (uint64_t)size) {
+        fprintf(stderr, "%s: bad section header table\n", path);
+        free(img);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < shnum; i++) {
+        const uint8_t *sh = img + shoff + (uint64_t)i * shentsz;
+        if (rd_le(sh + 4, 4) != SHT_SYMTAB) {
+            continue;
+        }
+        uint64_t off    = is64 ? rd_le(sh + 0x18, 8) : rd_le(sh + 0x10, 4);
+        uint64_t len    = is64 ? rd_le(sh + 0x20, 8) : rd_le(sh + 0x14, 4);
+        uint32_t link   = (uint32_t)rd_le(sh + (is64 ? 0x28 : 0x18), 4);
+        uint64_t entsz  = is64 ? rd_le(sh + 0x38, 8) : rd_le(sh + 0x24, 4);
+        if (link >= shnum || entsz == 0 || off + len > (uint64_t)size) {
+            continue;
+        }
+        const uint8_t *strsh  = img + shoff + (uint64_t)link * shentsz;
+        uint64_t       stroff = is64 ? rd_le(strsh + 0x18, 8) : rd_le(strsh + 0x10, 4);
+        const char    *file   = NULL;
+
+        for (uint64_t s = 0; s + entsz <= len; s += entsz) {
+            const uint8_t *sym   = img + off + s;
+            uint32_t       nm    = (uint32_t)rd_le(sym, 4);
+            uint8_t        info  = is64 ? sym[4] : sym[12];
+            uint64_t       value = is64 ? rd_le(sym + 8, 8) : rd_le(sym + 4, 4);
+            uint64_t       ssize = is64 ? rd_le(sym + 16, 8) : rd_le(sym + 8, 4);
+
+            if (stroff + nm >= (uint64_t)size) {
+                continue;
+            }
+            const char *name = (const char *)img + stroff + nm;
+
+            if ((info & 0xF) == STT_FILE) {
+                file = base_name(name);
+                continue;
+            }
+            for (int r = 0; r < NREGIONS; r++) {
+                if (strcmp(name, g_regions[r].end_sym) == 0) {
+                    g_end[r] = value;
+                }
+            }
+            if (strcmp(name, "_Min_Stack_Size") == 0) {
+                g_min_stack = value;
+            } else if (strcmp(name, "_Min_Heap_Size") == 0) {
+                g_min_heap = value;
+            }
+
+            int r = region_of(value);
+            if ((info & 0xF) != STT_OBJECT || ssize == 0 || r < 0) {
+                continue;
+            }
+            add_object(name, ((info >> 4) == STB_LOCAL) ? file : NULL, r, value, ssize);
+        }
+    }
+    // Symbol names point into img, which therefore stays allocated.
+    return 0;
+}
+
+static int cmp_obj(const void *a, const void *b)
+{
+    const object_t *x = a, *y = b;
+    if (x->region != y->region) {
+        return x->region - y->region;
+    }
+    return (x->size < y->size) - (x->size > y->size);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s firmware.elf [min_bytes]\n", argv[0]);
+        return 2;
+    }
+    uint64_t min_bytes = (argc > 2) ? strtoull(argv[2], NULL, 0) : 64;
+
+    if (load_elf(argv[1]) != 0) {
+        return 1;
+    }
+    qsort(g_obj, (size_t)g_nobj, sizeof(*g_obj), cmp_obj);
+
+    for (int r = 0; r < NREGIONS; r++) {
+        uint64_t total = 0, small = 0;
+        int      nsmall = 0;
+
+        printf("%s 0x%08llX, %llu bytes\n", g_regions[r].name,
+               (unsigned long long)g_regions[r].base, (unsigned long long)g_regions[r].size);
+        printf("  %8s  %-10s  %-22s %-18s %s\n", "bytes", "addr", "object", "file", "parts");
+
+        for (int i = 0; i < g_nobj; i++) {
+            const object_t *o = &g_obj[i];
+            if (o->region != r) {
+                continue;
+            }
+            total += o->size;
+            if (o->size < min_bytes) {
+                small += o->size;
+                nsmall++;
+                continue;
+            }
+            printf("  %8llu  0x%08llX  %-22s %-18s %s\n", (unsigned long long)o->size,
+                   (unsigned long long)o->addr, o->key, o->file ? o->file : "-", o->parts);
+        }
+        if (nsmall) {
+            printf("  %8llu  %-10s  (%d objects < %llu bytes)\n", (unsigned long long)small, "",
+                   nsmall, (unsigned long long)min_bytes);
+        }
+
+        printf("  %8llu  total objects\n", (unsigned long long)total);
+        if (g_end[r] > g_regions[r].base) {
+            uint64_t used = g_end[r] - g_regions[r].base;
+            uint64_t rsv  = (r == 0) ? g_min_stack + g_min_heap : 0;
+            printf("  %8llu  static data up to %s", (unsigned long long)used, g_regions[r].end_sym);
+            if (rsv) {
+                printf(" + %llu main stack / newlib heap", (unsigned long long)rsv);
+            }
+            printf(" -> %lld bytes free\n",
+                   (long long)g_regions[r].size - (long long)used - (long long)rsv);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+// trace_decode.c  — 把板子送出的 binary trace (trace.h) 還原成文字
+//
+// format 字串只存在 ELF 的 .trace_fmt section 裡，這支程式把它讀出來，
+// 再把 UART 收到的 COBS frame 一筆一筆解開：
+//   payload = varint(fmt_id << 3 | level) varint(ms) varint(arg0) ...
+//
+// 用法: ./trace_decode Project0.elf [capture.bin]     (沒給檔案就讀 stdin)
+//   例: stty -F /dev/ttyUSB0 115200 raw && ./trace_decode ../Debug/Project0.elf < /dev/ttyUSB0
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_MAX   256
+
+static uint8_t  *g_fmt;         // .trace_fmt contents
+static uint64_t  g_fmt_addr;    // its sh_addr (0 on target)
+static uint64_t  g_fmt_size;
+
+static const char *g_level_name[] = { "-", "E", "W", "I", "D", "?", "?", "?" };
+
+// --------- ELF: find .trace_fmt -------------------------------------------
+
+static uint64_t rd_le(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static int load_elf(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *img = malloc((size_t)size);
+    if (img == NULL || fread(img, 1, (size_t)size, f) != (size_t)size) {
+        fclose(f);
+        free(img);
+        return -1;
+    }
+    fclose(f);
+
+    if (size < 52 || memcmp(img, "\x7f" "ELF", 4) != 0 || img[5] != 1) {
+        fprintf(stderr, "%s: not a little-endian ELF file\n", path);
+        free(img);
+        return -1;
+    }
+
+    // Field offsets / sizes differ between ELF32 (target) and ELF64 (host builds).
+    int      is64     = (img[4] == 2);
+    uint64_t shoff    = is64 ? rd_le(img + 0x28, 8) : rd_le(img + 0x20, 4);
+    uint32_t shentsz  = (uint32_t)rd_le(img + (is64 ? 0x3A : 0x2E), 2);
+    uint32_t shnum    = (uint32_t)rd_le(img + (is64 ? 0x3C : 0x30), 2);
+    uint32_t shstrndx = (uint32_t)rd_le(img + (is64 ? 0x3E : 0x32), 2);
+
+    if (shoff + (uint64_t)shnum * shentsz > (uint64_t)size || shstrndx >= shnum) {
+        fprintf(stderr, "%s: bad section header table\n", path);
+        free(img);
+        return -1;
+    }
+
+    const uint8_t *strsh   = img + shoff + (uint64_t)shstrndx * shentsz;
+    uint64_t       stroff  = is64 ? rd_le(strsh + 0x18, 8) : rd_le(strsh + 0x10, 4);
+
+    for (uint32_t i = 0; i < shnum; i++) {
+        const uint8_t *sh   = img + shoff + (uint64_t)i * shentsz;
+        uint32_t       name = (uint32_t)rd_le(sh, 4);
+        uint64_t       addr = is64 ? rd_le(sh + 0x10, 8) : rd_le(sh + 0x0C, 4);
+        uint64_t       off  = is64 ? rd_le(sh + 0x18, 8) : rd_le(sh + 0x10, 4);
+        uint64_t       len  = is64 ? rd_le(sh + 0x20, 8) : rd_le(sh + 0x14, 4);
+
+        if (stroff + name < (uint64_t)size &&
+            strcmp((const char *)img + stroff + name, ".trace_fmt") == 0 &&
+            off + len <= (uint64_t)size) {
+            g_fmt = malloc(len + 1);
+            memcpy(g_fmt, img + off, len);
+            g_fmt[len]  = 0;
+            g_fmt_addr = addr;
+            g_fmt_size = len;
+            free(img);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "%s: no .trace_fmt section\n", path);
+    free(img);
+    return -1;
+}
+
+// --------- Frame decoding -------------------------------------------------
+
+// COBS-decode in place; returns the payload length or -1.
+static int cobs_decode(uint8_t *buf, int len)
+{
+    int in = 0, out = 0;
+
+    while (in < len) {
+        uint8_t code = buf[in++];
+        if (code == 0 || in + code - 1 > len) {
+            return -1;
+        }
+        for (int i = 1; i < code; i++) {
+            buf[out++] = buf[in++];
+        }
+        if (code != 0xFF && in < len) {
+            buf[out++] = 0;
+        }
+    }
+    return out;
+}
+
+static int get_varint(const uint8_t *p, int len, int *pos, uint32_t *v)
+{
+    uint32_t r     = 0;
+    int      shift = 0;
+
+    while (*pos < len && shift < 35) {
+        uint8_t b = p[(*pos)++];
+        r |= (uint32_t)(b & 0x7F) << shift;
+        if ((b & 0x80) == 0) {
+            *v = r;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+// printf the format string with 32-bit integer arguments.
+static void print_formatted(const char *fmt, const uint32_t *args, int nargs)
+{
+    int a = 0;
+
+    while (*fmt) {
+        if (*fmt != '%') {
+            if (*fmt != '\r') {
+                putchar(*fmt);
+            }
+            fmt++;
+            continue;
+        }
+        if (fmt[1] == '%') {
+            putchar('%');
+            fmt += 2;
+            continue;
+        }
+
+        // Copy "%[flags][width][.prec]", drop length modifiers, keep the conversion.
+        char spec[32];
+        int  n = 0;
+        spec[n++] = *fmt++;
+        while (*fmt && strchr("-+ #0123456789.", *fmt) && n < 28) {
+            spec[n++] = *fmt++;
+        }
+        while (*fmt && strchr("hlLqjzt", *fmt)) {
+            fmt++;
+        }
+        char conv = *fmt ? *fmt++ : 'd';
+        spec[n++] = conv;
+        spec[n]   = 0;
+
+        if (a >= nargs) {
+            fputs("<?>", stdout);
+            continue;
+        }
+        uint32_t v = args[a++];
+        if (conv == 'd' || conv == 'i') {
+            printf(spec, (int)(int32_t)v);
+        } else if (strchr("uxXoc", conv)) {
+            printf(spec, (unsigned)v);
+        } else {
+            printf("<%%%c?>", conv);
+        }
+    }
+}
+
+static void decode_frame(uint8_t *buf, int len)
+{
+    uint32_t head, ms, args[16];
+    int      nargs = 0, pos = 0;
+
+    len = cobs_decode(buf, len);
+    if (len <= 0 || !get_varint(buf, len, &pos, &head) || !get_varint(buf, len, &pos, &ms)) {
+        puts("<bad frame>");
+        return;
+    }
+    while (pos < len && nargs < 16 && get_varint(buf, len, &pos, &args[nargs])) {
+        nargs++;
+    }
+
+    uint64_t id = head >> 3;
+    printf("[%6lu.%03lu] %s ", (unsigned long)(ms / 1000), (unsigned long)(ms % 1000),
+           g_level_name[head & 7]);
+
+    if (id < g_fmt_addr || id - g_fmt_addr >= g_fmt_size) {
+        printf("<unknown fmt id 0x%lx>\n", (unsigned long)id);
+        return;
+    }
+    const char *fmt = (const char *)g_fmt + (id - g_fmt_addr);
+    print_formatted(fmt, args, nargs);
+    if (fmt[0] == 0 || fmt[strlen(fmt) - 1] != '\n') {
+        putchar('\n');
+    }
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s firmware.elf [capture.bin]\n", argv[0]);
+        return 2;
+    }
+    if (load_elf(argv[1]) != 0) {
+        return 1;
+    }
+
+    FILE *in = stdin;
+    if (argc > 2 && (in = fopen(argv[2], "rb")) == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    uint8_t frame[FRAME_MAX];
+    int     len = 0, overflow = 0, c;
+
+    while ((c = fgetc(in)) != EOF) {
+        if (c != 0) {
+            if (len < FRAME_MAX) {
+                frame[len++] = (uint8_t)c;
+            } else {
+                overflow = 1;
+            }
+            continue;
+        }
+        if (len > 0 && !overflow) {
+            decode_frame(frame, len);
+        }
+        len      = 0;
+        overflow = 0;
+    }
+    return 0;
+}